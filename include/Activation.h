@@ -254,12 +254,35 @@ namespace dnn
 		bool reorderFwdSrc;
 		bool reorderBwdSrc;
 		bool reorderBwdDiffSrc;
+		std::vector<uint64_t> mask;	// one bit per element, the derivative is MaskHigh where set and MaskLow elsewhere
+		UInt maskStride;			// words per sample
+		bool maskRequested;			// BitMask as asked for, it stays off while the layouts differ (see MaskLayout)
 	
 	public:
 		const Activations ActivationFunction;
 		const Float Alpha;
 		const Float Beta;
 		const Act Func;
+		bool FusedWithMerge;	// the forward pass is done by the merge layer in front (see FusedEpilogue)
+		bool BitMask;			// the backward pass reads a 1-bit mask packed in the forward pass instead of the input
+		const Float MaskHigh;
+		const Float MaskLow;
+
+		// the derivative is a step function of the input, it takes only two values
+		static bool HasStepDerivative(const Activations activation)
+		{
+			switch (activation)
+			{
+			case Activations::BoundedRelu:
+			case Activations::Clip:
+			case Activations::ClipV2:
+			case Activations::HardSigmoid:
+			case Activations::Relu:
+				return true;
+			default:
+				return false;
+			}
+		}
 
 		static auto GetAlpha(const Activations activation, const Float alpha, const Float beta)
 		{
@@ -848,7 +871,14 @@ namespace dnn
 			algorithm(dnnl::algorithm::eltwise_linear),
 			reorderFwdSrc(false),
 			reorderBwdSrc(false),
-			reorderBwdDiffSrc(false)
+			reorderBwdDiffSrc(false),
+			mask(std::vector<uint64_t>()),
+			maskStride(0),
+			maskRequested(false),
+			FusedWithMerge(false),
+			BitMask(false),
+			MaskHigh(activation == Activations::HardSigmoid ? Alpha : Float(1)),
+			MaskLow(activation == Activations::Relu ? Alpha : Float(0))
 		{
 			assert(Inputs.size() == 1);
 		}
@@ -880,6 +910,48 @@ namespace dnn
 			return 1;
 		}
 
+		void SetBatchSize(const UInt batchSize) final override
+		{
+			Layer::SetBatchSize(batchSize);
+
+			SetBitMask(maskRequested, batchSize);
+		}
+
+		// the mask is packed from the Neurons of the input layer and unpacked into its NeuronsD1 in the layout of this layer,
+		// a layer that reorders its source or its input gradient keeps the regular backward pass
+		bool MaskLayout() const
+		{
+			if (!DstMemDesc || !DiffDstMemDesc || !InputLayer->DstMemDesc || !InputLayer->DiffDstMemDesc)
+				return false;
+
+			return !reorderFwdSrc && !reorderBwdDiffSrc && *InputLayer->DstMemDesc == *DstMemDesc && *InputLayer->DiffDstMemDesc == *DiffDstMemDesc;
+		}
+
+		void SetBitMask(const bool enable, const UInt batchSize)
+		{
+			maskRequested = enable;
+			BitMask = enable && HasStepDerivative(ActivationFunction) && MaskLayout();
+
+			maskStride = BitMask ? (PaddedCDHW() + 63ull) / 64ull : 0ull;
+			mask.resize(batchSize * maskStride);
+			mask.shrink_to_fit();
+		}
+
+		UInt GetNeuronsSize(const UInt batchSize) const final override
+		{
+			return Layer::GetNeuronsSize(batchSize) + batchSize * maskStride * sizeof(uint64_t);
+		}
+
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdSrc) + UInt(reorderBwdDiffSrc);
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			auto alpha = Alpha;
@@ -994,6 +1066,9 @@ namespace dnn
 			reorderBwdSrc = bwdDesc->src_desc() != *InputLayer->DstMemDesc;
 			reorderBwdDiffSrc = bwdDesc->diff_src_desc() != *InputLayer->DiffDstMemDesc;
 
+			if (maskRequested)
+				SetBitMask(maskRequested, batchSize);
+
 #ifdef DNN_CACHE_PRIMITIVES
 			fwd = std::make_unique<dnnl::eltwise_forward>(dnnl::eltwise_forward(*fwdDesc));
 			bwd = std::make_unique<dnnl::eltwise_backward>(dnnl::eltwise_backward(*bwdDesc));
@@ -1003,6 +1078,9 @@ namespace dnn
 
 		void ForwardProp(const UInt batchSize, const bool training) final override
 		{
+			if (FusedWithMerge && !training)
+				return;
+
 			const auto plain = IsPlainFormat();
 			const auto threads = batchSize == 1 ? 1ull : GetThreads(batchSize * (plain ? CDHW() : PaddedCDHW()), Float(10));
 
@@ -1249,6 +1327,9 @@ namespace dnn
 #endif
 				Device.stream.wait();
 
+				if (training && BitMask)
+					PackMask(batchSize);
+
 #ifndef DNN_LEAN
 				if (training && !InplaceBwd)
 					InitArray<Float>(NeuronsD1.data(), batchSize * PaddedCDHW());
@@ -1450,6 +1531,12 @@ namespace dnn
 
 			default:
 			{
+				if (BitMask)
+				{
+					MaskedBackwardProp(batchSize);
+					break;
+				}
+
 				auto memSrc = dnnl::memory(*InputLayerFwd->DstMemDesc, Device.engine, InputLayerFwd->Neurons.data());
 				auto srcMem = reorderBwdSrc ? dnnl::memory(bwdDesc->src_desc(), Device.engine) : memSrc;
 				if (reorderBwdSrc)
@@ -1491,5 +1578,83 @@ namespace dnn
 			ReleaseGradient();
 #endif // DNN_LEAN
 		}
+
+	private:
+		template<typename Pred>
+		void PackMask(const UInt batchSize, const Pred& pred)
+		{
+			const auto elements = IsPlainFormat() ? CDHW() : PaddedCDHW();
+			const auto part = GetVectorPart(elements);
+			const auto rest = elements - part;
+			const auto threads = batchSize == 1ull ? 1ull : GetThreads(batchSize * elements, Float(10));
+
+			for_i(batchSize, threads, [=](UInt n)
+			{
+				const auto src = &InputLayer->Neurons[n * elements];
+				const auto bits = &mask[n * maskStride];
+
+				std::fill_n(bits, maskStride, uint64_t(0));
+				for (auto e = 0ull; e < part; e += VectorSize)
+					bits[e / 64ull] |= uint64_t(to_bits(pred(VecFloat().load(src + e)))) << (e % 64ull);
+				if (rest > 0ull)
+					bits[part / 64ull] |= (uint64_t(to_bits(pred(VecFloat().load_partial(int(rest), src + part)))) & ((uint64_t(1) << rest) - 1ull)) << (part % 64ull);
+			});
+		}
+
+		void PackMask(const UInt batchSize)
+		{
+			const auto alpha = Alpha;
+			const auto beta = Beta;
+
+			switch (ActivationFunction)
+			{
+			case Activations::BoundedRelu:
+				PackMask(batchSize, [=](const VecFloat& x) { return (x > Float(0)) & (x <= alpha); });
+				break;
+			case Activations::Clip:
+				PackMask(batchSize, [=](const VecFloat& x) { return (x > alpha) & (x <= beta); });
+				break;
+			case Activations::ClipV2:
+				PackMask(batchSize, [=](const VecFloat& x) { return (x > alpha) & (x < beta); });
+				break;
+			case Activations::HardSigmoid:
+				PackMask(batchSize, [=](const VecFloat& x) { return (x > (-beta / alpha)) & (x < ((Float(1) - beta) / alpha)); });
+				break;
+			default:
+				PackMask(batchSize, [=](const VecFloat& x) { return x > Float(0); });
+			}
+		}
+
+		void MaskedBackwardProp(const UInt batchSize)
+		{
+			const auto elements = IsPlainFormat() ? CDHW() : PaddedCDHW();
+			const auto part = GetVectorPart(elements);
+			const auto rest = elements - part;
+			const auto threads = batchSize == 1ull ? 1ull : GetThreads(batchSize * elements, Float(10));
+			const auto high = VecFloat(MaskHigh);
+			const auto low = VecFloat(MaskLow);
+
+			for_i(batchSize, threads, [=](UInt n)
+			{
+				const auto offset = n * elements;
+				const auto bits = &mask[n * maskStride];
+				const auto derivative = [=](const UInt e) { return select(VecFloatBool().load_bits(VecFloatBits(bits[e / 64ull] >> (e % 64ull))), high, low); };
+
+				if (InplaceBwd)
+				{
+					for (auto e = 0ull; e < part; e += VectorSize)
+						(derivative(e) * VecFloat().load(&InputLayer->NeuronsD1[offset + e])).store(&InputLayer->NeuronsD1[offset + e]);
+					if (rest > 0ull)
+						(derivative(part) * VecFloat().load_partial(int(rest), &InputLayer->NeuronsD1[offset + part])).store_partial(int(rest), &InputLayer->NeuronsD1[offset + part]);
+				}
+				else
+				{
+					for (auto e = 0ull; e < part; e += VectorSize)
+						mul_add(derivative(e), VecFloat().load(&NeuronsD1[offset + e]), VecFloat().load(&InputLayer->NeuronsD1[offset + e])).store(&InputLayer->NeuronsD1[offset + e]);
+					if (rest > 0ull)
+						mul_add(derivative(part), VecFloat().load_partial(int(rest), &NeuronsD1[offset + part]), VecFloat().load_partial(int(rest), &InputLayer->NeuronsD1[offset + part])).store_partial(int(rest), &InputLayer->NeuronsD1[offset + part]);
+				}
+			});
+		}
 	};
 }
\ No newline at end of file
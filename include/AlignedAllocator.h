@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <stdlib.h>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <stdexcept>
 
@@ -11,6 +12,10 @@
 
 namespace dnn
 {
+	// An allocator can borrow a buffer it doesn't own: a vector of exactly that size is then a view on it (see View),
+	// which is neither written when it's created nor freed. The borrowed buffer never travels with a copy: a copy of a view
+	// and a vector copy assigned from one get owned memory. A view itself is replaced by moving a vector into it, copy
+	// assigning to it writes into the borrowed buffer.
 	template <typename T, std::size_t alignment>
 	class AlignedAllocator
 	{
@@ -22,6 +27,9 @@ namespace dnn
 		typedef T& reference;
 		typedef const T& const_reference;
 		typedef const T* const_pointer;
+		typedef std::false_type propagate_on_container_copy_assignment;
+		typedef std::true_type propagate_on_container_move_assignment;
+		typedef std::true_type propagate_on_container_swap;
 
 		template <typename U>
 		struct rebind
@@ -29,10 +37,17 @@ namespace dnn
 			typedef AlignedAllocator<U, alignment> other;
 		};
 
-		AlignedAllocator() {}
+		T* Borrowed;
+		size_type BorrowedSize;
+
+		AlignedAllocator() : Borrowed(nullptr), BorrowedSize(0ull) {}
+
+		AlignedAllocator(T* borrowed, const size_type size) : Borrowed(borrowed), BorrowedSize(size) {}
 
 		template <typename U>
-		AlignedAllocator(const AlignedAllocator<U, alignment>&) {}
+		AlignedAllocator(const AlignedAllocator<U, alignment>&) : Borrowed(nullptr), BorrowedSize(0ull) {}
+
+		AlignedAllocator select_on_container_copy_construction() const { return AlignedAllocator(); }
 
 		const_pointer address(const_reference value) const { return std::addressof(value); }
 
@@ -40,6 +55,9 @@ namespace dnn
 
 		pointer allocate(const size_type size, const void* = nullptr)
 		{
+			if (Borrowed && size == BorrowedSize)
+				return Borrowed;
+
 			void* p = AlignedAlloc(alignment, sizeof(T) * size);
 
 			if (!p && size > 0ull)
@@ -50,7 +68,11 @@ namespace dnn
 
 		size_type max_size() const { return ~static_cast<std::size_t>(0ull) / sizeof(T); }
 
-		void deallocate(pointer ptr, size_type) { AlignedFree(ptr); }
+		void deallocate(pointer ptr, size_type)
+		{
+			if (ptr != Borrowed)
+				AlignedFree(ptr);
+		}
 
 		template <class U, class V>
 		void construct(U* ptr, const V& value)
@@ -69,6 +91,10 @@ namespace dnn
 		template <class U>
 		void construct(U* ptr)
 		{
+			// the elements of a view keep the values of the borrowed buffer
+			if (Borrowed && ptr >= Borrowed && ptr < Borrowed + BorrowedSize)
+				return;
+
 			void* p = ptr;
 			::new (p) U();
 		}
@@ -118,8 +144,16 @@ namespace dnn
 	};
 
 	template <typename T1, typename T2, std::size_t alignment>
-	inline bool operator==(const AlignedAllocator<T1,alignment>&, const AlignedAllocator<T2,alignment>&) { return true; }
+	inline bool operator==(const AlignedAllocator<T1,alignment>& a, const AlignedAllocator<T2,alignment>& b) { return static_cast<const void*>(a.Borrowed) == static_cast<const void*>(b.Borrowed); }
 
 	template <typename T1, typename T2, std::size_t alignment>
-	inline bool operator!=(const AlignedAllocator<T1,alignment>&, const AlignedAllocator<T2,alignment>&) { return false; }
+	inline bool operator!=(const AlignedAllocator<T1,alignment>& a, const AlignedAllocator<T2,alignment>& b) { return !(a == b); }
+
+	// a vector of size elements on a buffer owned elsewhere that has to outlive it
+	template <typename Vector>
+	inline Vector View(const typename Vector::value_type* data, const std::size_t size)
+	{
+		auto borrowed = const_cast<typename Vector::value_type*>(data);
+		return Vector(size, typename Vector::allocator_type(borrowed, size));
+	}
 }
\ No newline at end of file
@@ -1,5 +1,5 @@
 #pragma once
-#include "Layer.h"
+#include "FusedEpilogue.h"
 
 namespace dnn
 {
@@ -17,6 +17,7 @@ namespace dnn
 	public:
 		const Byte first, second;
 		FloatVector SurvivalProbability;
+		FusedEpilogue Epilogue;
 
 		Average(const dnn::Device& device, const dnnl::memory::format_tag format, const std::string& name, const std::vector<Layer*>& inputs) :
 			Layer(device, format, name, LayerTypes::Average, 0, 0, inputs[GetFirst(inputs)]->C, inputs[GetFirst(inputs)]->D, inputs[GetFirst(inputs)]->H, inputs[GetFirst(inputs)]->W, 0, 0, 0, inputs),
@@ -289,6 +290,8 @@ namespace dnn
 					}
 				}
 			}
+			else if (Epilogue.Enabled())
+				Epilogue.ForwardProp(*this, *Inputs[first], *Inputs[second], batchSize, [](const auto& a, const auto& b) { return (a + b) * Float(0.5); });
 			else
 			{
 #ifdef DNN_CACHE_PRIMITIVES
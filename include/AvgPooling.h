@@ -89,6 +89,16 @@ namespace dnn
 			return 1;
 		}
 
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdDiffSrc);
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			if (InputLayer->DstMemDesc->get_ndims() == 2)
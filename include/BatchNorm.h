@@ -91,6 +91,21 @@ namespace dnn
 			return 1;
 		}
 
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdSrc) + UInt(reorderBwdDiffSrc);
+		}
+
+		bool BackwardReadsNeurons() const final override
+		{
+			return false;
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			if (InputLayer->DstMemDesc->get_ndims() == 2)
@@ -364,6 +379,11 @@ namespace dnn
 			DNN_UNREF_PAR(biasesFillerScale);
 		}
 
+		std::vector<FloatVector*> RunningStats() override
+		{
+			return std::vector<FloatVector*>({ &RunningMean, &RunningVariance });
+		}
+
 		void Save(std::ostream& os, const bool persistOptimizer = false, const Optimizers optimizer = Optimizers::SGD) override
 		{
 			os.write(reinterpret_cast<const char*>(RunningMean.data()), std::streamsize(C * sizeof(Float)));
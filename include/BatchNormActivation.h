@@ -34,6 +34,7 @@ namespace dnn
 		FloatVector RunningVariance;
 		FloatVector InvStdDev;
 		FloatArray InputNeurons;
+		bool FusedWithMerge;	// the inference pass is done by the merge layer in front (see FusedEpilogue)
 
 		BatchNormActivation(const dnn::Device& device, const dnnl::memory::format_tag format, const std::string& name, const Activations activation, const std::vector<Layer*>& inputs, const bool scaling = true, const Float alpha = Float(0), const Float beta = Float(0), const Float momentum = Float(0.99), const Float eps = Float(1e-04), const bool hasBias = true) :
 			Layer(device, format, name, LayerTypes::BatchNormActivation, inputs[0]->C, inputs[0]->C, inputs[0]->C, inputs[0]->D, inputs[0]->H, inputs[0]->W, 0, 0, 0, inputs, hasBias, scaling),
@@ -54,7 +55,8 @@ namespace dnn
 			inference(false),
 			reorderFwdSrc(false),
 			reorderBwdSrc(false),
-			reorderBwdDiffSrc(false)
+			reorderBwdDiffSrc(false),
+			FusedWithMerge(false)
 		{
 			assert(Inputs.size() == 1);
 
@@ -113,6 +115,16 @@ namespace dnn
 				InputNeurons.resize(batchSize, C, H, W, dnnl::memory::data_type::f32, BlockedFmt, Device.engine);
 		}
 
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdSrc) + UInt(reorderBwdDiffSrc);
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			if (InputLayer->DstMemDesc->get_ndims() == 2)
@@ -178,7 +190,10 @@ namespace dnn
 		}
 
 		void ForwardProp(const UInt batchSize, const bool training) final override
-		{			
+		{
+			if (FusedWithMerge && !training)
+				return;
+
 			if constexpr (Reference && !TestBatchNormalization)
 				ForwardPropRef(batchSize, training);
 			else
@@ -251,82 +266,16 @@ namespace dnn
 
 						for_i(C, threads, [=](UInt c)
 						{
-							auto mean = Float(0);
-							auto variance = Float(0);
-							auto unbiasedVariance = Float(0);
-						
-							auto vecMean = VecFloat(0);
-							auto vecVariance = VecFloat(0);
-							auto correction0 = VecFloat(0);
-							auto correction1 = VecFloat(0);
-							auto correction0Float = Float(0);
-							auto correction1Float = Float(0);
-															
-							if constexpr (SingleMeanVariancePass)
-							{
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto start = c * HW() + (n * CDHW());
-									const auto part = start + partialHW;
-									for (auto hw = start; hw < part; hw += VectorSize)
-									{
-										KahanSum<VecFloat>(VecFloat().load_a(&InputLayer->Neurons[hw]), vecMean, correction0);
-										KahanSum<VecFloat>(square(VecFloat().load_a(&InputLayer->Neurons[hw])), vecVariance, correction1);
-									}
-									const auto end = start + HW();
-									for (auto hw = part; hw < end; hw++)
-									{
-										KahanSum<Float>(InputLayer->Neurons[hw], mean, correction0Float);
-										KahanSum<Float>(Square(InputLayer->Neurons[hw]), variance, correction1Float);
-									}
-								}
-
-								mean += horizontal_add(vecMean);
-								mean /= Float(batchSize * HW());
-								Mean[c] = mean;
-
-								variance += horizontal_add(vecVariance);
-								unbiasedVariance = std::max(Float(0), (variance / Float(batchSize * HW() - 1)) - Square<Float>(mean));
-								variance /= Float(batchSize * HW());
-								variance -= Square<Float>(mean);
-								variance = std::max(Float(0), variance);
-								Variance[c] = variance;
-							}
-							else
-							{
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto start = c * HW() + (n * CDHW());
-									const auto part = start + partialHW;
-									for (auto hw = start; hw < part; hw += VectorSize)
-										KahanSum<VecFloat>(VecFloat().load_a(&InputLayer->Neurons[hw]), vecMean, correction0);
-									const auto end = start + HW();
-									for (auto hw = part; hw < end; hw++)
-										KahanSum<Float>(InputLayer->Neurons[hw], mean, correction0Float);
-								}
-
-								mean += horizontal_add(vecMean);
-								mean /= Float(batchSize * HW());
-								Mean[c] = mean;
+							auto stats = MeanVariance<Float>();
+							for (auto n = 0ull; n < batchSize; n++)
+								stats.Add(&InputLayer->Neurons[c * HW() + (n * CDHW())], HW());
 
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto start = c * HW() + (n * CDHW());
-									const auto part = start + partialHW;
-									for (auto hw = start; hw < part; hw += VectorSize)
-										KahanSum<VecFloat>(square(VecFloat().load_a(&InputLayer->Neurons[hw]) - mean), vecVariance, correction1);
-									const auto end = start + HW();
-									for (auto hw = part; hw < end; hw++)
-										KahanSum<Float>(Square(InputLayer->Neurons[hw] - mean), variance, correction1Float);
-								}
+							const auto mean = stats.Mean;
+							const auto variance = std::max(Float(0), stats.Variance());
+							const auto unbiasedVariance = std::max(Float(0), stats.UnbiasedVariance());
+							Mean[c] = mean;
+							Variance[c] = variance;
 
-								variance += horizontal_add(vecVariance);
-								unbiasedVariance = std::max(Float(0), variance / Float(batchSize * HW() - 1));
-								variance /= Float(batchSize * HW());
-								variance = std::max(Float(0), variance);
-								Variance[c] = variance;
-							}
-							
 							RunningMean[c] = RunningMean[c] * Momentum + OneMinusMomentum * mean;
 							RunningVariance[c] = RunningVariance[c] * Momentum + OneMinusMomentum * unbiasedVariance;
 
@@ -378,69 +327,14 @@ namespace dnn
 							const auto channelOffset = c * VectorSize;
 							const auto mapOffset = channelOffset * HW();
 
-							auto mean = VecFloat(0);
-							auto variance = VecFloat(0);
-							auto unbiasedVariance = VecFloat(0);
-
-							if constexpr (SingleMeanVariancePass)
-							{
-								auto correction0 = VecFloat(0);
-								auto correction1 = VecFloat(0);
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto offsetC = n * PaddedCDHW() + mapOffset;
-									for (auto h = 0ull; h < H; h++)
-									{
-										const auto offsetH = offsetC + h * strideH;
-										for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
-										{
-											KahanSum<VecFloat>(VecFloat().load_a(&InputLayer->Neurons[w]), mean, correction0);
-											KahanSum<VecFloat>(square(VecFloat().load_a(&InputLayer->Neurons[w])), variance, correction1);
-										}
-									}
-								}
-
-								mean /= Float(batchSize * HW());
-								mean.store_a(&Mean[channelOffset]);
-
-								unbiasedVariance = max(VecFloat(0), (variance / Float(batchSize * HW() - 1)) - square(mean));
-								variance /= Float(batchSize * HW());
-								variance -= square(mean);
-							}
-							else
-							{
-								auto correction0 = VecFloat(0);
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto offsetC = n * PaddedCDHW() + mapOffset;
-									for (auto h = 0ull; h < H; h++)
-									{
-										const auto offsetH = offsetC + h * strideH;
-										for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
-											KahanSum<VecFloat>(VecFloat().load_a(&InputLayer->Neurons[w]), mean, correction0);
-									}
-								}
-
-								mean /= Float(batchSize * HW());
-								mean.store_a(&Mean[channelOffset]);
-
-								auto correction1 = VecFloat(0);
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto offsetC = n * PaddedCDHW() + mapOffset;
-									for (auto h = 0ull; h < H; h++)
-									{
-										const auto offsetH = offsetC + h * strideH;
-										for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
-											KahanSum<VecFloat>(square(VecFloat().load_a(&InputLayer->Neurons[w]) - mean), variance, correction1);
-									}
-								}
-
-								unbiasedVariance = max(VecFloat(0), (variance / Float(batchSize * HW() - 1)));
-								variance /= Float(batchSize * HW());
-							}
+							auto stats = MeanVariance<VecFloat>();
+							for (auto n = 0ull; n < batchSize; n++)
+								stats.Add(&InputLayer->Neurons[n * PaddedCDHW() + mapOffset], HW());
 
-							variance = max(VecFloat(0), variance);
+							const auto mean = stats.Mean;
+							const auto variance = max(VecFloat(0), stats.Variance());
+							const auto unbiasedVariance = max(VecFloat(0), stats.UnbiasedVariance());
+							mean.store_a(&Mean[channelOffset]);
 							variance.store_a(&Variance[channelOffset]);
 
 							mul_add(VecFloat().load_a(&RunningMean[channelOffset]), Momentum, OneMinusMomentum * mean).store_a(&RunningMean[channelOffset]);
@@ -1237,6 +1131,11 @@ namespace dnn
 			DNN_UNREF_PAR(biasesFillerScale);
 		}
 
+		std::vector<FloatVector*> RunningStats() override
+		{
+			return std::vector<FloatVector*>({ &RunningMean, &RunningVariance });
+		}
+
 		void Save(std::ostream& os, const bool persistOptimizer = false, const Optimizers optimizer = Optimizers::SGD) override
 		{
 			os.write(reinterpret_cast<const char*>(RunningMean.data()), std::streamsize(C * sizeof(Float)));
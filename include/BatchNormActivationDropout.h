@@ -37,8 +37,9 @@ namespace dnn
 		FloatVector Variance;
 		FloatVector RunningVariance;
 		FloatVector InvStdDev;
-		FloatArray NeuronsActive;
 		FloatArray InputNeurons;
+		UInt Seed;	// keys the counter-based mask generator (see SetStep)
+		UInt Step;	// training step, the forward and the backward pass of a step see the same mask
 
 		BatchNormActivationDropout(const dnn::Device& device, const dnnl::memory::format_tag format, const std::string& name, const Activations activation, const std::vector<Layer*>& inputs, const Float dropout = Float(0.5), const bool localValue = false, const bool scaling = true, const Float alpha = Float(0), const Float beta = Float(0), const Float momentum = Float(0.99), const Float eps = Float(1e-04), const bool hasBias = true) :
 			Layer(device, format, name, LayerTypes::BatchNormActivationDropout, inputs[0]->C, inputs[0]->C, inputs[0]->C, inputs[0]->D, inputs[0]->H, inputs[0]->W, 0, 0, 0, inputs, hasBias, scaling, dropout > 0),
@@ -58,6 +59,8 @@ namespace dnn
 			RunningVariance(FloatVector(PaddedC, Float(1))),
 			InvStdDev(FloatVector(PaddedC)),
 			InputNeurons(FloatArray()),
+			Seed(std::hash<std::string>()(name)),
+			Step(0),
 			flags(static_cast<dnnl::normalization_flags>(0U)),
 			inference(false),
 			reorderFwdSrc(false),
@@ -86,6 +89,13 @@ namespace dnn
 			}
 		}
 
+		// the mask of an element only depends on (seed, step, layer, element index), so it is regenerated in the backward pass instead of stored
+		void SetStep(const UInt seed, const UInt step)
+		{
+			Seed = seed ^ std::hash<std::string>()(Name);
+			Step = step;
+		}
+
 		bool Lockable() const final override
 		{
 			return WeightCount > 0 && Scaling;
@@ -131,6 +141,16 @@ namespace dnn
 			return 1;
 		}
 
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdSrc) + UInt(reorderBwdDiffSrc);
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			if (InputLayer->DstMemDesc->get_ndims() == 2)
@@ -196,16 +216,6 @@ namespace dnn
 
 			if constexpr (Reference)
 				InputNeurons.resize(batchSize, C, H, W, dnnl::memory::data_type::f32, BlockedFmt, Device.engine);
-
-			if (Enabled)
-			{
-				NeuronsActive.resize(batchSize, C, H, W, dnnl::memory::data_type::f32, BlockedFmt, Device.engine);
-				for (auto n = 0ull; n < batchSize; n++)
-					for (auto i = 0ull; i < CDHW(); i++)
-						NeuronsActive[n * PaddedCDHW() + i] = Float(1);
-			}
-			else
-				NeuronsActive.release();
 		}
 
 		void ForwardProp(const UInt batchSize, const bool training) final override
@@ -283,81 +293,15 @@ namespace dnn
 
 						for_i(C, threads, [=](UInt c)
 						{
-							auto mean = Float(0);
-							auto variance = Float(0);
-							auto unbiasedVariance = Float(0);
-
-							auto vecMean = VecFloat(0);
-							auto vecVariance = VecFloat(0);
-							auto correction0 = VecFloat(0);
-							auto correction1 = VecFloat(0);
-							auto correction0Float = Float(0);
-							auto correction1Float = Float(0);
-
-							if constexpr (SingleMeanVariancePass)
-							{
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto start = c * HW() + (n * CDHW());
-									const auto part = start + partialHW;
-									for (auto hw = start; hw < part; hw += VectorSize)
-									{
-										KahanSum<VecFloat>(VecFloat().load_a(&InputLayer->Neurons[hw]), vecMean, correction0);
-										KahanSum<VecFloat>(square(VecFloat().load_a(&InputLayer->Neurons[hw])), vecVariance, correction1);
-									}
-									const auto end = start + HW();
-									for (auto hw = part; hw < end; hw++)
-									{
-										KahanSum<Float>(InputLayer->Neurons[hw], mean, correction0Float);
-										KahanSum<Float>(Square(InputLayer->Neurons[hw]), variance, correction1Float);
-									}
-								}
-
-								mean += horizontal_add(vecMean);
-								mean /= Float(batchSize * HW());
-								Mean[c] = mean;
-
-								variance += horizontal_add(vecVariance);
-								unbiasedVariance = std::max(Float(0), (variance / Float(batchSize * HW() - 1)) - Square<Float>(mean));
-								variance /= Float(batchSize * HW());
-								variance -= Square<Float>(mean);
-								variance = std::max(Float(0), variance);
-								Variance[c] = variance;
-							}
-							else
-							{
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto start = c * HW() + (n * CDHW());
-									const auto part = start + partialHW;
-									for (auto hw = start; hw < part; hw += VectorSize)
-										KahanSum<VecFloat>(VecFloat().load_a(&InputLayer->Neurons[hw]), vecMean, correction0);
-									const auto end = start + HW();
-									for (auto hw = part; hw < end; hw++)
-										KahanSum<Float>(InputLayer->Neurons[hw], mean, correction0Float);
-								}
-
-								mean += horizontal_add(vecMean);
-								mean /= Float(batchSize * HW());
-								Mean[c] = mean;
-
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto start = c * HW() + (n * CDHW());
-									const auto part = start + partialHW;
-									for (auto hw = start; hw < part; hw += VectorSize)
-										KahanSum<VecFloat>(square(VecFloat().load_a(&InputLayer->Neurons[hw]) - mean), vecVariance, correction1);
-									const auto end = start + HW();
-									for (auto hw = part; hw < end; hw++)
-										KahanSum<Float>(Square(InputLayer->Neurons[hw] - mean), variance, correction1Float);
-								}
+							auto stats = MeanVariance<Float>();
+							for (auto n = 0ull; n < batchSize; n++)
+								stats.Add(&InputLayer->Neurons[c * HW() + (n * CDHW())], HW());
 
-								variance += horizontal_add(vecVariance);
-								unbiasedVariance = std::max(0.f, variance / Float(batchSize * HW() - 1));
-								variance /= Float(batchSize * HW());
-								variance = std::max(Float(0), variance);
-								Variance[c] = variance;
-							}
+							const auto mean = stats.Mean;
+							const auto variance = std::max(Float(0), stats.Variance());
+							const auto unbiasedVariance = std::max(Float(0), stats.UnbiasedVariance());
+							Mean[c] = mean;
+							Variance[c] = variance;
 
 							RunningMean[c] = RunningMean[c] * Momentum + OneMinusMomentum * mean;
 							RunningVariance[c] = RunningVariance[c] * Momentum + OneMinusMomentum * unbiasedVariance;
@@ -378,15 +322,13 @@ namespace dnn
 										const auto part = start + partialHW;
 										for (auto hw = start; hw < part; hw += VectorSize)
 										{
-											mask = BernoulliVecFloat(Keep);
-											mask.store_a(&NeuronsActive[hw]);
+											mask = DropoutMaskVec(hw, Step, Seed, Keep);
 											(mask * Scale * Func.fVec(((VecFloat().load_a(&InputLayer->Neurons[hw]) - mean) * weightedInvStdDev + biases), Alpha, Beta)).store_a(&Neurons[hw]);
 										}
 										const auto end = start + HW();
 										for (auto hw = part; hw < end; hw++)
 										{
-											NeuronsActive[hw] = Bernoulli<Float>(Keep);
-											Neurons[hw] = NeuronsActive[hw] * Scale * Func.f((InputLayer->Neurons[hw] - mean) * weightedInvStdDev + biases, Alpha, Beta);
+											Neurons[hw] = DropoutMask(hw, Step, Seed, Keep) * Scale * Func.f((InputLayer->Neurons[hw] - mean) * weightedInvStdDev + biases, Alpha, Beta);
 										}
 									}
 								else
@@ -396,8 +338,7 @@ namespace dnn
 										const auto part = start + partialHW;
 										for (auto hw = start; hw < part; hw += VectorSize)
 										{
-											mask = BernoulliVecFloat(Keep);
-											mask.store_a(&NeuronsActive[hw]);
+											mask = DropoutMaskVec(hw, Step, Seed, Keep);
 											(mask * Scale * Func.fVec(((VecFloat().load_a(&InputLayer->Neurons[hw]) - mean) * weightedInvStdDev + biases), Alpha, Beta)).store_a(&Neurons[hw]);
 	#ifndef DNN_LEAN
 											VecFloat(0).store_nt(&NeuronsD1[hw]);
@@ -406,8 +347,7 @@ namespace dnn
 										const auto end = start + HW();
 										for (auto hw = part; hw < end; hw++)
 										{
-											NeuronsActive[hw] = Bernoulli<Float>(Keep);
-											Neurons[hw] = NeuronsActive[hw] * Scale * Func.f((InputLayer->Neurons[hw] - mean) * weightedInvStdDev + biases, Alpha, Beta);
+											Neurons[hw] = DropoutMask(hw, Step, Seed, Keep) * Scale * Func.f((InputLayer->Neurons[hw] - mean) * weightedInvStdDev + biases, Alpha, Beta);
 	#ifndef DNN_LEAN
 											NeuronsD1[hw] = Float(0);
 	#endif
@@ -460,69 +400,14 @@ namespace dnn
 							const auto channelOffset = c * VectorSize;
 							const auto mapOffset = channelOffset * HW();
 
-							auto mean = VecFloat(0);
-							auto variance = VecFloat(0);
-							auto unbiasedVariance = VecFloat(0);
-
-							if constexpr (SingleMeanVariancePass)
-							{
-								auto correction0 = VecFloat(0);
-								auto correction1 = VecFloat(0);
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto offsetC = n * PaddedCDHW() + mapOffset;
-									for (auto h = 0ull; h < H; h++)
-									{
-										const auto offsetH = offsetC + h * strideH;
-										for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
-										{
-											KahanSum<VecFloat>(VecFloat().load_a(&InputLayer->Neurons[w]), mean, correction0);
-											KahanSum<VecFloat>(square(VecFloat().load_a(&InputLayer->Neurons[w])), variance, correction1);
-										}
-									}
-								}
-
-								mean /= Float(batchSize * HW());
-								mean.store_a(&Mean[channelOffset]);
-
-								unbiasedVariance = max(VecFloat(0), (variance / Float(batchSize * HW() - 1)) - square(mean));
-								variance /= Float(batchSize * HW());
-								variance -= square(mean);
-							}
-							else
-							{
-								auto correction0 = VecFloat(0);
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto offsetC = n * PaddedCDHW() + mapOffset;
-									for (auto h = 0ull; h < H; h++)
-									{
-										const auto offsetH = offsetC + h * strideH;
-										for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
-											KahanSum<VecFloat>(VecFloat().load_a(&InputLayer->Neurons[w]), mean, correction0);
-									}
-								}
-
-								mean /= Float(batchSize * HW());
-								mean.store_a(&Mean[channelOffset]);
-
-								auto correction1 = VecFloat(0);
-								for (auto n = 0ull; n < batchSize; n++)
-								{
-									const auto offsetC = n * PaddedCDHW() + mapOffset;
-									for (auto h = 0ull; h < H; h++)
-									{
-										const auto offsetH = offsetC + h * strideH;
-										for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
-											KahanSum<VecFloat>(square(VecFloat().load_a(&InputLayer->Neurons[w]) - mean), variance, correction1);
-									}
-								}
-
-								unbiasedVariance = max(VecFloat(0), (variance / Float(batchSize * HW() - 1)));
-								variance /= Float(batchSize * HW());
-							}
+							auto stats = MeanVariance<VecFloat>();
+							for (auto n = 0ull; n < batchSize; n++)
+								stats.Add(&InputLayer->Neurons[n * PaddedCDHW() + mapOffset], HW());
 
-							variance = max(VecFloat(0), variance);
+							const auto mean = stats.Mean;
+							const auto variance = max(VecFloat(0), stats.Variance());
+							const auto unbiasedVariance = max(VecFloat(0), stats.UnbiasedVariance());
+							mean.store_a(&Mean[channelOffset]);
 							variance.store_a(&Variance[channelOffset]);
 
 							mul_add(VecFloat().load_a(&RunningMean[channelOffset]), Momentum, OneMinusMomentum * mean).store_a(&RunningMean[channelOffset]);
@@ -546,8 +431,7 @@ namespace dnn
 											const auto offsetH = offsetC + h * strideH;
 											for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
 											{
-												mask = BernoulliVecFloat(Keep);
-												mask.store_a(&NeuronsActive[w]);
+												mask = DropoutMaskVec(w, Step, Seed, Keep);
 												(mask * Scale * Func.fVec(mul_add(VecFloat().load_a(&InputLayer->Neurons[w]) - mean, weightedInvStdDev, biases), Alpha, Beta)).store_a(&Neurons[w]);
 											}
 										}
@@ -561,8 +445,7 @@ namespace dnn
 											const auto offsetH = offsetC + h * strideH;
 											for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
 											{
-												mask = BernoulliVecFloat(Keep);
-												mask.store_a(&NeuronsActive[w]);
+												mask = DropoutMaskVec(w, Step, Seed, Keep);
 												(mask * Scale * Func.fVec(mul_add(VecFloat().load_a(&InputLayer->Neurons[w]) - mean, weightedInvStdDev, biases), Alpha, Beta)).store_a(&Neurons[w]);
 	#ifndef DNN_LEAN
 												VecFloat(0).store_nt(&NeuronsD1[w]);
@@ -653,13 +536,13 @@ namespace dnn
 							{
 								inputNeurons.load_a(&InputLayerFwd->Neurons[hw]);
 								inputNeurons -= Mean[c];
-								diffSrc = (enabled ? VecFloat().load_a(&NeuronsActive[hw]) : VecFloat(1)) * Func.dfVec(inputNeurons * weightedInvStdDev + biases, Alpha, Beta) * VecFloat().load_a(&layerD1[hw]);
+								diffSrc = (enabled ? DropoutMaskVec(hw, Step, Seed, Keep) : VecFloat(1)) * Func.dfVec(inputNeurons * weightedInvStdDev + biases, Alpha, Beta) * VecFloat().load_a(&layerD1[hw]);
 								KahanSum<VecFloat>(diffSrc * inputNeurons, diffGamma, correction0);
 								KahanSum<VecFloat>(diffSrc, diffBeta, correction1);
 							}
 							for (auto hw = part; hw < start + HW(); hw++)
 							{
-								diffSrcFloat = (enabled ? NeuronsActive[hw] : Float(1)) * Func.df(((InputLayerFwd->Neurons[hw] - Mean[c]) * weightedInvStdDev) + biases, Alpha, Beta) * layerD1[hw];
+								diffSrcFloat = (enabled ? DropoutMask(hw, Step, Seed, Keep) : Float(1)) * Func.df(((InputLayerFwd->Neurons[hw] - Mean[c]) * weightedInvStdDev) + biases, Alpha, Beta) * layerD1[hw];
 								KahanSum<Float>(diffSrcFloat * (InputLayerFwd->Neurons[hw] - Mean[c]), diffGammaFloat, correction0Float);
 								KahanSum<Float>(diffSrcFloat, diffBetaFloat, correction1Float);
 							}
@@ -686,7 +569,7 @@ namespace dnn
 								const auto part = start + partialHW;
 								for (auto hw = start; hw < part; hw += VectorSize)
 								{
-									diffSrc = (enabled ? VecFloat().load_a(&NeuronsActive[hw]) : VecFloat(1)) * Func.dfVec((VecFloat().load_a(&InputLayerFwd->Neurons[hw]) - Mean[c]) * weightedInvStdDev + biases, Alpha, Beta) * (InplaceBwd ? VecFloat().load_a(&InputLayer->NeuronsD1[hw]) : VecFloat().load_a(&NeuronsD1[hw]));
+									diffSrc = (enabled ? DropoutMaskVec(hw, Step, Seed, Keep) : VecFloat(1)) * Func.dfVec((VecFloat().load_a(&InputLayerFwd->Neurons[hw]) - Mean[c]) * weightedInvStdDev + biases, Alpha, Beta) * (InplaceBwd ? VecFloat().load_a(&InputLayer->NeuronsD1[hw]) : VecFloat().load_a(&NeuronsD1[hw]));
 
 									// if not using global stats!
 									diffSrc -= mul_add(VecFloat().load_a(&InputLayerFwd->Neurons[hw]) - Mean[c], diffGammaFloat, diffBetaFloat);
@@ -696,7 +579,7 @@ namespace dnn
 								}
 								for (auto hw = part; hw < start + HW(); hw++)
 								{
-									diffSrcFloat = (enabled ? NeuronsActive[hw] : Float(1)) * Func.df((InputLayerFwd->Neurons[hw] - Mean[c]) * weightedInvStdDev + biases, Alpha, Beta) * InputLayer->NeuronsD1[hw];
+									diffSrcFloat = (enabled ? DropoutMask(hw, Step, Seed, Keep) : Float(1)) * Func.df((InputLayerFwd->Neurons[hw] - Mean[c]) * weightedInvStdDev + biases, Alpha, Beta) * InputLayer->NeuronsD1[hw];
 
 									// if not using global stats!
 									diffSrcFloat -= (InputLayerFwd->Neurons[hw] - Mean[c]) * diffGammaFloat + diffBetaFloat;
@@ -712,7 +595,7 @@ namespace dnn
 								const auto part = start + partialHW;
 								for (auto hw = start; hw < part; hw += VectorSize)
 								{
-									diffSrc = (enabled ? VecFloat().load_a(&NeuronsActive[hw]) : VecFloat(1)) * Func.dfVec((VecFloat().load_a(&InputLayerFwd->Neurons[hw]) - Mean[c]) * weightedInvStdDev + biases, Alpha, Beta) * VecFloat().load_a(&NeuronsD1[hw]);
+									diffSrc = (enabled ? DropoutMaskVec(hw, Step, Seed, Keep) : VecFloat(1)) * Func.dfVec((VecFloat().load_a(&InputLayerFwd->Neurons[hw]) - Mean[c]) * weightedInvStdDev + biases, Alpha, Beta) * VecFloat().load_a(&NeuronsD1[hw]);
 
 									// if not using global stats!
 									diffSrc -= mul_add(VecFloat().load_a(&InputLayerFwd->Neurons[hw]) - Mean[c], diffGammaFloat, diffBetaFloat);
@@ -722,7 +605,7 @@ namespace dnn
 								}
 								for (auto hw = part; hw < start + HW(); hw++)
 								{
-									diffSrcFloat = (enabled ? NeuronsActive[hw] : Float(1)) * Func.df((InputLayerFwd->Neurons[hw] - Mean[c]) * weightedInvStdDev + biases, Alpha, Beta) * NeuronsD1[hw];
+									diffSrcFloat = (enabled ? DropoutMask(hw, Step, Seed, Keep) : Float(1)) * Func.df((InputLayerFwd->Neurons[hw] - Mean[c]) * weightedInvStdDev + biases, Alpha, Beta) * NeuronsD1[hw];
 
 									// if not using global stats!
 									diffSrcFloat -= (InputLayerFwd->Neurons[hw] - Mean[c]) * diffGammaFloat + diffBetaFloat;
@@ -763,7 +646,7 @@ namespace dnn
 									diffSrc.load_a(&layerD1[w]);
 									inputNeurons.load_a(&InputLayerFwd->Neurons[w]);
 									inputNeurons -= mean;
-									diffSrc *= (enabled ? VecFloat().load_a(&NeuronsActive[w]) : VecFloat(1)) * Func.dfVec(mul_add(inputNeurons, weightedInvStdDev, biases), Alpha, Beta);
+									diffSrc *= (enabled ? DropoutMaskVec(w, Step, Seed, Keep) : VecFloat(1)) * Func.dfVec(mul_add(inputNeurons, weightedInvStdDev, biases), Alpha, Beta);
 									KahanSum<VecFloat>(diffSrc * inputNeurons, diffGamma, correction0);
 									KahanSum<VecFloat>(diffSrc, diffBeta, correction1);
 								}
@@ -793,7 +676,7 @@ namespace dnn
 
 									for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
 									{
-										diffSrc = (enabled ? VecFloat().load_a(&NeuronsActive[w]) : VecFloat(1)) * Func.dfVec(mul_add(VecFloat().load_a(&InputLayerFwd->Neurons[w]) - mean, weightedInvStdDev, biases), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[w]);
+										diffSrc = (enabled ? DropoutMaskVec(w, Step, Seed, Keep) : VecFloat(1)) * Func.dfVec(mul_add(VecFloat().load_a(&InputLayerFwd->Neurons[w]) - mean, weightedInvStdDev, biases), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[w]);
 
 										// if not using global stats!
 										diffSrc -= mul_add(VecFloat().load_a(&InputLayerFwd->Neurons[w]) - mean, diffGamma, diffBeta);
@@ -813,7 +696,7 @@ namespace dnn
 
 									for (auto w = offsetH; w < offsetH + strideH; w += VectorSize)
 									{
-										diffSrc = (enabled ? VecFloat().load_a(&NeuronsActive[w]) : VecFloat(1)) * Func.dfVec(mul_add(VecFloat().load_a(&InputLayerFwd->Neurons[w]) - mean, weightedInvStdDev, biases), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[w]);
+										diffSrc = (enabled ? DropoutMaskVec(w, Step, Seed, Keep) : VecFloat(1)) * Func.dfVec(mul_add(VecFloat().load_a(&InputLayerFwd->Neurons[w]) - mean, weightedInvStdDev, biases), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[w]);
 
 										// if not using global stats!
 										diffSrc -= mul_add(VecFloat().load_a(&InputLayerFwd->Neurons[w]) - mean, diffGamma, diffBeta);
@@ -942,8 +825,7 @@ namespace dnn
 								{
 									for (auto hw = offset; hw < offset + strideHW; hw += VectorSize)
 									{
-										mask = BernoulliVecFloat(Keep);
-										mask.store_a(&NeuronsActive[hw]);
+										mask = DropoutMaskVec(hw, Step, Seed, Keep);
 										(mask * Scale * Func.fVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta)).store_a(&Neurons[hw]);										
 #ifndef DNN_LEAN
 										VecFloat(0).store_nt(&NeuronsD1[hw]);
@@ -975,8 +857,7 @@ namespace dnn
 									const auto offset = n * PaddedCDHW() + c * HW();
 									for (auto hw = offset; hw < offset + strideHW; hw += VectorSize)
 									{
-										mask = BernoulliVecFloat(Keep);
-										mask.store_a(&NeuronsActive[hw]);
+										mask = DropoutMaskVec(hw, Step, Seed, Keep);
 										(mask * Scale * Func.fVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta)).store_a(&Neurons[hw]);
 									}
 								}
@@ -1004,8 +885,7 @@ namespace dnn
 								const auto offset = n * CDHW() + c * HW();
 								for (auto hw = offset; hw < offset + HW(); hw++)
 								{
-									NeuronsActive[hw] = Bernoulli<Float>(Keep);
-									Neurons[hw] = NeuronsActive[hw] * Scale * Func.f(InputNeurons[hw], Alpha, Beta);
+									Neurons[hw] = DropoutMask(hw, Step, Seed, Keep) * Scale * Func.f(InputNeurons[hw], Alpha, Beta);
 #ifndef DNN_LEAN
 									NeuronsD1[hw] = Float(0);
 #endif // DNN_LEAN
@@ -1022,8 +902,7 @@ namespace dnn
 								const auto offset = n * CDHW() + c * HW();
 								for (auto hw = offset; hw < offset + HW(); hw++)
 								{
-									NeuronsActive[hw] = Bernoulli<Float>(Keep);
-									Neurons[hw] = NeuronsActive[hw] * Scale * Func.f(InputNeurons[hw], Alpha, Beta);
+									Neurons[hw] = DropoutMask(hw, Step, Seed, Keep) * Scale * Func.f(InputNeurons[hw], Alpha, Beta);
 								}
 							}
 						});
@@ -1085,12 +964,12 @@ namespace dnn
 						if (!plain)
 						{
 							for (auto c = 0ull; c < PaddedC; c += VectorSize)
-								((enabled ? VecFloat().load_a(&NeuronsActive[c]) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[c]), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[c]))).store_a(&InputLayer->NeuronsD1[c]);
+								((enabled ? DropoutMaskVec(c, Step, Seed, Keep) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[c]), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[c]))).store_a(&InputLayer->NeuronsD1[c]);
 						}
 						else
 						{
 							for (auto c = 0ull; c < C; c++)
-								InputLayer->NeuronsD1[c] = (enabled ? NeuronsActive[c] : Float(1)) * Func.df(InputNeurons[c], Alpha, Beta) * InputLayer->NeuronsD1[c];
+								InputLayer->NeuronsD1[c] = (enabled ? DropoutMask(c, Step, Seed, Keep) : Float(1)) * Func.df(InputNeurons[c], Alpha, Beta) * InputLayer->NeuronsD1[c];
 						}
 					}
 					else
@@ -1098,12 +977,12 @@ namespace dnn
 						if (!plain)
 						{
 							for (auto c = 0ull; c < PaddedC; c += VectorSize)
-								((enabled ? VecFloat().load_a(&NeuronsActive[c]) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[c]), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[c]))).store_a(&NeuronsD1[c]);
+								((enabled ? DropoutMaskVec(c, Step, Seed, Keep) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[c]), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[c]))).store_a(&NeuronsD1[c]);
 						}
 						else
 						{
 							for (auto c = 0ull; c < C; c++)
-								NeuronsD1[c] = (enabled ? NeuronsActive[c] : Float(1)) * Func.df(InputNeurons[c], Alpha, Beta) * NeuronsD1[c];
+								NeuronsD1[c] = (enabled ? DropoutMask(c, Step, Seed, Keep) : Float(1)) * Func.df(InputNeurons[c], Alpha, Beta) * NeuronsD1[c];
 						}
 					}
 				}
@@ -1117,14 +996,14 @@ namespace dnn
 							{
 								const auto offset = n * PaddedC;
 								for (auto c = offset; c < offset + PaddedC; c += VectorSize)
-									((enabled ? VecFloat().load_a(&NeuronsActive[c]) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[c]), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[c]))).store_a(&InputLayer->NeuronsD1[c]);
+									((enabled ? DropoutMaskVec(c, Step, Seed, Keep) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[c]), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[c]))).store_a(&InputLayer->NeuronsD1[c]);
 							});
 						else
 							for_i(batchSize, threads, [=](UInt n)
 							{
 								const auto offset = n * C;
 								for (auto c = offset; c < offset + C; c++)
-									InputLayer->NeuronsD1[c] = (enabled ? NeuronsActive[c] : Float(1)) * Func.df(InputNeurons[c], Alpha, Beta) * InputLayer->NeuronsD1[c];
+									InputLayer->NeuronsD1[c] = (enabled ? DropoutMask(c, Step, Seed, Keep) : Float(1)) * Func.df(InputNeurons[c], Alpha, Beta) * InputLayer->NeuronsD1[c];
 							});
 					}
 					else
@@ -1134,14 +1013,14 @@ namespace dnn
 							{
 								const auto offset = n * PaddedC;
 								for (auto c = offset; c < offset + PaddedC; c += VectorSize)
-									((enabled ? VecFloat().load_a(&NeuronsActive[c]) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[c]), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[c]))).store_a(&NeuronsD1[c]);
+									((enabled ? DropoutMaskVec(c, Step, Seed, Keep) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[c]), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[c]))).store_a(&NeuronsD1[c]);
 							});
 						else
 							for_i(batchSize, threads, [=](UInt n)
 							{
 								const auto offset = n * C;
 								for (auto c = offset; c < offset + C; c++)
-									NeuronsD1[c] = (enabled ? NeuronsActive[c] : Float(1)) * Func.df(InputNeurons[c], Alpha, Beta) * NeuronsD1[c];
+									NeuronsD1[c] = (enabled ? DropoutMask(c, Step, Seed, Keep) : Float(1)) * Func.df(InputNeurons[c], Alpha, Beta) * NeuronsD1[c];
 							});
 					}
 #ifdef DNN_STOCHASTIC
@@ -1160,7 +1039,7 @@ namespace dnn
 							{
 								const auto offset = c * HW();
 								for (auto hw = offset; hw < offset + strideHW; hw += VectorSize)
-									((enabled ? VecFloat().load_a(&NeuronsActive[hw]) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[hw]))).store_a(&InputLayer->NeuronsD1[hw]);
+									((enabled ? DropoutMaskVec(hw, Step, Seed, Keep) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[hw]))).store_a(&InputLayer->NeuronsD1[hw]);
 							}
 						else
 						{
@@ -1168,7 +1047,7 @@ namespace dnn
 							{
 								const auto offset = c * HW();
 								for (auto hw = offset; hw < offset + HW(); hw++)
-									InputLayer->NeuronsD1[hw] = (enabled ? NeuronsActive[hw] : Float(1)) * Func.df(InputNeurons[hw], Alpha, Beta) * InputLayer->NeuronsD1[hw];
+									InputLayer->NeuronsD1[hw] = (enabled ? DropoutMask(hw, Step, Seed, Keep) : Float(1)) * Func.df(InputNeurons[hw], Alpha, Beta) * InputLayer->NeuronsD1[hw];
 							}
 						}
 					}
@@ -1179,7 +1058,7 @@ namespace dnn
 							{
 								const auto offset = c * HW();
 								for (auto hw = offset; hw < offset + strideHW; hw += VectorSize)
-									((enabled ? VecFloat().load_a(&NeuronsActive[hw]) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[hw]))).store_a(&NeuronsD1[hw]);
+									((enabled ? DropoutMaskVec(hw, Step, Seed, Keep) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[hw]))).store_a(&NeuronsD1[hw]);
 							}
 						else
 						{
@@ -1187,7 +1066,7 @@ namespace dnn
 							{
 								const auto offset = c * HW();
 								for (auto hw = offset; hw < offset + HW(); hw++)
-									NeuronsD1[hw] = (enabled ? NeuronsActive[hw] : Float(1)) * Func.df(InputNeurons[hw], Alpha, Beta) * NeuronsD1[hw];
+									NeuronsD1[hw] = (enabled ? DropoutMask(hw, Step, Seed, Keep) : Float(1)) * Func.df(InputNeurons[hw], Alpha, Beta) * NeuronsD1[hw];
 							}
 						}
 					}
@@ -1204,7 +1083,7 @@ namespace dnn
 								{
 									const auto offset = n * PaddedCDHW() + c * HW();
 									for (auto hw = offset; hw < offset + strideHW; hw += VectorSize)
-										((enabled ? VecFloat().load_a(&NeuronsActive[hw]) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[hw]))).store_a(&InputLayer->NeuronsD1[hw]);
+										((enabled ? DropoutMaskVec(hw, Step, Seed, Keep) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta) * VecFloat().load_a(&InputLayer->NeuronsD1[hw]))).store_a(&InputLayer->NeuronsD1[hw]);
 								}
 							});
 						else
@@ -1214,7 +1093,7 @@ namespace dnn
 								{
 									const auto offset = n * CDHW() + c * HW();
 									for (auto hw = offset; hw < offset + HW(); hw++)
-										InputLayer->NeuronsD1[hw] *= (enabled ? NeuronsActive[hw] : Float(1)) * Func.df(InputNeurons[hw], Alpha, Beta);
+										InputLayer->NeuronsD1[hw] *= (enabled ? DropoutMask(hw, Step, Seed, Keep) : Float(1)) * Func.df(InputNeurons[hw], Alpha, Beta);
 								}
 							});
 					}
@@ -1227,7 +1106,7 @@ namespace dnn
 								{
 									const auto offset = n * PaddedCDHW() + c * HW();
 									for (auto hw = offset; hw < offset + strideHW; hw += VectorSize)
-										((enabled ? VecFloat().load_a(&NeuronsActive[hw]) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[hw]))).store_a(&NeuronsD1[hw]);
+										((enabled ? DropoutMaskVec(hw, Step, Seed, Keep) : VecFloat(1)) * (Func.dfVec(VecFloat().load_a(&InputNeurons[hw]), Alpha, Beta) * VecFloat().load_a(&NeuronsD1[hw]))).store_a(&NeuronsD1[hw]);
 								}
 							});
 						else
@@ -1237,7 +1116,7 @@ namespace dnn
 								{
 									const auto offset = n * CDHW() + c * HW();
 									for (auto hw = offset; hw < offset + HW(); hw++)
-										NeuronsD1[hw] *= (enabled ? NeuronsActive[hw] : Float(1)) * Func.df(InputNeurons[hw], Alpha, Beta);
+										NeuronsD1[hw] *= (enabled ? DropoutMask(hw, Step, Seed, Keep) : Float(1)) * Func.df(InputNeurons[hw], Alpha, Beta);
 								}
 							});
 					}
@@ -1355,6 +1234,11 @@ namespace dnn
 			DNN_UNREF_PAR(biasesFillerScale);
 		}
 
+		std::vector<FloatVector*> RunningStats() override
+		{
+			return std::vector<FloatVector*>({ &RunningMean, &RunningVariance });
+		}
+
 		void Save(std::ostream& os, const bool persistOptimizer = false, const Optimizers optimizer = Optimizers::SGD) override
 		{
 			os.write(reinterpret_cast<const char*>(RunningMean.data()), std::streamsize(C * sizeof(Float)));
@@ -1378,11 +1262,10 @@ namespace dnn
 
 		UInt GetNeuronsSize(const UInt batchSize) const override
 		{
-#ifndef DNN_LEAN
-			return batchSize * PaddedCDHW() * sizeof(Float) * (InplaceBwd ? 2 : 3);
-#else
-			return batchSize * PaddedCDHW() * sizeof(Float) * (InplaceBwd ? 1 : 2);
-#endif // DNN_LEAN
+			if constexpr (Reference)
+				return Layer::GetNeuronsSize(batchSize) + (batchSize * PaddedCDHW());
+			else
+				return Layer::GetNeuronsSize(batchSize);
 		}
 	};
 }
\ No newline at end of file
@@ -93,6 +93,16 @@ namespace dnn
 			return 1;
 		}
 
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdSrc) + UInt(reorderBwdDiffSrc);
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			if (InputLayer->DstMemDesc->get_ndims() == 2)
@@ -371,6 +381,11 @@ namespace dnn
 			DNN_UNREF_PAR(biasesFillerScale);
 		}
 
+		std::vector<FloatVector*> RunningStats() override
+		{
+			return std::vector<FloatVector*>({ &RunningMean, &RunningVariance });
+		}
+
 		void Save(std::ostream& os, const bool persistOptimizer = false, const Optimizers optimizer = Optimizers::SGD) override
 		{
 			os.write(reinterpret_cast<const char*>(RunningMean.data()), std::streamsize(C * sizeof(Float)));
@@ -8,11 +8,13 @@ namespace dnn
 	public:
 		const UInt Group;
 		const UInt Groups;
+		bool ZeroCopy;	// Neurons are the group slice of the input (forward-only memory plan at batch size 1, never in training)
 
 		ChannelSplit(const dnn::Device& device, const dnnl::memory::format_tag format, const std::string& name, const std::vector<Layer*>& inputs, const UInt group, const UInt groups) :
 			Layer(device, format, name, LayerTypes::ChannelSplit, 0, 0, inputs[0]->C / groups, inputs[0]->D, inputs[0]->H, inputs[0]->W, 0, 0, 0, inputs),
 			Group(group),
-			Groups(groups)
+			Groups(groups),
+			ZeroCopy(false)
 		{
 			assert(Inputs.size() == 1);
 			assert(InputLayer->C % Groups == 0);
@@ -74,6 +76,9 @@ namespace dnn
 
 		void ForwardProp(const UInt batchSize, const bool training) final override
 		{
+			if (ZeroCopy && !training)
+				return;
+
 			const auto plain = IsPlainFormat();
 			const auto threads = GetThreads(batchSize * (plain ? CDHW() : PaddedCDHW()), Float(10));
 			const auto groupC = (Group - 1) * C;
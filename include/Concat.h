@@ -23,8 +23,11 @@ namespace dnn
 		}
 
 	public:
+		bool ZeroCopy;	// the inputs write straight into their slice of Neurons (forward-only memory plan at batch size 1, never in training)
+
 		Concat(const dnn::Device& device, const dnnl::memory::format_tag format, const std::string& name, const std::vector<Layer*>& inputs) :
-			Layer(device, format, name, LayerTypes::Concat, 0, 0, InputChannels(inputs), inputs[0]->D, inputs[0]->H, inputs[0]->W, 0, 0, 0, inputs)
+			Layer(device, format, name, LayerTypes::Concat, 0, 0, InputChannels(inputs), inputs[0]->D, inputs[0]->H, inputs[0]->W, 0, 0, 0, inputs),
+			ZeroCopy(false)
 		{
 			assert(Inputs.size() > 1);
 		}
@@ -103,6 +106,9 @@ namespace dnn
 
 		void ForwardProp(const UInt batchSize, const bool training) final override
 		{
+			if (ZeroCopy && !training)
+				return;
+
 			if (training)
 			{
 #ifdef DNN_LEAN
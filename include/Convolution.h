@@ -115,6 +115,21 @@ namespace dnn
 			return C / Groups * KernelH * KernelW / StrideH * StrideW;
 		}
 
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdSrc) + UInt(reorderBwdDiffSrc) + UInt(reorderBwdDiffDst) + UInt(reorderBwdWeights) + UInt(reorderBwdDiffWeights);
+		}
+
+		bool BackwardReadsNeurons() const final override
+		{
+			return false;
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			std::vector<dnnl::memory::desc> memDesc;
@@ -149,18 +164,7 @@ namespace dnn
 			bwdAddDesc = std::make_unique<dnnl::binary::primitive_desc>(dnnl::binary::primitive_desc(Device.engine, dnnl::algorithm::binary_add, *InputLayer->DiffDstMemDesc, *InputLayer->DiffDstMemDesc, *InputLayer->DiffDstMemDesc));
 
 			if (*WeightsMemDesc != fwdDesc->weights_desc())
-			{
-				auto memWeights = dnnl::memory(*WeightsMemDesc, Device.engine, Weights.data());
-
-				auto weights = FloatVector(fwdDesc->weights_desc().get_size() / sizeof(Float));
-				auto weightsMem = dnnl::memory(fwdDesc->weights_desc(), Device.engine, weights.data());
-
-				dnnl::reorder(memWeights, weightsMem).execute(Device.stream, std::unordered_map<int, dnnl::memory>{ {DNNL_ARG_FROM, memWeights}, { DNNL_ARG_TO, weightsMem } });
-				Device.stream.wait();
-				
-				Weights = weights;
-				WeightsMemDesc = std::make_unique<dnnl::memory::desc>(fwdDesc->weights_desc());
-			}
+				ReorderWeights(fwdDesc->weights_desc());
 
 			DstMemDesc = std::make_unique<dnnl::memory::desc>(fwdDesc->dst_desc());
 			DiffDstMemDesc = std::make_unique<dnnl::memory::desc>(fwdDesc->dst_desc());
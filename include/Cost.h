@@ -10,7 +10,8 @@ namespace dnn
 		MeanAbsoluteEpsError = 2,
 		MeanAbsoluteError = 3,
 		MeanSquaredError = 4,
-		SmoothHinge = 5
+		SmoothHinge = 5,
+		KullbackLeibler = 6
 	};
 
 	class Cost : public Layer
@@ -18,6 +19,17 @@ namespace dnn
 	private:
 		std::vector<LabelInfo> sampleLabel;
 		std::vector<std::vector<LabelInfo>> sampleLabels;
+
+		inline const LabelInfo& GetLabel(const UInt batchSize, const UInt n) const
+		{
+#ifdef DNN_STOCHASTIC
+			if (batchSize == 1)
+				return sampleLabel[LabelIndex];
+#else
+			DNN_UNREF_PAR(batchSize);
+#endif
+			return sampleLabels[n][LabelIndex];
+		}
 		
 	public:
 		const Costs CostFunction;
@@ -29,14 +41,21 @@ namespace dnn
 		const Float Eps;
 		const bool IsLogSoftmax;
 		UInt TrainErrors;
+		UInt TrainErrorsTop5;
 		Float TrainLoss;
 		Float AvgTrainLoss;
 		Float TrainErrorPercentage;
 		UInt TestErrors;
+		UInt TestErrorsTop5;
 		Float TestLoss;
 		Float AvgTestLoss;
 		Float TestErrorPercentage;
 		std::vector<std::vector<UInt>> ConfusionMatrix;
+		bool Fused;
+		std::vector<Float> SampleLoss;
+		std::vector<UInt> SampleHot;
+		std::vector<Byte> SampleTop5;
+		std::vector<Float> Targets;	// KullbackLeibler: the class probabilities of the teacher for every sample of the training batch (see Distillation.h)
 
 		Cost(const dnn::Device& device, const dnnl::memory::format_tag format, const std::string& name, const Costs cost, const UInt groupIndex, const UInt labelIndex, const UInt c, const std::vector<Layer*>& inputs, const Float labelTrue, const Float labelFalse, const Float weight, const Float eps) :
 			Layer(device, format, name, LayerTypes::Cost, 0, 0, c, 1, 1, 1, 0, 0, 0, inputs),
@@ -47,18 +66,25 @@ namespace dnn
 			LabelFalse(labelFalse),
 			Weight(weight),
 			Eps(eps),
-			IsLogSoftmax(inputs.size() == 1 && inputs[0]->LayerType == LayerTypes::LogSoftmax)
+			IsLogSoftmax(inputs.size() == 1 && inputs[0]->LayerType == LayerTypes::LogSoftmax),
+			Fused(false),
+			SampleLoss(std::vector<Float>()),
+			SampleHot(std::vector<UInt>()),
+			SampleTop5(std::vector<Byte>()),
+			Targets(std::vector<Float>())
 		{
 			assert(Inputs.size() == 1);
 
 			InputLayer->LayerBeforeCost = true;
 
 			TrainErrors = 0;
+			TrainErrorsTop5 = 0;
 			TrainErrorPercentage = Float(0);
 			TrainLoss = Float(0);
 			AvgTrainLoss = Float(0);
 
 			TestErrors = 0;
+			TestErrorsTop5 = 0;
 			TestErrorPercentage = Float(0);
 			TestLoss = Float(0);
 			AvgTestLoss = Float(0);
@@ -75,7 +101,7 @@ namespace dnn
 			description.append(nwl + std::string(" LabelTrue:") + tab + FloatToStringFixed(LabelTrue));
 			description.append(nwl + std::string(" LabelFalse:") + tab + FloatToStringFixed(LabelFalse));
 			description.append(nwl + std::string(" Weight:") + tab + FloatToStringFixed(Weight));
-			if (CostFunction == Costs::MeanAbsoluteEpsError || CostFunction == Costs::CategoricalCrossEntropy)
+			if (CostFunction == Costs::MeanAbsoluteEpsError || CostFunction == Costs::CategoricalCrossEntropy || CostFunction == Costs::KullbackLeibler)
 				description.append(nwl + std::string(" Epsilon:") + tab + FloatToStringFixed(Eps, 6));
 
 			return description;
@@ -111,11 +137,13 @@ namespace dnn
 		void Reset()
 		{
 			TrainErrors = 0;
+			TrainErrorsTop5 = 0;
 			TrainErrorPercentage = Float(0);
 			TrainLoss = Float(0);
 			AvgTrainLoss = Float(0);
 
 			TestErrors = 0;
+			TestErrorsTop5 = 0;
 			TestErrorPercentage = Float(0);
 			TestLoss = Float(0);
 			AvgTestLoss = Float(0);
@@ -123,8 +151,113 @@ namespace dnn
 			ConfusionMatrix = std::vector<std::vector<UInt>>(C, std::vector<UInt>(C, 0));
 		}
 
+		// KullbackLeibler: the teacher probabilities blended with Eps of the hard label, only the hard label without a teacher or outside training
+		inline Float Target(const UInt batchSize, const UInt n, const UInt c, const bool distill) const
+		{
+			const auto hot = c == GetLabel(batchSize, n).LabelA ? Float(1) : Float(0);
+
+			return distill ? (Float(1) - Eps) * Targets[n * C + c] + Eps * hot : hot;
+		}
+
+		// CategoricalCrossEntropy after a Softmax/LogSoftmax with a flat plain input: the (log)softmax is computed here from the logits
+		// together with the loss, the arg-max and the top-5 hit of every sample, in one vectorized pass parallel over the batch.
+		// The gradient isn't fused, BackwardProp is the same as without fusion and reads the (log)softmax written here.
+		bool CanFuse() const
+		{
+			if (CostFunction != Costs::CategoricalCrossEntropy || (InputLayer->LayerType != LayerTypes::Softmax && InputLayer->LayerType != LayerTypes::LogSoftmax))
+				return false;
+
+			const auto logits = InputLayer->InputLayer;
+
+			return InputLayer->Outputs.size() == 1ull && InputLayer->CDHW() == C && logits->CDHW() == C && (logits->DstMemDesc->get_ndims() == 2 || logits->IsPlainFormat());
+		}
+
+		void ForwardPropFused(const UInt batchSize, const bool training)
+		{
+			DNN_UNREF_PAR(training);
+
+			if (SampleLoss.size() < batchSize)
+			{
+				SampleLoss.resize(batchSize);
+				SampleHot.resize(batchSize);
+				SampleTop5.resize(batchSize);
+			}
+
+			const auto logits = InputLayer->InputLayer->Neurons.data();
+			const auto outputs = InputLayer->Neurons.data();
+			const auto logSoftmax = InputLayer->LayerType == LayerTypes::LogSoftmax;
+			const auto part = C - (C % VectorSize);
+			const auto threads = std::min<UInt>(GetThreads(batchSize * C, Float(0.5)), batchSize);
+
+			for_i(batchSize, threads, [&](const UInt n)
+			{
+				const auto x = logits + n * C;
+				const auto y = outputs + n * C;
+				const auto label = GetLabel(batchSize, n).LabelA;
+
+				auto vecMax = VecFloat(std::numeric_limits<Float>::lowest());
+				for (auto c = 0ull; c < part; c += VectorSize)
+					vecMax = max(vecMax, VecFloat().load(x + c));
+				auto maxValue = horizontal_max(vecMax);
+				for (auto c = part; c < C; c++)
+					maxValue = std::max(maxValue, x[c]);
+
+				auto vecSum = VecFloat(0);
+				for (auto c = 0ull; c < part; c += VectorSize)
+					vecSum += exp(VecFloat().load(x + c) - maxValue);
+				auto sum = horizontal_add(vecSum);
+				for (auto c = part; c < C; c++)
+					sum += std::exp(x[c] - maxValue);
+
+				const auto logSum = std::log(sum);
+				if (logSoftmax)
+				{
+					const auto shift = maxValue + logSum;
+					for (auto c = 0ull; c < part; c += VectorSize)
+						(VecFloat().load(x + c) - shift).store(y + c);
+					for (auto c = part; c < C; c++)
+						y[c] = x[c] - shift;
+				}
+				else
+				{
+					const auto scale = Float(1) / sum;
+					for (auto c = 0ull; c < part; c += VectorSize)
+						(exp(VecFloat().load(x + c) - maxValue) * scale).store(y + c);
+					for (auto c = part; c < C; c++)
+						y[c] = std::exp(x[c] - maxValue) * scale;
+				}
+
+				auto hot = 0ull;
+				while (hot < C - 1ull && x[hot] != maxValue)
+					hot++;
+
+				const auto target = x[label];
+				auto greater = 0ull;
+				for (auto c = 0ull; c < part; c += VectorSize)
+					greater += horizontal_count(VecFloat().load(x + c) > target);
+				for (auto c = part; c < C; c++)
+					greater += x[c] > target ? 1ull : 0ull;
+
+				SampleLoss[n] = maxValue + logSum - target;
+				SampleHot[n] = hot;
+				SampleTop5[n] = greater < 5ull ? 1 : 0;
+
+				std::fill_n(&Neurons[n * C], C, Float(0));
+				Neurons[n * C + label] = SampleLoss[n];
+#ifndef DNN_LEAN
+				std::fill_n(&NeuronsD1[n * C], C, Float(0));
+#endif
+			});
+		}
+
 		void ForwardProp(const UInt batchSize, const bool training) final override
 		{
+			if (Fused)
+			{
+				ForwardPropFused(batchSize, training);
+				return;
+			}
+
 			DNN_UNREF_PAR(training);
 
 			switch (CostFunction)
@@ -367,6 +500,25 @@ namespace dnn
 #endif
 			}
 			break;
+
+			case Costs::KullbackLeibler:
+			{
+				const auto distill = training && Targets.size() >= batchSize * C;
+
+				for (auto n = 0ull; n < batchSize; n++)
+					for (auto c = 0ull; c < C; c++)
+					{
+						const auto nc = n * C + c;
+						const auto target = Target(batchSize, n, c, distill);
+						const auto logProbability = IsLogSoftmax ? InputLayer->Neurons[nc] : std::log(std::max(InputLayer->Neurons[nc], std::numeric_limits<Float>::min()));
+
+						Neurons[nc] = target > Float(0) ? target * (std::log(target) - logProbability) : Float(0);
+#ifndef DNN_LEAN
+						NeuronsD1[nc] = Float(0);
+#endif
+					}
+			}
+			break;
 			}
 		}
 
@@ -616,6 +768,21 @@ namespace dnn
 #endif
 			}
 			break;
+
+			case Costs::KullbackLeibler:
+			{
+				const auto distill = Targets.size() >= batchSize * C;
+
+				for (auto n = 0ull; n < batchSize; n++)
+					for (auto c = 0ull; c < C; c++)
+					{
+						const auto nc = n * C + c;
+						const auto probability = IsLogSoftmax ? std::exp(InputLayerFwd->Neurons[nc]) : InputLayerFwd->Neurons[nc];
+
+						InputLayer->NeuronsD1[nc] = probability - Target(batchSize, n, c, distill);
+					}
+			}
+			break;
 			}
 
 #ifdef DNN_LEAN
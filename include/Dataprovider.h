@@ -16,6 +16,20 @@ namespace dnn
 		tinyimagenet = 4
 	};
 
+	// Overrides for the synthetic dataset, zero (or empty) keeps the value of the dataset named in the definition.
+	// The class counts have to match the Cost layers of the definition.
+	struct SyntheticDataset
+	{
+		UInt C = 0;
+		UInt D = 0;
+		UInt H = 0;
+		UInt W = 0;
+		std::vector<UInt> ClassCount = std::vector<UInt>();
+		UInt TrainingSamplesCount = 0;
+		UInt TestingSamplesCount = 0;
+		UInt Seed = 1;
+	};
+
 	class Dataprovider final
 	{
 	public:
@@ -38,6 +52,8 @@ namespace dnn
 		ImageByteVector TestingSamples;
 		std::vector<std::vector<UInt>> TrainingLabels;
 		std::vector<std::vector<UInt>> TestingLabels;
+		bool Synthetic;
+		SyntheticDataset SyntheticParameters;
 
 		Dataprovider(const std::string& directory) :
 			StorageDirectory(std::filesystem::path(directory)),
@@ -53,7 +69,9 @@ namespace dnn
 			TrainingSamplesCount(50000),
 			TestingSamplesCount(10000),
 			Hierarchies(1),
-			ClassCount(std::vector<UInt>({ 10 }))
+			ClassCount(std::vector<UInt>({ 10 })),
+			Synthetic(false),
+			SyntheticParameters(SyntheticDataset())
 		{
 			std::filesystem::create_directories(DatasetsDirectory);
 
@@ -471,9 +489,16 @@ namespace dnn
 			return result;
 		}
 
+		// when enabled LoadDataset fabricates the samples instead of reading (or downloading) the dataset files
+		void SetSynthetic(const bool enable, const SyntheticDataset& parameters = SyntheticDataset())
+		{
+			Synthetic = enable;
+			SyntheticParameters = parameters;
+		}
+
 		bool LoadDataset(const Datasets dataset)
 		{
-			if (!DatasetAvailable(dataset))
+			if (!Synthetic && !DatasetAvailable(dataset))
 			{
 				GetDataset(dataset);
 
@@ -569,6 +594,9 @@ namespace dnn
 				break;
 			}
 
+			if (Synthetic)
+				return LoadSyntheticDataset(dataset);
+
 			switch (dataset)
 			{
 			case Datasets::cifar10:
@@ -830,6 +858,72 @@ namespace dnn
 			return true;
 		}
 
+		// Every sample is a function of the seed and its index only (Threefry counters), so the dataset is the same
+		// whatever the number of threads. The pixels of a class scatter around a per class and channel level, enough
+		// for a network to learn something while its throughput is measured.
+		bool LoadSyntheticDataset(const Datasets dataset)
+		{
+			const auto& p = SyntheticParameters;
+
+			C = p.C > 0 ? p.C : C;
+			D = p.D > 0 ? p.D : D;
+			H = p.H > 0 ? p.H : H;
+			W = p.W > 0 ? p.W : W;
+			ClassCount = p.ClassCount.empty() ? ClassCount : p.ClassCount;
+			Hierarchies = ClassCount.size();
+			TrainingSamplesCount = p.TrainingSamplesCount > 0 ? p.TrainingSamplesCount : TrainingSamplesCount;
+			TestingSamplesCount = p.TestingSamplesCount > 0 ? p.TestingSamplesCount : TestingSamplesCount;
+
+			if (Hierarchies == 0 || std::find(ClassCount.begin(), ClassCount.end(), 0ull) != ClassCount.end())
+				return false;
+
+			TrainingSamples = ImageByteVector(TrainingSamplesCount);
+			TestingSamples = ImageByteVector(TestingSamplesCount);
+			TrainingLabels = std::vector<std::vector<UInt>>(TrainingSamplesCount, std::vector<UInt>(Hierarchies));
+			TestingLabels = std::vector<std::vector<UInt>>(TestingSamplesCount, std::vector<UInt>(Hierarchies));
+
+			const auto key0 = static_cast<uint32_t>(p.Seed);
+			const auto key1 = static_cast<uint32_t>(p.Seed >> 32);
+			const auto classes = ClassCount.back();
+
+			const auto generate = [=](ImageByteVector& samples, std::vector<std::vector<UInt>>& labels, const UInt count, const uint32_t stream)
+			{
+				for_i_dynamic(count, [=, &samples, &labels](UInt index)
+				{
+					// the finest hierarchy is drawn, the coarser ones are derived from it
+					const auto label = UInt(Threefry<uint32_t>(static_cast<uint32_t>(index), stream, key0, key1)) % classes;
+					for (auto h = 0ull; h < Hierarchies; h++)
+						labels[index][h] = label * ClassCount[h] / classes;
+
+					auto image = Image<Byte>(static_cast<unsigned>(C), static_cast<unsigned>(D), static_cast<unsigned>(H), static_cast<unsigned>(W));
+					auto element = uint32_t(0);
+					for (auto c = 0u; c < C; c++)
+					{
+						const auto level = int(64u + Threefry<uint32_t>(c, static_cast<uint32_t>(label), key0, key1 ^ 0x9E3779B9u) % 128u);
+						for (auto d = 0u; d < D; d++)
+							for (auto h = 0u; h < H; h++)
+								for (auto w = 0u; w < W; w++)
+								{
+									const auto noise = int(Threefry<uint32_t>(element++, static_cast<uint32_t>(index), key0 ^ stream, key1) >> 24) - 128;
+									image(c, d, h, w) = static_cast<Byte>(std::clamp(level + noise / 4, 0, 255));
+								}
+					}
+
+					samples[index] = image;
+				});
+			};
+
+			generate(TrainingSamples, TrainingLabels, TrainingSamplesCount, 0x5EED0000u);
+			generate(TestingSamples, TestingLabels, TestingSamplesCount, 0x5EED0001u);
+
+			Mean = GetMean(TrainingSamplesCount, C, D, H, W);
+			StdDev = GetStdDev(Mean, TrainingSamplesCount, C, D, H, W);
+
+			Dataset = dataset;
+
+			return true;
+		}
+
 		void GetTinyImageNetLabels(const std::filesystem::path& path)
 		{
 			auto classnames = std::ofstream((path / "classnames.txt").string(), std::ios::trunc);
@@ -3,124 +3,721 @@
 
 namespace dnn
 {
+	// Case-insensitive keyword lookup through a perfect hash: the seed is searched once so that every keyword lands
+	// in a slot of its own, a lookup is then one hash and one comparison without any allocation.
+	class KeywordTable
+	{
+	private:
+		std::vector<std::string> slots;
+		UInt mask;
+		uint64_t seed;
+
+		static inline char Lower(const char c) noexcept
+		{
+			return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+		}
+
+		static inline uint64_t Hash(const char* text, const UInt length, const uint64_t seed) noexcept
+		{
+			auto hash = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+			for (auto i = 0ull; i < length; i++)
+				hash = (hash ^ uint64_t(Lower(text[i]))) * 1099511628211ull;
+
+			return hash ^ (hash >> 29);
+		}
+
+		static inline bool Equal(const std::string& keyword, const char* text, const UInt length) noexcept
+		{
+			if (keyword.size() != length)
+				return false;
+
+			for (auto i = 0ull; i < length; i++)
+				if (Lower(keyword[i]) != Lower(text[i]))
+					return false;
+
+			return true;
+		}
+
+	public:
+		KeywordTable(const std::vector<std::string>& keywords) :
+			slots(std::vector<std::string>()),
+			mask(0),
+			seed(0)
+		{
+			auto size = 2ull;
+			while (size < 2ull * keywords.size())
+				size *= 2ull;
+
+			while (true)
+			{
+				for (auto s = 0ull; s < 256ull; s++)
+				{
+					auto table = std::vector<std::string>(size);
+					auto perfect = true;
+
+					for (const auto& keyword : keywords)
+					{
+						auto& slot = table[Hash(keyword.data(), keyword.size(), s) & (size - 1ull)];
+						if (slot.empty())
+							slot = keyword;
+						else if (!Equal(slot, keyword.data(), keyword.size()))
+						{
+							perfect = false;
+							break;
+						}
+					}
+
+					if (perfect)
+					{
+						slots = std::move(table);
+						mask = size - 1ull;
+						seed = s;
+						return;
+					}
+				}
+
+				size *= 2ull;
+			}
+		}
+
+		// the keyword as spelled in the table, nullptr if the text isn't one
+		const std::string* Find(const char* text, const UInt length) const noexcept
+		{
+			const auto& slot = slots[Hash(text, length, seed) & mask];
+
+			return !slot.empty() && Equal(slot, text, length) ? &slot : nullptr;
+		}
+	};
+
+	template<typename T>
+	std::vector<std::string> EnumKeywords()
+	{
+		auto keywords = std::vector<std::string>();
+		for (const auto name : magic_enum::enum_names<T>())
+			keywords.push_back(std::string(name));
+
+		return keywords;
+	}
+
+	// Single pass over the definition: white space and empty lines are dropped, every section starts after an empty line
+	// and the keys, the enum values and Yes/No/True/False get the spelling Parse expects.
 	const std::string NormalizeDefinition(const std::string& definition)
 	{
-		auto defNorm = std::string(definition);
-
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), tab, "");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), " ", "");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), nwl + nwl + nwl + nwl + nwl + nwl + nwl + nwl, nwl);
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), nwl + nwl + nwl + nwl + nwl + nwl + nwl, nwl);
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), nwl + nwl + nwl + nwl + nwl + nwl, nwl);
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), nwl + nwl + nwl + nwl + nwl, nwl);
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), nwl + nwl + nwl + nwl, nwl);
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), nwl + nwl + nwl, nwl);
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), nwl + nwl, nwl);
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "[", nwl + "[");
-
-		defNorm = Trim(defNorm);
-
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "=Yes", "=Yes");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "=No", "=No");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "=True", "=True");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "=False", "=False");
-
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Inputs=", "Inputs=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "WeightsScale=", "WeightsScale=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "WeightsLRM=", "WeightsLRM=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "WeightsWDM=", "WeightsWDM=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "BiasesScale=", "BiasesScale=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "BiasesLRM=", "BiasesLRM=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "BiasesWDM=", "BiasesWDM=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Biases=", "Biases=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Momentum=", "Momentum=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Scaling=", "Scaling=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Eps=", "Eps=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Dim=", "Dim=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "MeanStd=", "MeanStd=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "ZeroPad=", "ZeroPad=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "MirrorPad=", "MirrorPad=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "RandomCrop=", "RandomCrop=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Dropout=", "Dropout=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "DepthDrop=", "DepthDrop=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "FixedDepthDrop=", "FixedDepthDrop=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Channels=", "Channels=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Kernel=", "Kernel=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Stride=", "Stride=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Dilation=", "Dilation=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Pad=", "Pad=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Alpha=", "Alpha=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Beta=", "Beta=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Factor=", "Factor=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Groups=", "Groups=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Group=", "Group=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Multiplier=", "Multiplier=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "AcrossChannel=", "AcrossChannel=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "LocalSize=", "LocalSize=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "K=", "K=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "CostIndex=", "CostIndex=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "GroupIndex=", "GroupIndex=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "LabelIndex=", "LabelIndex=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "LabelTrue=", "LabelTrue=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "LabelFalse=", "LabelFalse=");
-		defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), "Weight=", "Weight=");
-
-		auto types = magic_enum::enum_names<LayerTypes>();
-		for (auto type : types)
+		static const auto keys = KeywordTable({ "Type", "Inputs", "Activation", "Cost", "Dataset", "Algorithm", "WeightsFiller", "BiasesFiller",
+			"WeightsScale", "WeightsLRM", "WeightsWDM", "BiasesScale", "BiasesLRM", "BiasesWDM", "Biases", "Momentum", "Scaling", "Eps", "Dim",
+			"MeanStd", "ZeroPad", "MirrorPad", "RandomCrop", "Dropout", "DepthDrop", "FixedDepthDrop", "Channels", "Kernel", "Stride", "Dilation",
+			"Pad", "Alpha", "Beta", "Factor", "Groups", "Group", "Multiplier", "AcrossChannel", "LocalSize", "K", "CostIndex", "GroupIndex",
+			"LabelIndex", "LabelTrue", "LabelFalse", "Weight" });
+		static const auto layerTypes = KeywordTable(EnumKeywords<LayerTypes>());
+		static const auto activations = KeywordTable(EnumKeywords<Activations>());
+		static const auto costs = KeywordTable(EnumKeywords<Costs>());
+		static const auto fillers = KeywordTable(EnumKeywords<Fillers>());
+		static const auto fillerModes = KeywordTable(EnumKeywords<FillerModes>());
+		static const auto datasets = KeywordTable(EnumKeywords<Datasets>());
+		static const auto algorithms = KeywordTable(EnumKeywords<Algorithms>());
+		static const auto booleans = KeywordTable({ "Yes", "No", "True", "False" });
+
+		auto defNorm = std::string();
+		defNorm.reserve(definition.size());
+
+		const auto append = [&](const KeywordTable* table, const char* text, const UInt length)
+		{
+			const auto keyword = table ? table->Find(text, length) : nullptr;
+			if (keyword)
+				defNorm += *keyword;
+			else
+				defNorm.append(text, length);
+		};
+
+		auto line = std::string();
+		auto begin = 0ull;
+		while (begin < definition.size())
 		{
-			auto text = "Type=" + std::string(type);
-			defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), text, text);
+			auto end = definition.find('\n', begin);
+			if (end == std::string::npos)
+				end = definition.size();
+
+			line.clear();
+			for (auto i = begin; i < end; i++)
+				if (definition[i] != ' ' && definition[i] != '\t' && definition[i] != '\r')
+					line += definition[i];
+
+			begin = end + 1ull;
+
+			if (line.empty())
+				continue;
+
+			if (!defNorm.empty())
+				defNorm += line[0] == '[' ? nwl + nwl : nwl;
+
+			const auto equal = line.find('=');
+			if (line[0] == '[' || equal == std::string::npos)
+			{
+				defNorm += line;
+				continue;
+			}
+
+			const auto key = keys.Find(line.data(), equal);
+			append(&keys, line.data(), equal);
+			defNorm += '=';
+
+			const auto value = line.data() + equal + 1ull;
+			const auto length = line.size() - equal - 1ull;
+
+			if (key && (*key == "WeightsFiller" || *key == "BiasesFiller"))
+			{
+				// Filler(Mode,Gain)
+				const auto open = UInt(std::find(value, value + length, '(') - value);
+				append(&fillers, value, open);
+
+				if (open < length)
+				{
+					const auto mode = value + open + 1ull;
+					const auto modeLength = UInt(std::find_if(mode, value + length, [](const char c) { return c == ',' || c == ')'; }) - mode);
+					defNorm += '(';
+					append(&fillerModes, mode, modeLength);
+					defNorm.append(mode + modeLength, length - open - 1ull - modeLength);
+				}
+			}
+			else if (key && *key == "Type")
+				append(&layerTypes, value, length);
+			else if (key && *key == "Activation")
+				append(&activations, value, length);
+			else if (key && *key == "Cost")
+				append(&costs, value, length);
+			else if (key && *key == "Dataset")
+				append(&datasets, value, length);
+			else if (key && *key == "Algorithm")
+				append(&algorithms, value, length);
+			else
+				append(&booleans, value, length);
 		}
 
-		auto activations = magic_enum::enum_names<Activations>();
-		for (auto activation : activations)
+		return defNorm;
+	}
+
+	// Writes or reads the fields handed to it in the order they are given, strings and vectors with their length in front
+	class DefinitionArchive
+	{
+	private:
+		std::ostream* os;
+		std::istream* is;
+
+	public:
+		DefinitionArchive(std::ostream& stream) : os(&stream), is(nullptr) { }
+		DefinitionArchive(std::istream& stream) : os(nullptr), is(&stream) { }
+
+		bool Loading() const { return is != nullptr; }
+		bool Good() const { return os ? os->good() : is->good(); }
+
+		template<typename T>
+		void operator()(T& value)
 		{
-			auto text = "Activation=" + std::string(activation);
-			defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), text, text);
+			static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable fields are archived as bytes");
+
+			if (os)
+				os->write(reinterpret_cast<const char*>(&value), sizeof(T));
+			else
+				is->read(reinterpret_cast<char*>(&value), sizeof(T));
 		}
 
-		auto costs = magic_enum::enum_names<Costs>();
-		for (auto cost : costs)
+		void operator()(std::string& value)
 		{
-			auto text = "Cost=" + std::string(cost);
-			defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), text, text);
+			auto size = UInt(value.size());
+			(*this)(size);
+
+			if (os)
+				os->write(value.data(), std::streamsize(size));
+			else if (is->good())
+			{
+				value.resize(size);
+				is->read(value.data(), std::streamsize(size));
+			}
 		}
 
-		auto fillers = magic_enum::enum_names<Fillers>();
-		for (auto filler : fillers)
+		void operator()(std::vector<std::string>& values)
 		{
-			auto textFillerWeights = "WeightsFiller=" + std::string(filler);
-			defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), textFillerWeights, textFillerWeights);
+			auto size = UInt(values.size());
+			(*this)(size);
 
-			auto textFillerBiases = "BiasesFiller=" + std::string(filler);
-			defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), textFillerBiases, textFillerBiases);
+			if (Loading() && is->good())
+				values.resize(size);
+			for (auto i = 0ull; i < values.size() && Good(); i++)
+				(*this)(values[i]);
 		}
 
-		auto fillerModes = magic_enum::enum_names<FillerModes>();
-		for (auto fillerMode : fillerModes)
+		template<typename T, typename U, typename... Rest>
+		void operator()(T& first, U& second, Rest&... rest)
 		{
-			auto textFillerMode = "(" + std::string(fillerMode) + ")";
-			defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), textFillerMode, textFillerMode);
+			(*this)(first);
+			(*this)(second, rest...);
 		}
+	};
 
-		auto datasets = magic_enum::enum_names<Datasets>();
-		for (auto dataset : datasets)
+	// A layer of a parsed definition with everything its constructor is given
+	struct LayerRecord
+	{
+		LayerTypes Type;
+		std::string Name;
+		std::vector<std::string> Inputs;
+		UInt C;
+		UInt D;
+		UInt H;
+		UInt W;
+		Activations ActivationFunction;
+		Float Alpha;
+		Float Beta;
+		UInt KernelH;
+		UInt KernelW;
+		UInt StrideH;
+		UInt StrideW;
+		UInt DilationH;
+		UInt DilationW;
+		UInt PadH;
+		UInt PadW;
+		bool Scaling;
+		Float Momentum;
+		Float Eps;
+		bool Biases;
+		Float Dropout;
+		UInt Group;
+		UInt Groups;
+		UInt Multiplier;
+		Costs CostFunction;
+		UInt GroupIndex;
+		UInt LabelIndex;
+		Float LabelTrue;
+		Float LabelFalse;
+		Float Weight;
+		bool AcrossChannels;
+		UInt LocalSize;
+		Float K;
+		Algorithms Algorithm;
+		Float FactorH;
+		Float FactorW;
+		bool UseDefaultParams;
+		Fillers WeightsFiller;
+		FillerModes WeightsFillerMode;
+		Float WeightsGain;
+		Float WeightsScale;
+		Float WeightsLRM;
+		Float WeightsWDM;
+		Fillers BiasesFiller;
+		FillerModes BiasesFillerMode;
+		Float BiasesGain;
+		Float BiasesScale;
+		Float BiasesLRM;
+		Float BiasesWDM;
+
+		void Serialize(DefinitionArchive& archive)
 		{
-			auto text = "Dataset=" + std::string(dataset);
-			defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), text, text);
+			archive(Type, Name, Inputs, C, D, H, W, ActivationFunction, Alpha, Beta, KernelH, KernelW, StrideH, StrideW, DilationH, DilationW, PadH, PadW);
+			archive(Scaling, Momentum, Eps, Biases, Dropout, Group, Groups, Multiplier, CostFunction, GroupIndex, LabelIndex, LabelTrue, LabelFalse, Weight);
+			archive(AcrossChannels, LocalSize, K, Algorithm, FactorH, FactorW, UseDefaultParams);
+			archive(WeightsFiller, WeightsFillerMode, WeightsGain, WeightsScale, WeightsLRM, WeightsWDM, BiasesFiller, BiasesFillerMode, BiasesGain, BiasesScale, BiasesLRM, BiasesWDM);
 		}
+	};
 
-		auto algorithms = magic_enum::enum_names<Algorithms>();
-		for (auto algorithm : algorithms)
+	// The outcome of parsing a definition: the model settings and the layers in order, a model is built from it without parsing again
+	struct CompiledDefinition
+	{
+		Datasets Dataset;
+		UInt C;
+		UInt D;
+		UInt H;
+		UInt W;
+		UInt PadD;
+		UInt PadH;
+		UInt PadW;
+		bool MeanStdNormalization;
+		bool MirrorPad;
+		bool RandomCrop;
+		bool FixedDepthDrop;
+		Float DepthDrop;
+		Float Dropout;
+		bool HasBias;
+		Float AlphaFiller;
+		Float BetaFiller;
+		bool BatchNormScaling;
+		Float BatchNormMomentum;
+		Float BatchNormEps;
+		Fillers WeightsFiller;
+		FillerModes WeightsFillerMode;
+		Float WeightsGain;
+		Float WeightsScale;
+		Float WeightsLRM;
+		Float WeightsWDM;
+		Fillers BiasesFiller;
+		FillerModes BiasesFillerMode;
+		Float BiasesGain;
+		Float BiasesScale;
+		Float BiasesLRM;
+		Float BiasesWDM;
+		std::vector<LayerRecord> Layers;
+
+		void Capture(const Model& model)
 		{
-			auto text = "Algorithm=" + std::string(algorithm);
-			defNorm = CaseInsensitiveReplace(defNorm.begin(), defNorm.end(), text, text);
+			Dataset = model.Dataset;
+			C = model.C;
+			D = model.D;
+			H = model.H;
+			W = model.W;
+			PadD = model.PadD;
+			PadH = model.PadH;
+			PadW = model.PadW;
+			MeanStdNormalization = model.MeanStdNormalization;
+			MirrorPad = model.MirrorPad;
+			RandomCrop = model.RandomCrop;
+			FixedDepthDrop = model.FixedDepthDrop;
+			DepthDrop = model.DepthDrop;
+			Dropout = model.Dropout;
+			HasBias = model.HasBias;
+			AlphaFiller = model.AlphaFiller;
+			BetaFiller = model.BetaFiller;
+			BatchNormScaling = model.BatchNormScaling;
+			BatchNormMomentum = model.BatchNormMomentum;
+			BatchNormEps = model.BatchNormEps;
+			WeightsFiller = model.WeightsFiller;
+			WeightsFillerMode = model.WeightsFillerMode;
+			WeightsGain = model.WeightsGain;
+			WeightsScale = model.WeightsScale;
+			WeightsLRM = model.WeightsLRM;
+			WeightsWDM = model.WeightsWDM;
+			BiasesFiller = model.BiasesFiller;
+			BiasesFillerMode = model.BiasesFillerMode;
+			BiasesGain = model.BiasesGain;
+			BiasesScale = model.BiasesScale;
+			BiasesLRM = model.BiasesLRM;
+			BiasesWDM = model.BiasesWDM;
 		}
 
-		return defNorm;
+		void Apply(Model& model) const
+		{
+			model.Dataset = Dataset;
+			model.C = C;
+			model.D = D;
+			model.H = H;
+			model.W = W;
+			model.PadD = PadD;
+			model.PadH = PadH;
+			model.PadW = PadW;
+			model.MeanStdNormalization = MeanStdNormalization;
+			model.MirrorPad = MirrorPad;
+			model.RandomCrop = RandomCrop;
+			model.FixedDepthDrop = FixedDepthDrop;
+			model.DepthDrop = DepthDrop;
+			model.Dropout = Dropout;
+			model.HasBias = HasBias;
+			model.AlphaFiller = AlphaFiller;
+			model.BetaFiller = BetaFiller;
+			model.BatchNormScaling = BatchNormScaling;
+			model.BatchNormMomentum = BatchNormMomentum;
+			model.BatchNormEps = BatchNormEps;
+			model.WeightsFiller = WeightsFiller;
+			model.WeightsFillerMode = WeightsFillerMode;
+			model.WeightsGain = WeightsGain;
+			model.WeightsScale = WeightsScale;
+			model.WeightsLRM = WeightsLRM;
+			model.WeightsWDM = WeightsWDM;
+			model.BiasesFiller = BiasesFiller;
+			model.BiasesFillerMode = BiasesFillerMode;
+			model.BiasesGain = BiasesGain;
+			model.BiasesScale = BiasesScale;
+			model.BiasesLRM = BiasesLRM;
+			model.BiasesWDM = BiasesWDM;
+		}
+
+		// false when the stream ends before all the layers are read
+		bool Serialize(DefinitionArchive& archive)
+		{
+			archive(Dataset, C, D, H, W, PadD, PadH, PadW, MeanStdNormalization, MirrorPad, RandomCrop, FixedDepthDrop, DepthDrop, Dropout, HasBias);
+			archive(AlphaFiller, BetaFiller, BatchNormScaling, BatchNormMomentum, BatchNormEps);
+			archive(WeightsFiller, WeightsFillerMode, WeightsGain, WeightsScale, WeightsLRM, WeightsWDM, BiasesFiller, BiasesFillerMode, BiasesGain, BiasesScale, BiasesLRM, BiasesWDM);
+
+			auto count = UInt(Layers.size());
+			archive(count);
+			if (archive.Loading() && archive.Good())
+				Layers.resize(count);
+
+			for (auto i = 0ull; i < Layers.size() && archive.Good(); i++)
+				Layers[i].Serialize(archive);
+
+			return archive.Good();
+		}
+	};
+
+	void CreateLayer(Model& model, const LayerRecord& layer)
+	{
+		const auto& name = layer.Name;
+		const auto inputs = model.GetLayerInputs(layer.Inputs);
+
+		switch (layer.Type)
+		{
+		case LayerTypes::Input:
+			model.Layers.push_back(std::make_unique<Input>(model.Device, model.Format, name, layer.C, layer.D, layer.H, layer.W));
+			break;
+		case LayerTypes::Activation:
+			model.Layers.push_back(std::make_unique<Activation>(model.Device, model.Format, name, layer.ActivationFunction, inputs, layer.Alpha, layer.Beta));
+			break;
+		case LayerTypes::Add:
+			model.Layers.push_back(std::make_unique<Add>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::Average:
+			model.Layers.push_back(std::make_unique<Average>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::AvgPooling:
+			model.Layers.push_back(std::make_unique<AvgPooling>(model.Device, model.Format, name, inputs, layer.KernelH, layer.KernelW, layer.StrideH, layer.StrideW, layer.DilationH, layer.DilationW, layer.PadH, layer.PadW));
+			break;
+		case LayerTypes::BatchNorm:
+			model.Layers.push_back(std::make_unique<BatchNorm>(model.Device, model.Format, name, inputs, layer.Scaling, layer.Momentum, layer.Eps, layer.Biases));
+			break;
+		case LayerTypes::BatchNormActivation:
+			model.Layers.push_back(std::make_unique<BatchNormActivation>(model.Device, model.Format, name, layer.ActivationFunction, inputs, layer.Scaling, layer.Alpha, layer.Beta, layer.Momentum, layer.Eps, layer.Biases));
+			break;
+		case LayerTypes::BatchNormActivationDropout:
+			model.Layers.push_back(std::make_unique<BatchNormActivationDropout>(model.Device, model.Format, name, layer.ActivationFunction, inputs, layer.Dropout, layer.Dropout != model.Dropout, layer.Scaling, layer.Alpha, layer.Beta, layer.Momentum, layer.Eps, layer.Biases));
+			break;
+		case LayerTypes::BatchNormRelu:
+			model.Layers.push_back(std::make_unique<BatchNormRelu>(model.Device, model.Format, name, inputs, layer.Scaling, layer.Momentum, layer.Eps, layer.Biases));
+			break;
+		case LayerTypes::ChannelSplit:
+			model.Layers.push_back(std::make_unique<ChannelSplit>(model.Device, model.Format, name, inputs, layer.Group, layer.Groups));
+			break;
+		case LayerTypes::ChannelZeroPad:
+			model.Layers.push_back(std::make_unique<ChannelZeroPad>(model.Device, model.Format, name, inputs, layer.C));
+			break;
+		case LayerTypes::Concat:
+			model.Layers.push_back(std::make_unique<Concat>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::Convolution:
+			model.Layers.push_back(std::make_unique<Convolution>(model.Device, model.Format, name, inputs, layer.C, layer.KernelH, layer.KernelW, layer.StrideH, layer.StrideW, layer.DilationH, layer.DilationW, layer.PadH, layer.PadW, layer.Groups, layer.Biases));
+			break;
+		case LayerTypes::ConvolutionTranspose:
+			model.Layers.push_back(std::make_unique<ConvolutionTranspose>(model.Device, model.Format, name, inputs, layer.C, layer.KernelH, layer.KernelW, layer.StrideH, layer.StrideW, layer.DilationH, layer.DilationW, layer.PadH, layer.PadW, layer.Biases));
+			break;
+		case LayerTypes::Cost:
+			model.Layers.push_back(std::make_unique<Cost>(model.Device, model.Format, name, layer.CostFunction, layer.GroupIndex, layer.LabelIndex, layer.C, inputs, layer.LabelTrue, layer.LabelFalse, layer.Weight, layer.Eps));
+			model.CostLayers.push_back(dynamic_cast<Cost*>(model.Layers[model.Layers.size() - 1].get()));
+			model.CostFuction = layer.CostFunction;
+			break;
+		case LayerTypes::Dense:
+			model.Layers.push_back(std::make_unique<Dense>(model.Device, model.Format, name, layer.C, inputs, layer.Biases));
+			break;
+		case LayerTypes::DepthwiseConvolution:
+			model.Layers.push_back(std::make_unique<DepthwiseConvolution>(model.Device, model.Format, name, inputs, layer.KernelH, layer.KernelW, layer.StrideH, layer.StrideW, layer.DilationH, layer.DilationW, layer.PadH, layer.PadW, layer.Multiplier, layer.Biases));
+			break;
+		case LayerTypes::Divide:
+			model.Layers.push_back(std::make_unique<Divide>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::Dropout:
+			model.Layers.push_back(std::make_unique<Dropout>(model.Device, model.Format, name, inputs, layer.Dropout, layer.Dropout != model.Dropout));
+			break;
+		case LayerTypes::GlobalAvgPooling:
+			model.Layers.push_back(std::make_unique<GlobalAvgPooling>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::GlobalMaxPooling:
+			model.Layers.push_back(std::make_unique<GlobalMaxPooling>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::LayerNorm:
+			model.Layers.push_back(std::make_unique<LayerNorm>(model.Device, model.Format, name, inputs, layer.Scaling, layer.Eps, layer.Biases));
+			break;
+		case LayerTypes::LocalResponseNorm:
+			model.Layers.push_back(std::make_unique<LocalResponseNorm>(model.Device, model.Format, name, inputs, layer.AcrossChannels, layer.LocalSize, layer.Alpha, layer.Beta, layer.K));
+			break;
+		case LayerTypes::LogSoftmax:
+			model.Layers.push_back(std::make_unique<LogSoftmax>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::Max:
+			model.Layers.push_back(std::make_unique<Max>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::MaxPooling:
+			model.Layers.push_back(std::make_unique<MaxPooling>(model.Device, model.Format, name, inputs, layer.KernelH, layer.KernelW, layer.StrideH, layer.StrideW, layer.DilationH, layer.DilationW, layer.PadH, layer.PadW));
+			break;
+		case LayerTypes::Min:
+			model.Layers.push_back(std::make_unique<Min>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::Multiply:
+			model.Layers.push_back(std::make_unique<Multiply>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::PartialDepthwiseConvolution:
+			model.Layers.push_back(std::make_unique<PartialDepthwiseConvolution>(model.Device, model.Format, name, inputs, layer.Group, layer.Groups, layer.KernelH, layer.KernelW, layer.StrideH, layer.StrideW, layer.DilationH, layer.DilationW, layer.PadH, layer.PadW, layer.Multiplier, layer.Biases));
+			break;
+		case LayerTypes::PRelu:
+			model.Layers.push_back(std::make_unique<PRelu>(model.Device, model.Format, name, inputs, layer.Alpha));
+			break;
+		case LayerTypes::Resampling:
+			model.Layers.push_back(std::make_unique<Resampling>(model.Device, model.Format, name, inputs, layer.Algorithm, layer.FactorH, layer.FactorW));
+			break;
+		case LayerTypes::Shuffle:
+			model.Layers.push_back(std::make_unique<Shuffle>(model.Device, model.Format, name, inputs, layer.Groups));
+			break;
+		case LayerTypes::Softmax:
+			model.Layers.push_back(std::make_unique<Softmax>(model.Device, model.Format, name, inputs));
+			break;
+		case LayerTypes::Substract:
+			model.Layers.push_back(std::make_unique<Substract>(model.Device, model.Format, name, inputs));
+			break;
+		}
+
+		switch (layer.Type)
+		{
+		case LayerTypes::BatchNorm:
+		case LayerTypes::BatchNormActivation:
+		case LayerTypes::BatchNormActivationDropout:
+		case LayerTypes::BatchNormRelu:
+		case LayerTypes::Convolution:
+		case LayerTypes::ConvolutionTranspose:
+		case LayerTypes::Dense:
+		case LayerTypes::DepthwiseConvolution:
+		case LayerTypes::LayerNorm:
+		case LayerTypes::PartialDepthwiseConvolution:
+		case LayerTypes::PRelu:
+			model.Layers.back()->SetParameters(layer.UseDefaultParams, layer.WeightsFiller, layer.WeightsFillerMode, layer.WeightsGain, layer.WeightsScale, layer.WeightsLRM, layer.WeightsWDM, layer.BiasesFiller, layer.BiasesFillerMode, layer.BiasesGain, layer.BiasesScale, layer.BiasesLRM, layer.BiasesWDM);
+			break;
+		default:
+			break;
+		}
 	}
 
-	Model* Parse(const std::string& definition, CheckMsg& msg, const bool onlyCheck = false, Dataprovider* dataprovider = nullptr)
+	// Normalized definitions, check outcomes and compiled definitions keyed by the hash of the definition text, checking an
+	// unchanged definition again (DNNCheck while it is edited) skips the normalization and the check, reading one that was
+	// read before builds its model from the compiled layers without parsing. With a storage directory the compiled
+	// definitions are also kept on disk (definitions/compiled), so a model opened again in another process skips parsing too.
+	class DefinitionCache
+	{
+	public:
+		struct Entry
+		{
+			std::string Source;
+			std::string Normalized;
+			bool Checked;
+			CheckMsg Msg;
+			std::shared_ptr<const CompiledDefinition> Compiled;
+		};
+
+		static bool Find(const std::string& definition, Entry& entry)
+		{
+			std::lock_guard<std::mutex> lock(Mutex());
+
+			const auto it = Entries().find(std::hash<std::string>()(definition));
+			if (it == Entries().end() || it->second.Source != definition)
+				return false;
+
+			entry = it->second;
+
+			return true;
+		}
+
+		static void Store(const Entry& entry)
+		{
+			std::lock_guard<std::mutex> lock(Mutex());
+
+			if (Entries().size() >= Capacity)
+				Entries().clear();
+
+			Entries()[std::hash<std::string>()(entry.Source)] = entry;
+		}
+
+		// the compiled definition stored by Save for exactly this definition text
+		static bool Load(const std::filesystem::path& directory, const std::string& definition, Entry& entry)
+		{
+			auto file = std::ifstream(FileName(directory, definition), std::ios::in | std::ios::binary);
+			if (!file.is_open())
+				return false;
+
+			auto archive = DefinitionArchive(file);
+			auto version = UInt(0);
+			auto loaded = Entry{ std::string(), std::string(), false, CheckMsg(), nullptr };
+
+			archive(version);
+			if (!archive.Good() || version != Version)
+				return false;
+
+			archive(loaded.Source);
+			if (!archive.Good() || loaded.Source != definition)
+				return false;
+
+			auto compiled = std::make_shared<CompiledDefinition>();
+			archive(loaded.Normalized);
+			if (!archive.Good() || !compiled->Serialize(archive) || compiled->Layers.empty())
+				return false;
+
+			loaded.Compiled = compiled;
+			entry = loaded;
+
+			return true;
+		}
+
+		// written to a temporary file first, a process reading it at the same time never sees half of it
+		static void Save(const std::filesystem::path& directory, const Entry& entry)
+		{
+			if (!entry.Compiled)
+				return;
+
+			auto error = std::error_code();
+			const auto fileName = FileName(directory, entry.Source);
+			std::filesystem::create_directories(fileName.parent_path(), error);
+			if (error)
+				return;
+
+			auto temporary = fileName;
+			temporary += ".tmp";
+			{
+				auto file = std::ofstream(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+				if (!file.is_open())
+					return;
+
+				auto archive = DefinitionArchive(file);
+				auto version = Version;
+				auto source = entry.Source;
+				auto normalized = entry.Normalized;
+				auto compiled = *entry.Compiled;
+
+				archive(version, source, normalized);
+				if (!compiled.Serialize(archive))
+				{
+					file.close();
+					std::filesystem::remove(temporary, error);
+					return;
+				}
+			}
+
+			std::filesystem::rename(temporary, fileName, error);
+			if (error)
+				std::filesystem::remove(temporary, error);
+		}
+
+	private:
+		static constexpr UInt Capacity = 32ull;
+		static constexpr UInt Version = 1ull;	// raise it when LayerRecord or CompiledDefinition change
+
+		// FNV-1a, std::hash may differ between builds and the files outlive them
+		static std::filesystem::path FileName(const std::filesystem::path& directory, const std::string& definition)
+		{
+			auto hash = 14695981039346656037ull;
+			for (const auto c : definition)
+				hash = (hash ^ uint64_t(static_cast<unsigned char>(c))) * 1099511628211ull;
+
+			auto name = std::stringstream();
+			name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+
+			return directory / "definitions" / "compiled" / name.str();
+		}
+
+		static std::mutex& Mutex()
+		{
+			static std::mutex mutex;
+			return mutex;
+		}
+
+		static std::unordered_map<size_t, Entry>& Entries()
+		{
+			static std::unordered_map<size_t, Entry> entries;
+			return entries;
+		}
+	};
+
+	Model* Parse(const std::string& definition, CheckMsg& msg, const bool onlyCheck = false, Dataprovider* dataprovider = nullptr, CompiledDefinition* compiled = nullptr)
 	{
 		auto userLocale = std::setlocale(LC_ALL, "C");
 
@@ -187,9 +784,69 @@ namespace dnn
 		auto depthDrop = Float(0);
 		auto fixedDepthDrop = false;
 
+		const auto record = [&](const std::string& name)
+		{
+			auto layer = LayerRecord();
+
+			layer.Type = layerType;
+			layer.Name = name;
+			layer.Inputs = inputsStr;
+			layer.C = c;
+			layer.D = d;
+			layer.H = h;
+			layer.W = w;
+			layer.ActivationFunction = activationFunction;
+			layer.Alpha = alpha;
+			layer.Beta = beta;
+			layer.KernelH = kernelH;
+			layer.KernelW = kernelW;
+			layer.StrideH = strideH;
+			layer.StrideW = strideW;
+			layer.DilationH = dilationH;
+			layer.DilationW = dilationW;
+			layer.PadH = padH;
+			layer.PadW = padW;
+			layer.Scaling = scaling;
+			layer.Momentum = momentum;
+			layer.Eps = layerType == LayerTypes::Cost && !epsSpecified ? Float(0) : eps;
+			layer.Biases = biases;
+			layer.Dropout = dropout;
+			layer.Group = group;
+			layer.Groups = groups;
+			layer.Multiplier = multiplier;
+			layer.CostFunction = costFunction;
+			layer.GroupIndex = groupIndex;
+			layer.LabelIndex = labelIndex;
+			layer.LabelTrue = labelTrue;
+			layer.LabelFalse = labelFalse;
+			layer.Weight = weight;
+			layer.AcrossChannels = acrossChannels;
+			layer.LocalSize = localSize;
+			layer.K = k;
+			layer.Algorithm = algorithm;
+			layer.FactorH = factorH;
+			layer.FactorW = factorW;
+			layer.UseDefaultParams = useDefaultParams;
+			layer.WeightsFiller = weightsFiller;
+			layer.WeightsFillerMode = weightsFillerMode;
+			layer.WeightsGain = weightsGain;
+			layer.WeightsScale = weightsScale;
+			layer.WeightsLRM = weightsLRM;
+			layer.WeightsWDM = weightsWDM;
+			layer.BiasesFiller = biasesFiller;
+			layer.BiasesFillerMode = biasesFillerMode;
+			layer.BiasesGain = biasesGain;
+			layer.BiasesScale = biasesScale;
+			layer.BiasesLRM = biasesLRM;
+			layer.BiasesWDM = biasesWDM;
+
+			return layer;
+		};
+
 		auto iss = std::istringstream(definition);
 		std::string strLine = "", modelName = "", layerName = "", params = "";
 		auto layerNames = std::vector<std::pair<std::string, UInt>>();
+		auto layerLines = std::unordered_map<std::string, UInt>();
 		UInt line = 0, col = 0, modelMandatory = 0, layerMandatory = 0;
 		auto isModel = true;
 			
@@ -230,6 +887,7 @@ namespace dnn
 						model = new Model(definition, dataprovider);
 							
 						layerNames.push_back(std::make_pair("Input", line));
+						layerLines["Input"] = line;
 					}
 					else
 					{
@@ -261,22 +919,26 @@ namespace dnn
 						model->DepthDrop = depthDrop;
 						model->FixedDepthDrop = fixedDepthDrop;
 
-						model->Layers.push_back(std::make_unique<Input>(model->Device, model->Format, "Input", c, model->RandomCrop ? d : d + padD, model->RandomCrop ? h : h + padH, model->RandomCrop ? w : w + padW));
+						auto input = record("Input");
+						input.Type = LayerTypes::Input;
+						input.Inputs.clear();
+						input.D = model->RandomCrop ? d : d + padD;
+						input.H = model->RandomCrop ? h : h + padH;
+						input.W = model->RandomCrop ? w : w + padW;
+						CreateLayer(*model, input);
+						if (compiled)
+							compiled->Layers.push_back(input);
 
 						isModel = false;
 
-						auto exists = false;
-						for (auto layer : layerNames)
-							if (layer.first == layerName)
-								exists = true;
-
-						if (exists)
+						if (layerLines.count(layerName) > 0)
 						{
 							msg = CheckMsg(line, col, "Name already in use, must be unique.");
 							goto FAIL;
 						}
 
 						layerNames.push_back(std::make_pair(layerName, line));
+						layerLines[layerName] = line;
 					}
 				}
 				else
@@ -287,18 +949,14 @@ namespace dnn
 						goto FAIL;
 					}
 
-					auto exists = false;
-					for (auto layer : layerNames)
-						if (layer.first == layerName)
-							exists = true;
-
-					if (exists)
+					if (layerLines.count(layerName) > 0)
 					{
 						msg = CheckMsg(line, col, "Layer name already in use, must be unique.");
 						goto FAIL;
 					}
 
 					layerNames.push_back(std::make_pair(layerName, line));
+					layerLines[layerName] = line;
 
 					layerMandatory = 0;
 
@@ -472,122 +1130,12 @@ namespace dnn
 
 					try
 					{
-						switch (layerType)
+						if (layerType != LayerTypes::Input)
 						{
-						case LayerTypes::Input:
-							break;
-						case LayerTypes::Activation:
-							model->Layers.push_back(std::make_unique<Activation>(model->Device, model->Format, name, activationFunction, inputs, alpha, beta));
-							break;
-						case LayerTypes::Add:
-							model->Layers.push_back(std::make_unique<Add>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::Average:
-							model->Layers.push_back(std::make_unique<Average>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::AvgPooling:
-							model->Layers.push_back(std::make_unique<AvgPooling>(model->Device, model->Format, name, inputs, kernelH, kernelW, strideH, strideW, dilationH, dilationW, padH, padW));
-							break;
-						case LayerTypes::BatchNorm:
-							model->Layers.push_back(std::make_unique<BatchNorm>(model->Device, model->Format, name, inputs, scaling, momentum, eps, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::BatchNormActivation:
-							model->Layers.push_back(std::make_unique<BatchNormActivation>(model->Device, model->Format, name, activationFunction, inputs, scaling, alpha, beta, momentum, eps, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::BatchNormActivationDropout:
-							model->Layers.push_back(std::make_unique<BatchNormActivationDropout>(model->Device, model->Format, name, activationFunction, inputs, dropout, dropout != model->Dropout, scaling, alpha, beta, momentum, eps, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::BatchNormRelu:
-							model->Layers.push_back(std::make_unique<BatchNormRelu>(model->Device, model->Format, name, inputs, scaling, momentum, eps, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::ChannelSplit:
-							model->Layers.push_back(std::make_unique<ChannelSplit>(model->Device, model->Format, name, inputs, group, groups));
-							break;
-						case LayerTypes::ChannelZeroPad:
-							model->Layers.push_back(std::make_unique<ChannelZeroPad>(model->Device, model->Format, name, inputs, c));
-							break;
-						case LayerTypes::Concat:
-							model->Layers.push_back(std::make_unique<Concat>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::Convolution:
-							model->Layers.push_back(std::make_unique<Convolution>(model->Device, model->Format, name, inputs, c, kernelH, kernelW, strideH, strideW, dilationH, dilationW, padH, padW, groups, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::ConvolutionTranspose:
-							model->Layers.push_back(std::make_unique<ConvolutionTranspose>(model->Device, model->Format, name, inputs, c, kernelH, kernelW, strideH, strideW, dilationH, dilationW, padH, padW, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::Cost:
-							model->Layers.push_back(std::make_unique<Cost>(model->Device, model->Format, name, costFunction, groupIndex, labelIndex, c, inputs, labelTrue, labelFalse, weight, epsSpecified ? eps : Float(0)));
-							model->CostLayers.push_back(dynamic_cast<Cost*>(model->Layers[model->Layers.size() - 1].get()));
-							model->CostFuction = costFunction;
-							break;
-						case LayerTypes::Dense:
-							model->Layers.push_back(std::make_unique<Dense>(model->Device, model->Format, name, c, inputs, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::DepthwiseConvolution:
-							model->Layers.push_back(std::make_unique<DepthwiseConvolution>(model->Device, model->Format, name, inputs, kernelH, kernelW, strideH, strideW, dilationH, dilationW, padH, padW, multiplier, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::Divide:
-							model->Layers.push_back(std::make_unique<Divide>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::Dropout:
-							model->Layers.push_back(std::make_unique<Dropout>(model->Device, model->Format, name, inputs, dropout, dropout != model->Dropout));
-							break;
-						case LayerTypes::GlobalAvgPooling:
-							model->Layers.push_back(std::make_unique<GlobalAvgPooling>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::GlobalMaxPooling:
-							model->Layers.push_back(std::make_unique<GlobalMaxPooling>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::LayerNorm:
-							model->Layers.push_back(std::make_unique<LayerNorm>(model->Device, model->Format, name, inputs, scaling, eps, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::LocalResponseNorm:
-							model->Layers.push_back(std::make_unique<LocalResponseNorm>(model->Device, model->Format, name, inputs, acrossChannels, localSize, alpha, beta, k));
-							break;
-						case LayerTypes::LogSoftmax:
-							model->Layers.push_back(std::make_unique<LogSoftmax>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::Max:
-							model->Layers.push_back(std::make_unique<Max>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::MaxPooling:
-							model->Layers.push_back(std::make_unique<MaxPooling>(model->Device, model->Format, name, inputs, kernelH, kernelW, strideH, strideW, dilationH, dilationW, padH, padW));
-							break;
-						case LayerTypes::Min:
-							model->Layers.push_back(std::make_unique<Min>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::Multiply:
-							model->Layers.push_back(std::make_unique<Multiply>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::PartialDepthwiseConvolution:
-							model->Layers.push_back(std::make_unique<PartialDepthwiseConvolution>(model->Device, model->Format, name, inputs, group, groups, kernelH, kernelW, strideH, strideW, dilationH, dilationW, padH, padW, multiplier, biases));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::PRelu:
-							model->Layers.push_back(std::make_unique<PRelu>(model->Device, model->Format, name, inputs, alpha));
-							model->Layers[model->Layers.size() - 1]->SetParameters(useDefaultParams, weightsFiller, weightsFillerMode, weightsGain, weightsScale, weightsLRM, weightsWDM, biasesFiller, biasesFillerMode, biasesGain, biasesScale, biasesLRM, biasesWDM);
-							break;
-						case LayerTypes::Resampling:
-							model->Layers.push_back(std::make_unique<Resampling>(model->Device, model->Format, name, inputs, algorithm, factorH, factorW));
-							break;
-						case LayerTypes::Shuffle:
-							model->Layers.push_back(std::make_unique<Shuffle>(model->Device, model->Format, name, inputs, groups));
-							break;
-						case LayerTypes::Softmax:
-							model->Layers.push_back(std::make_unique<Softmax>(model->Device, model->Format, name, inputs));
-							break;
-						case LayerTypes::Substract:
-							model->Layers.push_back(std::make_unique<Substract>(model->Device, model->Format, name, inputs));
-							break;
+							const auto layer = record(name);
+							CreateLayer(*model, layer);
+							if (compiled)
+								compiled->Layers.push_back(layer);
 						}
 					}
 					catch (std::exception exception)
@@ -1020,11 +1568,7 @@ namespace dnn
 
 				for (auto input : inputsStr)
 				{
-					auto ok = false;
-					for (auto name : layerNames)
-						if (name.first.compare(input) == 0)
-							ok = true;
-					if (!ok)
+					if (layerLines.count(input) == 0)
 					{
 						msg = CheckMsg(line, col, "Inputs " + input + " doesn't exists.");
 						goto FAIL;
@@ -2512,9 +3056,10 @@ namespace dnn
 				goto FAIL;
 			}
 
-			model->Layers.push_back(std::make_unique<Cost>(model->Device, model->Format, layerNames[model->Layers.size()].first, costFunction, groupIndex, labelIndex, c, model->GetLayerInputs(inputsStr), labelTrue, labelFalse, weight, epsSpecified ? eps : Float(0)));
-			model->CostLayers.push_back(dynamic_cast<Cost*>(model->Layers[model->Layers.size() - 1].get()));
-			model->CostFuction = costFunction;
+			const auto layer = record(layerNames[model->Layers.size()].first);
+			CreateLayer(*model, layer);
+			if (compiled)
+				compiled->Layers.push_back(layer);
 		}
 
 		{
@@ -2523,9 +3068,8 @@ namespace dnn
 			if (unreferencedLayers.size() > 0)
 			{
 				auto l = unreferencedLayers[0];
-				for (auto t : layerNames)
-					if (t.first == l->Name)
-						line = t.second;
+				if (layerLines.count(l->Name) > 0)
+					line = layerLines[l->Name];
 
 				msg = CheckMsg(line, col, "Layer " + l->Name + " never referenced.");
 				goto FAIL;
@@ -2547,9 +3091,8 @@ namespace dnn
 		for (auto l : model->CostLayers)
 			if (model->GetLayerOutputs(l).size() > 0)
 			{
-				for (auto t : layerNames)
-					if (t.first == l->Name)
-						line = t.second;
+				if (layerLines.count(l->Name) > 0)
+					line = layerLines[l->Name];
 
 				msg = CheckMsg(line, col, "Cost Layer " + l->Name + " is referenced.");
 				goto FAIL;
@@ -2566,6 +3109,9 @@ namespace dnn
         // check model definition is a welformed Directed Acyclic Graph
         // check parameters
            
+		if (compiled)
+			compiled->Capture(*model);
+
 		if (onlyCheck)
 		{
 			if (model != nullptr)
@@ -2575,7 +3121,10 @@ namespace dnn
 			}
 		}
 		else
+		{
+			model->NegotiateFormats();
 			model->ResetWeights();
+		}
 			
 		std::setlocale(LC_ALL, userLocale);
             
@@ -2597,21 +3146,107 @@ namespace dnn
 
 	bool Check(std::string& definition, CheckMsg& checkMsg)
 	{
-		definition = NormalizeDefinition(definition);
+		auto entry = DefinitionCache::Entry();
+		if (DefinitionCache::Find(definition, entry) && entry.Checked)
+		{
+			definition = entry.Normalized;
+			checkMsg = entry.Msg;
+
+			return checkMsg.Error;
+		}
+
+		entry = DefinitionCache::Entry{ definition, NormalizeDefinition(definition), true, CheckMsg() };
+		definition = entry.Normalized;
 
 		Parse(definition, checkMsg, true);
 
+		entry.Msg = checkMsg;
+		DefinitionCache::Store(entry);
+
 		return checkMsg.Error;
 	}
 
-	Model* Read(const std::string& definition, Dataprovider* dataprovider, CheckMsg& checkMsg)
+	// the model of a definition that parsed before: the layers are created from their records and only the relations,
+	// formats and weights are set up again. The layers of a forward-only model never allocate their gradients.
+	Model* Build(const CompiledDefinition& compiled, const std::string& definition, Dataprovider* dataprovider, CheckMsg& checkMsg, const bool forwardOnly = false)
 	{
-		Model* model = Parse(NormalizeDefinition(definition), checkMsg, false, dataprovider);
+		auto model = std::make_unique<Model>(definition, dataprovider);
+		compiled.Apply(*model);
 
-		if (checkMsg.Error)
+		for (const auto& layer : compiled.Layers)
 		{
+			try
+			{
+				CreateLayer(*model, layer);
+			}
+			catch (std::exception exception)
+			{
+				checkMsg = CheckMsg(0, 0, "Exception occured when creating layer " + layer.Name + nwl + nwl + exception.what());
+				return nullptr;
+			}
+		}
+
+		model->SetRelations();
+		model->CostIndex = model->CostLayers.size() - 1ull;
+		model->GroupIndex = model->CostLayers[model->CostIndex]->GroupIndex;
+		model->LabelIndex = model->CostLayers[model->CostIndex]->LabelIndex;
+
+		for (auto& layer : model->Layers)
+			layer->ForwardOnly = forwardOnly;
+
+		model->NegotiateFormats();
+		model->ResetWeights();
 
+		checkMsg = CheckMsg(0, 0, "No issues found", false);
+
+		return model.release();
+	}
+
+	Model* Read(const std::string& definition, Dataprovider* dataprovider, CheckMsg& checkMsg, const bool forwardOnly = false)
+	{
+		auto entry = DefinitionCache::Entry();
+		if (DefinitionCache::Find(definition, entry))
+		{
+			if (entry.Checked && entry.Msg.Error)
+			{
+				checkMsg = entry.Msg;
+				return nullptr;
+			}
+
+			if (entry.Compiled)
+				return Build(*entry.Compiled, entry.Normalized, dataprovider, checkMsg, forwardOnly);
 		}
+
+		// compiled by an earlier process
+		if (dataprovider && DefinitionCache::Load(dataprovider->StorageDirectory, definition, entry))
+		{
+			DefinitionCache::Store(entry);
+
+			return Build(*entry.Compiled, entry.Normalized, dataprovider, checkMsg, forwardOnly);
+		}
+
+		if (entry.Source.empty())
+			entry = DefinitionCache::Entry{ definition, NormalizeDefinition(definition), false, CheckMsg() };
+
+		auto compiled = std::make_shared<CompiledDefinition>();
+
+		// a forward-only model is checked and then built, a parsed model already holds the gradients of its layers
+		Model* model = Parse(entry.Normalized, checkMsg, forwardOnly, dataprovider, compiled.get());
+		if (checkMsg.Error)
+			return nullptr;
+
+		entry.Compiled = compiled;
+		if (forwardOnly)
+		{
+			entry.Checked = true;
+			entry.Msg = checkMsg;
+		}
+		DefinitionCache::Store(entry);
+		if (dataprovider)
+			DefinitionCache::Save(dataprovider->StorageDirectory, entry);
+
+		if (forwardOnly)
+			model = Build(*compiled, entry.Normalized, dataprovider, checkMsg, true);
 			
 		return model;
 	}
@@ -56,6 +56,21 @@ namespace dnn
 			return CDHW();
 		}
 
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdSrc) + UInt(reorderBwdDiffSrc) + UInt(reorderBwdWeights) + UInt(reorderBwdDiffWeights);
+		}
+
+		bool BackwardReadsNeurons() const final override
+		{
+			return false;
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			std::vector<dnnl::memory::desc> memDesc;
@@ -87,17 +102,7 @@ namespace dnn
 			bwdDataDesc = std::make_unique<dnnl::inner_product_backward_data::primitive_desc>(dnnl::inner_product_backward_data::primitive_desc(Device.engine, memDesc[0], memDesc[2], memDesc[1], *fwdDesc));
 
 			if (*WeightsMemDesc != fwdDesc->weights_desc())
-			{
-				auto weights = FloatVector(fwdDesc->weights_desc().get_size() / sizeof(Float), Float(0));
-				auto memWeights = dnnl::memory(*WeightsMemDesc, Device.engine, Weights.data());
-				auto weightsMem = dnnl::memory(fwdDesc->weights_desc(), Device.engine, weights.data());
-
-				dnnl::reorder(memWeights, weightsMem).execute(Device.stream, std::unordered_map<int, dnnl::memory>{ {DNNL_ARG_FROM, memWeights}, { DNNL_ARG_TO, weightsMem } });
-				Device.stream.wait();
-
-				Weights = weights;
-				WeightsMemDesc = std::make_unique<dnnl::memory::desc>(fwdDesc->weights_desc());
-			}
+				ReorderWeights(fwdDesc->weights_desc());
 
 			DstMemDesc = std::make_unique<dnnl::memory::desc>(fwdDesc->dst_desc());
 			DiffDstMemDesc = std::make_unique<dnnl::memory::desc>(fwdDesc->dst_desc());
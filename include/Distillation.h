@@ -0,0 +1,127 @@
+#pragma once
+#include "InferenceSession.h"
+
+namespace dnn
+{
+	// Knowledge distillation: a teacher trained with this library runs forward-only in an InferenceSession (one planned arena,
+	// no gradients, fused epilogues) on the augmented input of every training batch of the student, while the student runs
+	// its own forward pass. The last output of the teacher becomes the Targets of the KullbackLeibler cost layers.
+	// The teacher is owned by Model::Teacher and goes away with the student or with Detach.
+	class Distillation
+	{
+	private:
+		Model& student;
+		std::unique_ptr<InferenceSession> session;
+		std::vector<Cost*> costs;
+		std::vector<Float> outputs;
+		UInt outputOffset;			// the last output of the teacher in outputs, per sample
+		LayerTypes outputType;
+
+		Distillation(Model& model, std::unique_ptr<InferenceSession> teacher) :
+			student(model),
+			session(std::move(teacher)),
+			costs(std::vector<Cost*>()),
+			outputs(std::vector<Float>()),
+			outputOffset(0),
+			outputType(LayerTypes::Softmax)
+		{
+			for (const auto cost : student.CostLayers)
+				if (cost->CostFunction == Costs::KullbackLeibler)
+					costs.push_back(cost);
+
+			const auto last = session->GetOutputCount() - 1ull;
+			outputOffset = session->GetOutputsSize() - session->GetOutputSize(last);
+			outputType = session->GetOutputType(last);
+		}
+
+		// the class probabilities of the teacher for the first batchSize samples of the input layer of the student
+		void Forward(const UInt batchSize)
+		{
+			if (batchSize > session->GetBatchSize())
+				session->SetBatchSize(batchSize);
+
+			const auto size = session->GetOutputsSize();
+			const auto C = costs.front()->C;
+			if (outputs.size() < batchSize * size)
+				outputs.resize(batchSize * size);
+
+			session->Run(student.Layers[0]->Neurons.data(), batchSize, outputs.data());
+
+			// Run writes every output as batchSize x CDHW in turn, the last one starts at batchSize * outputOffset
+			const auto probabilities = outputs.data() + batchSize * outputOffset;
+
+			for_i(batchSize, [&](const UInt n)
+			{
+				const auto sample = probabilities + n * C;
+
+				if (outputType == LayerTypes::LogSoftmax)
+					for (auto c = 0ull; c < C; c++)
+						sample[c] = std::exp(sample[c]);
+				else if (outputType != LayerTypes::Softmax)
+				{
+					const auto maxValue = *std::max_element(sample, sample + C);
+					auto sum = Float(0);
+					for (auto c = 0ull; c < C; c++)
+					{
+						sample[c] = std::exp(sample[c] - maxValue);
+						sum += sample[c];
+					}
+					for (auto c = 0ull; c < C; c++)
+						sample[c] /= sum;
+				}
+			});
+
+			for (const auto cost : costs)
+			{
+				cost->Targets.resize(batchSize * C);
+				std::copy(probabilities, probabilities + batchSize * C, cost->Targets.begin());
+			}
+		}
+
+	public:
+		// the teacher must take the input of the student and its last output must have the classes of the KullbackLeibler cost layers
+		static bool Attach(Model& student, const std::string& definition, const std::string& weightsFileName, CheckMsg& msg)
+		{
+			auto hasTarget = false;
+			for (const auto cost : student.CostLayers)
+				hasTarget |= cost->CostFunction == Costs::KullbackLeibler;
+
+			if (!hasTarget)
+			{
+				msg = CheckMsg(0, 0, "The student has no KullbackLeibler cost layer", true);
+				return false;
+			}
+
+			auto teacher = InferenceSession::Create(definition, weightsFileName, std::max<UInt>(student.BatchSize, 1ull), nullptr, false, msg);
+			if (!teacher)
+				return false;
+
+			if (teacher->GetInputSize() != student.Layers[0]->CDHW())
+			{
+				msg = CheckMsg(0, 0, "The input of the teacher doesn't match the input of the student", true);
+				return false;
+			}
+
+			for (const auto cost : student.CostLayers)
+				if (cost->CostFunction == Costs::KullbackLeibler && teacher->GetOutputSize(teacher->GetOutputCount() - 1ull) != cost->C)
+				{
+					msg = CheckMsg(0, 0, "The output of the teacher doesn't match the cost layer " + cost->Name, true);
+					return false;
+				}
+
+			const auto distillation = std::shared_ptr<Distillation>(new Distillation(student, std::move(teacher)));
+			student.Teacher = [distillation](const UInt batchSize) { return std::async(std::launch::async, [distillation, batchSize] { distillation->Forward(batchSize); }); };
+
+			return true;
+		}
+
+		// the KullbackLeibler cost layers fall back to the hard labels
+		static void Detach(Model& student)
+		{
+			student.Teacher = nullptr;
+
+			for (const auto cost : student.CostLayers)
+				cost->Targets = std::vector<Float>();
+		}
+	};
+}
@@ -9,14 +9,16 @@ namespace dnn
 		const bool LocalValue;
 		Float Keep;
 		Float Scale;
-		FloatArray NeuronsActive;
+		UInt Seed;	// keys the counter-based mask generator (see SetStep)
+		UInt Step;	// training step, the forward and the backward pass of a step see the same mask
 
 		Dropout(const dnn::Device& device, const dnnl::memory::format_tag format, const std::string& name, const std::vector<Layer*>& inputs, const Float dropout = Float(0.5), const bool localValue = false) :
 			Layer(device, format, name, LayerTypes::Dropout, 0, 0, inputs[0]->C, inputs[0]->D, inputs[0]->H, inputs[0]->W, 0, 0, 0, inputs, false, false, dropout > 0),
 			LocalValue(localValue),
 			Keep(Float(1) - dropout),
 			Scale(Float(1) / (Float(1) - dropout)),
-			NeuronsActive(FloatArray())
+			Seed(std::hash<std::string>()(name)),
+			Step(0)
 		{
 			assert(Inputs.size() == 1);
 		}
@@ -37,6 +39,13 @@ namespace dnn
 			}
 		}
 
+		// the mask of an element only depends on (seed, step, layer, element index), so it is regenerated in the backward pass instead of stored
+		void SetStep(const UInt seed, const UInt step)
+		{
+			Seed = seed ^ std::hash<std::string>()(Name);
+			Step = step;
+		}
+
 		std::string GetDescription() const final override
 		{
 			auto description = GetDescriptionHeader();
@@ -67,21 +76,6 @@ namespace dnn
 			DiffDstMemDesc = std::make_unique<dnnl::memory::desc>(*InputLayer->DiffDstMemDesc);
 		}
 
-		void SetBatchSize(const UInt batchSize) final override
-		{
-			Layer::SetBatchSize(batchSize);
-
-			if (Enabled)
-			{
-				NeuronsActive.resize(batchSize, C, H, W, dnnl::memory::data_type::f32, BlockedFmt, Device.engine);
-				for (auto n = 0ull; n < batchSize; n++)
-					for (auto i = 0ull; i < CDHW(); i++)
-						NeuronsActive[n * PaddedCDHW() + i] = Float(1);
-			}
-			else
-				NeuronsActive.release();
-		}
-
 		void ForwardProp(const UInt batchSize, const bool training) final override
 		{
 			const auto size = IsPlainFormat() ? CDHW() : PaddedCDHW();
@@ -97,8 +91,7 @@ namespace dnn
 					VecFloat mask;
 					for (auto i = 0ull; i < part; i += VectorSize)
 					{
-						mask = BernoulliVecFloat(Keep);
-						mask.store_a(&NeuronsActive[i]);
+						mask = DropoutMaskVec(i, Step, Seed, Keep);
 						(mask * Scale * VecFloat().load_a(&InputLayer->Neurons[i])).store_a(&Neurons[i]);
 #ifndef DNN_LEAN
 						VecFloat(0).store_nt(&NeuronsD1[i]);
@@ -106,8 +99,7 @@ namespace dnn
 					}
 					for (auto i = part; i < size; i++)
 					{
-						NeuronsActive[i] = Bernoulli<Float>(Keep);
-						Neurons[i] = NeuronsActive[i] * Scale * InputLayer->Neurons[i];
+						Neurons[i] = DropoutMask(i, Step, Seed, Keep) * Scale * InputLayer->Neurons[i];
 #ifndef DNN_LEAN
 						NeuronsD1[i] = Float(0);
 #endif
@@ -122,8 +114,7 @@ namespace dnn
 						VecFloat mask;
 						for (auto i = start; i < end; i += VectorSize)
 						{
-							mask = BernoulliVecFloat(Keep);
-							mask.store_a(&NeuronsActive[i]);
+							mask = DropoutMaskVec(i, Step, Seed, Keep);
 							(mask * Scale * VecFloat().load_a(&InputLayer->Neurons[i])).store_a(&Neurons[i]);
 #ifndef DNN_LEAN
 							VecFloat(0).store_nt(&NeuronsD1[i]);
@@ -131,8 +122,7 @@ namespace dnn
 						}
 						for (auto i = end; i < start + size; i++)
 						{
-							NeuronsActive[i] = Bernoulli<Float>(Keep);
-							Neurons[i] = NeuronsActive[i] * Scale * InputLayer->Neurons[i];
+							Neurons[i] = DropoutMask(i, Step, Seed, Keep) * Scale * InputLayer->Neurons[i];
 #ifndef DNN_LEAN
 							NeuronsD1[i] = Float(0);
 #endif
@@ -179,9 +169,9 @@ namespace dnn
 				if (batchSize == 1)
 				{
 					for (auto i = 0ull; i < part; i += VectorSize)
-						mul_add(VecFloat().load_a(&NeuronsActive[i]), VecFloat().load_a(&NeuronsD1[i]), VecFloat().load_a(&InputLayer->NeuronsD1[i])).store_a(&InputLayer->NeuronsD1[i]);
+						mul_add(DropoutMaskVec(i, Step, Seed, Keep), VecFloat().load_a(&NeuronsD1[i]), VecFloat().load_a(&InputLayer->NeuronsD1[i])).store_a(&InputLayer->NeuronsD1[i]);
 					for (auto i = part; i < size; i++)
-						InputLayer->NeuronsD1[i] += NeuronsActive[i] * NeuronsD1[i];
+						InputLayer->NeuronsD1[i] += DropoutMask(i, Step, Seed, Keep) * NeuronsD1[i];
 				}
 				else
 #endif
@@ -190,9 +180,9 @@ namespace dnn
 						const auto start = b * size;
 						const auto end = start + part;
 						for (auto i = start; i < end; i += VectorSize)
-							mul_add(VecFloat().load_a(&NeuronsActive[i]), VecFloat().load_a(&NeuronsD1[i]), VecFloat().load_a(&InputLayer->NeuronsD1[i])).store_a(&InputLayer->NeuronsD1[i]);
+							mul_add(DropoutMaskVec(i, Step, Seed, Keep), VecFloat().load_a(&NeuronsD1[i]), VecFloat().load_a(&InputLayer->NeuronsD1[i])).store_a(&InputLayer->NeuronsD1[i]);
 						for (auto i = end; i < start + size; i++)
-							InputLayer->NeuronsD1[i] += NeuronsActive[i] * NeuronsD1[i];
+							InputLayer->NeuronsD1[i] += DropoutMask(i, Step, Seed, Keep) * NeuronsD1[i];
 					});
 			}
 			else
@@ -221,10 +211,5 @@ namespace dnn
 			ReleaseGradient();
 #endif // DNN_LEAN
 		}
-
-		UInt GetNeuronsSize(const UInt batchSize) const override
-		{
-			return Layer::GetNeuronsSize(batchSize) + (batchSize * PaddedCDHW());
-		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,174 @@
+#pragma once
+#include "BatchNormActivation.h"
+
+namespace dnn
+{
+	// An Activation or BatchNormActivation behind an Add, Average or Substract in the forward-only memory plan lives in the
+	// Neurons of the merge layer (see MemoryPlanner::Views). The merge layer then applies the folded batch normalization and
+	// the activation while the merged value is still in registers and the epilogue layer skips its own pass.
+	class FusedEpilogue
+	{
+	private:
+		Layer* target;
+		FloatVector scale;
+		FloatVector shift;
+
+		void SetFused(const bool fused)
+		{
+			if (target->LayerType == LayerTypes::Activation)
+				dynamic_cast<Activation*>(target)->FusedWithMerge = fused;
+			else
+				dynamic_cast<BatchNormActivation*>(target)->FusedWithMerge = fused;
+		}
+
+		// inference batch normalization as one multiply-add per channel
+		void Fold()
+		{
+			if (target->LayerType == LayerTypes::Activation)
+				return;
+
+			const auto bn = dynamic_cast<const BatchNormActivation*>(target);
+			for (auto c = 0ull; c < bn->C; c++)
+			{
+				const auto invStdDev = Float(1) / std::sqrt(bn->RunningVariance[c] + bn->Eps);
+				scale[c] = bn->Scaling ? bn->Weights[c] * invStdDev : invStdDev;
+				shift[c] = (bn->Scaling && bn->HasBias ? bn->Biases[c] : Float(0)) - bn->RunningMean[c] * scale[c];
+			}
+		}
+
+	public:
+		FusedEpilogue() :
+			target(nullptr),
+			scale(FloatVector()),
+			shift(FloatVector())
+		{
+		}
+
+		static const Act& GetFunc(const Layer& layer)
+		{
+			return layer.LayerType == LayerTypes::Activation ? dynamic_cast<const Activation&>(layer).Func : dynamic_cast<const BatchNormActivation&>(layer).Func;
+		}
+
+		// activations only computed by oneDNN (Clip, ClipV2, GeluErf, GeluTanh) have no function to apply here
+		static bool CanFuse(const Layer& merge)
+		{
+			if (merge.Outputs.size() != 1ull)
+				return false;
+
+			const auto output = merge.Outputs[0];
+			if (output->LayerType != LayerTypes::Activation && output->LayerType != LayerTypes::BatchNormActivation)
+				return false;
+
+			const auto& func = GetFunc(*output);
+
+			return func.f != nullptr && func.fVec != nullptr && output->Inputs.size() == 1ull && output->Neurons.data() == merge.Neurons.data();
+		}
+
+		auto Enabled() const noexcept
+		{
+			return target != nullptr;
+		}
+
+		void Set(Layer& merge, const bool enable)
+		{
+			Reset();
+
+			if (enable && CanFuse(merge))
+			{
+				target = merge.Outputs[0];
+				scale = FloatVector(target->PaddedC, Float(1));
+				shift = FloatVector(target->PaddedC, Float(0));
+				SetFused(true);
+			}
+		}
+
+		void Reset()
+		{
+			if (target)
+				SetFused(false);
+
+			target = nullptr;
+		}
+
+		// merge(a, b) is called with both Float and VecFloat, input is the full-size input and broadcast the (possibly 1x1) other one
+		template<typename Merge>
+		void ForwardProp(Layer& layer, Layer& input, Layer& broadcast, const UInt batchSize, const Merge& merge)
+		{
+			Fold();
+
+			const auto& func = GetFunc(*target);
+			const auto alpha = target->LayerType == LayerTypes::Activation ? dynamic_cast<const Activation*>(target)->Alpha : dynamic_cast<const BatchNormActivation*>(target)->Alpha;
+			const auto beta = target->LayerType == LayerTypes::Activation ? dynamic_cast<const Activation*>(target)->Beta : dynamic_cast<const BatchNormActivation*>(target)->Beta;
+
+			const auto equal = broadcast.H == layer.H && broadcast.W == layer.W;
+			const auto plain = layer.IsPlainFormat();
+			const auto HW = layer.HW();
+
+			const auto src0 = input.Neurons.data();
+			const auto src1 = broadcast.Neurons.data();
+			const auto dst = layer.Neurons.data();
+
+			if (plain)
+			{
+				const auto C = layer.C;
+				const auto CDHW = layer.CDHW();
+				const auto part = GetVectorPart(HW);
+				const auto threads = std::min<UInt>(GetThreads(batchSize * CDHW, Float(5)), batchSize * C);
+
+				for_i(batchSize * C, threads, [&](UInt nc)
+				{
+					const auto n = nc / C;
+					const auto c = nc % C;
+					const auto start = n * CDHW + c * HW;
+					const auto channelScale = scale[c];
+					const auto channelShift = shift[c];
+
+					if (equal)
+					{
+						for (auto hw = start; hw < start + part; hw += VectorSize)
+							func.fVec(mul_add(merge(VecFloat().load(src0 + hw), VecFloat().load(src1 + hw)), channelScale, channelShift), alpha, beta).store(dst + hw);
+						for (auto hw = start + part; hw < start + HW; hw++)
+							dst[hw] = func.f(merge(src0[hw], src1[hw]) * channelScale + channelShift, alpha, beta);
+					}
+					else
+					{
+						const auto b = src1[n * C + c];
+						for (auto hw = start; hw < start + part; hw += VectorSize)
+							func.fVec(mul_add(merge(VecFloat().load(src0 + hw), VecFloat(b)), channelScale, channelShift), alpha, beta).store(dst + hw);
+						for (auto hw = start + part; hw < start + HW; hw++)
+							dst[hw] = func.f(merge(src0[hw], b) * channelScale + channelShift, alpha, beta);
+					}
+				});
+			}
+			else
+			{
+				const auto PaddedC = layer.PaddedC;
+				const auto PaddedCDHW = layer.PaddedCDHW();
+				const auto blocks = PaddedC / VectorSize;
+				const auto strideHW = HW * VectorSize;
+				const auto threads = std::min<UInt>(GetThreads(batchSize * PaddedCDHW, Float(5)), batchSize * blocks);
+
+				for_i(batchSize * blocks, threads, [&](UInt nc)
+				{
+					const auto n = nc / blocks;
+					const auto c = (nc % blocks) * VectorSize;
+					const auto start = n * PaddedCDHW + c * HW;
+					const auto channelScale = VecFloat().load_a(&scale[c]);
+					const auto channelShift = VecFloat().load_a(&shift[c]);
+
+					if (equal)
+					{
+						for (auto hw = start; hw < start + strideHW; hw += VectorSize)
+							func.fVec(mul_add(merge(VecFloat().load_a(src0 + hw), VecFloat().load_a(src1 + hw)), channelScale, channelShift), alpha, beta).store_a(dst + hw);
+					}
+					else
+					{
+						const auto b = VecFloat().load_a(src1 + n * PaddedC + c);
+						for (auto hw = start; hw < start + strideHW; hw += VectorSize)
+							func.fVec(mul_add(merge(VecFloat().load_a(src0 + hw), b), channelScale, channelShift), alpha, beta).store_a(dst + hw);
+					}
+				});
+			}
+		}
+	};
+}
@@ -0,0 +1,240 @@
+#pragma once
+#include "InferenceSession.h"
+
+namespace dnn
+{
+	// Dynamic batching of concurrent single-sample requests: requests are queued until MaxBatchSize is reached or the
+	// oldest one waited MaxDelay, then run together in the smallest prepared bucket that fits and handed back through futures.
+	// Every bucket has its own session, built and warmed up in the constructor, so no primitive is created on the request path.
+	// The sessions read the weights of the session they're cloned from and the buckets run one after the other, so all of
+	// them place their activations in the arena of the largest one.
+	class InferenceBatcher
+	{
+	private:
+		struct Request
+		{
+			std::vector<Byte> Input;
+			std::promise<std::vector<Float>> Result;
+			std::chrono::steady_clock::time_point Arrival;
+		};
+
+		std::vector<UInt> Buckets;
+		std::vector<std::unique_ptr<InferenceSession>> Sessions;
+		std::deque<Request> Queue;
+		std::mutex QueueLock;
+		std::condition_variable QueueChanged;
+		std::thread Worker;
+		bool Stopping;
+		std::vector<Byte> Input;
+		std::vector<Float> Output;
+		std::vector<UInt> OutputSizes;
+		std::atomic<UInt> RequestCount;
+		std::atomic<UInt> BatchCount;
+
+		void Execute(std::vector<Request>& batch)
+		{
+			const auto count = batch.size();
+			const auto bucket = std::lower_bound(Buckets.begin(), Buckets.end(), count) - Buckets.begin();
+			auto& session = Sessions[bucket];
+
+			for (auto n = 0ull; n < count; n++)
+				std::copy(batch[n].Input.begin(), batch[n].Input.end(), Input.begin() + n * InputSize);
+
+			auto answered = 0ull;
+			try
+			{
+				if (!session->Run(Input.data(), count, Output.data()))
+					throw std::runtime_error("Inference failed");
+
+				for (auto n = 0ull; n < count; n++)
+				{
+					auto result = std::vector<Float>(OutputsSize);
+					auto src = Output.cbegin();
+					auto dst = result.begin();
+					for (const auto size : OutputSizes)
+					{
+						std::copy(src + n * size, src + (n + 1) * size, dst);
+						src += count * size;
+						dst += size;
+					}
+
+					batch[n].Result.set_value(std::move(result));
+					answered++;
+				}
+			}
+			catch (...)
+			{
+				for (auto n = answered; n < count; n++)
+					batch[n].Result.set_exception(std::current_exception());
+			}
+
+			RequestCount += count;
+			BatchCount++;
+		}
+
+		void Run()
+		{
+			auto batch = std::vector<Request>();
+			batch.reserve(MaxBatchSize);
+
+			while (true)
+			{
+				{
+					auto lock = std::unique_lock<std::mutex>(QueueLock);
+
+					QueueChanged.wait(lock, [this]() { return Stopping || !Queue.empty(); });
+					if (Queue.empty())
+						return;
+
+					const auto deadline = Queue.front().Arrival + MaxDelay;
+					QueueChanged.wait_until(lock, deadline, [this]() { return Stopping || Queue.size() >= MaxBatchSize; });
+
+					const auto count = std::min<UInt>(Queue.size(), MaxBatchSize);
+					for (auto i = 0ull; i < count; i++)
+					{
+						batch.push_back(std::move(Queue.front()));
+						Queue.pop_front();
+					}
+				}
+
+				Execute(batch);
+				batch.clear();
+			}
+		}
+
+	public:
+		const UInt MaxBatchSize;
+		const std::chrono::microseconds MaxDelay;
+		const UInt InputSize;
+		const UInt OutputsSize;
+
+		// buckets are the powers of two below maxBatchSize and maxBatchSize itself
+		InferenceBatcher(InferenceSession& session, const UInt maxBatchSize, const std::chrono::microseconds maxDelay) :
+			Buckets(std::vector<UInt>()),
+			Sessions(std::vector<std::unique_ptr<InferenceSession>>()),
+			Queue(std::deque<Request>()),
+			Stopping(false),
+			RequestCount(0),
+			BatchCount(0),
+			MaxBatchSize(std::max<UInt>(maxBatchSize, 1)),
+			MaxDelay(maxDelay),
+			InputSize(session.GetInputSize()),
+			OutputsSize(session.GetOutputsSize())
+		{
+			for (auto bucket = UInt(1); bucket < MaxBatchSize; bucket *= 2)
+				Buckets.push_back(bucket);
+			Buckets.push_back(MaxBatchSize);
+
+			for (const auto bucket : Buckets)
+			{
+				auto clone = session.Clone();
+				if (!clone || !clone->SetBatchSize(bucket))
+					throw std::runtime_error("Could not allocate an inference session for batch size " + std::to_string(bucket));
+
+				Sessions.push_back(std::move(clone));
+			}
+
+			for (auto i = 0ull; i < Sessions.size() - 1ull; i++)
+				if (!Sessions[i]->ShareArena(*Sessions.back()))
+					throw std::runtime_error("Could not share the activations of the inference session for batch size " + std::to_string(Buckets[i]));
+
+			for (auto i = 0ull; i < session.GetOutputCount(); i++)
+				OutputSizes.push_back(session.GetOutputSize(i));
+
+			Input = std::vector<Byte>(MaxBatchSize * InputSize, Byte(0));
+			Output = std::vector<Float>(MaxBatchSize * OutputsSize, Float(0));
+
+			// the first pass creates the primitives
+			const auto warmup = std::vector<Float>(MaxBatchSize * InputSize, Float(0));
+			for (auto i = 0ull; i < Buckets.size(); i++)
+				Sessions[i]->Run(warmup.data(), Buckets[i], Output.data());
+
+			Worker = std::thread(&InferenceBatcher::Run, this);
+		}
+
+		~InferenceBatcher()
+		{
+			{
+				const std::lock_guard<std::mutex> lock(QueueLock);
+				Stopping = true;
+			}
+			QueueChanged.notify_all();
+
+			if (Worker.joinable())
+				Worker.join();
+		}
+
+		// input is one sample of InputSize bytes, the result holds every output layer in turn
+		std::future<std::vector<Float>> Submit(const Byte* input)
+		{
+			auto request = Request();
+			request.Input = std::vector<Byte>(input, input + InputSize);
+			request.Arrival = std::chrono::steady_clock::now();
+
+			auto result = request.Result.get_future();
+			{
+				const std::lock_guard<std::mutex> lock(QueueLock);
+				Queue.push_back(std::move(request));
+			}
+			QueueChanged.notify_one();
+
+			return result;
+		}
+
+		UInt GetRequestCount() const { return RequestCount.load(); }
+		UInt GetBatchCount() const { return BatchCount.load(); }
+
+		// clients submit requestsPerClient requests each, one at a time, and measure the round trip
+		BatcherBenchmarkInfo Benchmark(const UInt clients, const UInt requestsPerClient)
+		{
+			auto latencies = std::vector<std::vector<Float>>(clients);
+			auto threads = std::vector<std::thread>();
+
+			const auto requests = RequestCount.load();
+			const auto batches = BatchCount.load();
+			const auto start = std::chrono::steady_clock::now();
+
+			for (auto c = 0ull; c < clients; c++)
+				threads.push_back(std::thread([&, c]()
+				{
+					auto input = std::vector<Byte>(InputSize);
+					auto engine = std::mt19937(static_cast<unsigned>(c));
+					auto distribution = std::uniform_int_distribution<int>(0, 255);
+
+					latencies[c].reserve(requestsPerClient);
+					for (auto r = 0ull; r < requestsPerClient; r++)
+					{
+						std::generate(input.begin(), input.end(), [&]() { return static_cast<Byte>(distribution(engine)); });
+
+						const auto timePoint = std::chrono::steady_clock::now();
+						Submit(input.data()).get();
+						latencies[c].push_back(std::chrono::duration<Float, std::milli>(std::chrono::steady_clock::now() - timePoint).count());
+					}
+				}));
+
+			for (auto& thread : threads)
+				thread.join();
+
+			const auto elapsed = std::chrono::duration<Float>(std::chrono::steady_clock::now() - start).count();
+
+			auto all = std::vector<Float>();
+			for (const auto& latency : latencies)
+				all.insert(all.end(), latency.begin(), latency.end());
+			std::sort(all.begin(), all.end());
+
+			const auto percentile = [&](const Float p) { return all.empty() ? Float(0) : all[std::min<UInt>(UInt(p * Float(all.size())), all.size() - 1)]; };
+
+			auto info = BatcherBenchmarkInfo();
+			info.Requests = RequestCount.load() - requests;
+			info.Batches = BatchCount.load() - batches;
+			info.AvgBatchSize = info.Batches > 0 ? Float(info.Requests) / Float(info.Batches) : Float(0);
+			info.Throughput = elapsed > Float(0) ? Float(info.Requests) / elapsed : Float(0);
+			info.LatencyP50 = percentile(Float(0.50));
+			info.LatencyP90 = percentile(Float(0.90));
+			info.LatencyP99 = percentile(Float(0.99));
+			info.LatencyMax = all.empty() ? Float(0) : all.back();
+
+			return info;
+		}
+	};
+}
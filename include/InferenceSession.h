@@ -0,0 +1,527 @@
+#pragma once
+#include "Definition.h"
+
+namespace dnn
+{
+	// the loaded parameters of a layer in the layout its session chose for them
+	struct LayerWeights
+	{
+		std::unique_ptr<dnnl::memory::desc> WeightsMemDesc;
+		FloatVector Weights;
+		FloatVector Biases;
+		std::vector<FloatVector> Stats;
+	};
+
+	// Read-only state shared by all sessions created from the same definition and weights file
+	struct InferenceModel
+	{
+		std::string Definition;
+		std::string Weights;		// weights image as written by Model::SaveWeights without optimizer state
+		std::vector<Float> Mean;
+		std::vector<Float> StdDev;
+		bool MeanStdNormalization;
+		std::vector<LayerWeights> Layers;	// filled once by the first session, the others read them in place
+
+		InferenceModel(const std::string& definition, const std::string& weights, const std::vector<Float>& mean, const std::vector<Float>& stddev, const bool meanStdNormalization) :
+			Definition(definition),
+			Weights(weights),
+			Mean(mean),
+			StdDev(stddev),
+			MeanStdNormalization(meanStdNormalization),
+			Layers(std::vector<LayerWeights>())
+		{
+		}
+	};
+
+	// an intermediate output that answers the samples it is confident about
+	struct EarlyExit
+	{
+		UInt LayerIndex;
+		UInt Output;				// index in the outputs of the session
+		std::vector<UInt> Live;		// layers up to LayerIndex whose Neurons are still read after it
+	};
+
+	// Forward-only execution of a model: no gradients, no optimizer state and all Neurons packed in one planned arena.
+	// A session is serialized by its own mutex, run independent sessions (see Clone) to serve requests concurrently.
+	// The sessions of one model read the same weights, a layer whose layout differs for a batch size gets its own copy.
+	class InferenceSession
+	{
+	private:
+		std::shared_ptr<const InferenceModel> Shared;
+		std::unique_ptr<Model> model;
+		std::vector<Layer*> Outputs;
+		std::vector<EarlyExit> Exits;
+		Float ExitThreshold;
+		std::mutex Lock;
+		UInt BatchSize;
+
+		InferenceSession(std::shared_ptr<const InferenceModel> shared, CheckMsg& msg) :
+			Shared(shared),
+			model(nullptr),
+			Outputs(std::vector<Layer*>()),
+			Exits(std::vector<EarlyExit>()),
+			ExitThreshold(Float(0)),
+			BatchSize(0)
+		{
+			model = std::unique_ptr<Model>(Read(Shared->Definition, nullptr, msg, true));
+
+			if (model)
+			{
+				for (const auto cost : model->CostLayers)
+					Outputs.push_back(cost->InputLayer);
+
+				model->MeanStdNormalization = Shared->MeanStdNormalization;
+				model->SwitchInplaceBwd(false);
+			}
+		}
+
+		bool Allocate(const UInt batchSize)
+		{
+			model->ReleaseMemoryPlan();
+
+			model->InitializeLayers(batchSize);
+			model->BatchSize = batchSize;
+
+			return model->ApplyMemoryPlan();
+		}
+
+		bool LoadWeights()
+		{
+			auto is = std::istringstream(Shared->Weights, std::ios::in | std::ios::binary);
+
+			for (auto& layer : model->Layers)
+				layer->Load(is, false, Optimizers::SGD);
+
+			return !is.fail();
+		}
+
+		// the loaded weights move to the shared model and the layers read them from there
+		void ShareWeights(InferenceModel& shared)
+		{
+			shared.Layers = std::vector<LayerWeights>(model->Layers.size());
+
+			for (auto i = 0ull; i < model->Layers.size(); i++)
+			{
+				auto& layer = model->Layers[i];
+				auto& weights = shared.Layers[i];
+
+				if (layer->HasWeights)
+					weights.WeightsMemDesc = std::make_unique<dnnl::memory::desc>(*layer->WeightsMemDesc);
+				weights.Weights = std::move(layer->Weights);
+				weights.Biases = std::move(layer->Biases);
+				for (const auto stats : layer->RunningStats())
+					weights.Stats.push_back(std::move(*stats));
+			}
+
+			BorrowWeights();
+		}
+
+		// false when the weights aren't shared yet or a layer chose another layout than the first session
+		bool BorrowWeights()
+		{
+			if (Shared->Layers.size() != model->Layers.size())
+				return false;
+
+			for (auto i = 0ull; i < model->Layers.size(); i++)
+			{
+				const auto& layer = model->Layers[i];
+				const auto& weights = Shared->Layers[i];
+
+				if (layer->HasWeights && (!weights.WeightsMemDesc || *weights.WeightsMemDesc != *layer->WeightsMemDesc || weights.Weights.size() != layer->Weights.size()))
+					return false;
+				if (weights.Biases.size() != layer->Biases.size() || weights.Stats.size() != layer->RunningStats().size())
+					return false;
+			}
+
+			for (auto i = 0ull; i < model->Layers.size(); i++)
+			{
+				auto& layer = model->Layers[i];
+				const auto& weights = Shared->Layers[i];
+
+				layer->Weights = View<FloatVector>(weights.Weights.data(), weights.Weights.size());
+				layer->Biases = View<FloatVector>(weights.Biases.data(), weights.Biases.size());
+
+				const auto stats = layer->RunningStats();
+				for (auto s = 0ull; s < stats.size(); s++)
+					*stats[s] = View<FloatVector>(weights.Stats[s].data(), weights.Stats[s].size());
+			}
+
+			return true;
+		}
+
+		void Forward(const UInt batchSize)
+		{
+			for (auto i = 1ull; i < model->Layers.size(); i++)
+				if (model->Layers[i]->LayerType != LayerTypes::Cost)
+					model->Layers[i]->ForwardProp(batchSize, false);
+		}
+
+		// sample n of the layer in plain CDHW order
+		static void CopySample(const Layer* layer, const UInt n, Float* output)
+		{
+			const auto size = layer->CDHW();
+			const auto DHW = layer->D * layer->HW();
+
+			if (layer->IsPlainFormat())
+				std::copy(&layer->Neurons[n * size], &layer->Neurons[n * size] + size, output);
+			else
+				for (auto c = 0ull; c < layer->C; c++)
+					for (auto i = 0ull; i < DHW; i++)
+						output[c * DHW + i] = layer->Neurons[n * layer->PaddedCDHW() + (c / VectorSize) * DHW * VectorSize + i * VectorSize + (c % VectorSize)];
+		}
+
+		void CopyOutputs(const UInt batchSize, Float* output) const
+		{
+			for (const auto layer : Outputs)
+			{
+				const auto size = layer->CDHW();
+
+				for (auto n = 0ull; n < batchSize; n++)
+				{
+					CopySample(layer, n, output);
+					output += size;
+				}
+			}
+		}
+
+		// the largest class probability of sample n, sample receives its output
+		static Float Confidence(const Layer* layer, const UInt n, Float* sample)
+		{
+			const auto size = layer->CDHW();
+
+			CopySample(layer, n, sample);
+			const auto maxValue = *std::max_element(sample, sample + size);
+
+			if (layer->LayerType == LayerTypes::Softmax)
+				return maxValue;
+
+			if (layer->LayerType == LayerTypes::LogSoftmax)
+				return std::exp(maxValue);
+
+			auto sum = Float(0);
+			for (auto i = 0ull; i < size; i++)
+				sum += std::exp(sample[i] - maxValue);
+
+			return Float(1) / sum;
+		}
+
+		// the samples in keep move to the front of the activations that are still read after the exit
+		void Compact(const EarlyExit& exit, const std::vector<UInt>& keep, const UInt survivors, const UInt batchSize)
+		{
+			auto buffers = std::vector<Float*>();
+
+			for (const auto j : exit.Live)
+			{
+				auto& neurons = model->Layers[j]->Neurons;
+				if (neurons.empty() || std::find(buffers.begin(), buffers.end(), neurons.data()) != buffers.end())
+					continue;
+
+				// views placed in place by the memory plan share the buffer of their root
+				buffers.push_back(neurons.data());
+
+				const auto stride = neurons.size() / batchSize;
+				for (auto q = 0ull; q < survivors; q++)
+					if (keep[q] != q)
+						std::copy(neurons.data() + keep[q] * stride, neurons.data() + (keep[q] + 1ull) * stride, neurons.data() + q * stride);
+			}
+		}
+
+		void SetInput(const Byte* input, const UInt batchSize)
+		{
+			const auto C = model->C;
+			const auto size = GetInputSize();
+			const auto channelSize = size / C;
+			const auto normalize = Shared->MeanStdNormalization && Shared->Mean.size() >= C && Shared->StdDev.size() >= C;
+			const auto neurons = model->Layers[0]->Neurons.data();
+
+			for_i(batchSize, [&](const UInt n)
+			{
+				for (auto c = 0ull; c < C; c++)
+				{
+					const auto sample = input + n * size + c * channelSize;
+
+					auto mean = Float(0);
+					auto stddev = Float(1);
+					if (normalize)
+					{
+						mean = Shared->Mean[c];
+						stddev = Shared->StdDev[c];
+					}
+					else
+					{
+						for (auto i = 0ull; i < channelSize; i++)
+							mean += Float(sample[i]);
+						mean /= Float(channelSize);
+
+						auto variance = Float(0);
+						for (auto i = 0ull; i < channelSize; i++)
+							variance += Square<Float>(Float(sample[i]) - mean);
+						stddev = std::max(std::sqrt(variance / Float(channelSize)), Float(1) / std::sqrt(Float(channelSize)));
+					}
+
+					const auto dst = neurons + n * size + c * channelSize;
+					for (auto i = 0ull; i < channelSize; i++)
+						dst[i] = (Float(sample[i]) - mean) / stddev;
+				}
+			});
+		}
+
+	public:
+		// with meanStdNormalization the input is normalized with the mean and standard deviation of the dataprovider,
+		// otherwise every sample with its own
+		static std::unique_ptr<InferenceSession> Create(const std::string& definition, const std::string& weightsFileName, const UInt batchSize, Dataprovider* dataprovider, const bool meanStdNormalization, CheckMsg& msg)
+		{
+			auto file = std::ifstream(weightsFileName, std::ios::in | std::ios::binary);
+			if (file.bad() || !file.is_open())
+			{
+				msg = CheckMsg(0, 0, "Weights file " + weightsFileName + " not found", true);
+				return nullptr;
+			}
+
+			std::stringstream stream;
+			stream << file.rdbuf();
+			file.close();
+
+			auto mean = std::vector<Float>();
+			auto stddev = std::vector<Float>();
+			if (dataprovider)
+			{
+				mean = dataprovider->Mean;
+				stddev = dataprovider->StdDev;
+			}
+
+			auto shared = std::make_shared<InferenceModel>(definition, stream.str(), mean, stddev, meanStdNormalization);
+
+			auto session = std::unique_ptr<InferenceSession>(new InferenceSession(shared, msg));
+			if (!session->model || msg.Error)
+				return nullptr;
+
+			if (session->model->GetWeightsSize(false, Optimizers::SGD) != shared->Weights.size())
+			{
+				msg = CheckMsg(0, 0, "Weights file " + weightsFileName + " doesn't match the definition", true);
+				return nullptr;
+			}
+
+			if (!session->SetBatchSize(batchSize))
+				return nullptr;
+
+			session->ShareWeights(*shared);
+
+			return session;
+		}
+
+		// a new session over the same definition and weights with its own activations, the model is built from the
+		// compiled definition and reads the weights of this one
+		std::unique_ptr<InferenceSession> Clone()
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			auto msg = CheckMsg();
+			auto session = std::unique_ptr<InferenceSession>(new InferenceSession(Shared, msg));
+			if (!session->model || msg.Error || !session->SetBatchSize(BatchSize))
+				return nullptr;
+
+			if (!Exits.empty())
+				session->SetEarlyExit(ExitThreshold);
+
+			return session;
+		}
+
+		// Confidence-gated early exits: an intermediate output with the shape of the last one answers every sample whose
+		// largest class probability reaches the threshold, the remaining samples go on as a smaller batch (see RunEarlyExit).
+		// Returns the number of exits, a threshold of 0 disables them.
+		UInt SetEarlyExit(const Float threshold)
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			Exits.clear();
+			ExitThreshold = threshold;
+
+			if (threshold <= Float(0) || Outputs.size() < 2ull)
+				return 0ull;
+
+			auto index = std::unordered_map<const Layer*, UInt>();
+			for (auto i = 0ull; i < model->Layers.size(); i++)
+				index[model->Layers[i].get()] = i;
+
+			const auto last = Outputs.back();
+			for (auto o = 0ull; o < Outputs.size() - 1ull; o++)
+			{
+				const auto i = index[Outputs[o]];
+				if (Outputs[o]->CDHW() != last->CDHW() || i >= index[last])
+					continue;
+
+				auto exit = EarlyExit{ i, o, std::vector<UInt>() };
+				for (auto j = 0ull; j <= i; j++)
+					for (const auto output : model->Layers[j]->Outputs)
+						if (output->LayerType != LayerTypes::Cost && index[output] > i)
+						{
+							exit.Live.push_back(j);
+							break;
+						}
+
+				Exits.push_back(exit);
+			}
+
+			std::sort(Exits.begin(), Exits.end(), [](const EarlyExit& a, const EarlyExit& b) { return a.LayerIndex < b.LayerIndex; });
+
+			return Exits.size();
+		}
+
+		bool SetBatchSize(const UInt batchSize)
+		{
+			if (batchSize < 1)
+				return false;
+
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			if (batchSize == BatchSize)
+				return true;
+
+			if (!Allocate(batchSize))
+				return false;
+
+			// weights in the persisted format are reordered to the chosen format while loading, so they are (re)loaded after the descriptors
+			if (BatchSize == 0 && !BorrowWeights() && !LoadWeights())
+				return false;
+
+			BatchSize = batchSize;
+
+			return true;
+		}
+
+		// the activations are placed in the arena of owner instead of one of their own, so owner and this session may never
+		// run at the same time (InferenceBatcher runs its buckets one after the other)
+		bool ShareArena(InferenceSession& owner)
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			if (&owner == this || BatchSize == 0)
+				return false;
+
+			return model->ApplyMemoryPlan(owner.model->GetArena().data(), owner.model->GetArena().size());
+		}
+
+		UInt GetBatchSize() const { return BatchSize; }
+		UInt GetInputSize() const { return model->C * model->D * model->H * model->W; }
+		UInt GetOutputCount() const { return Outputs.size(); }
+		UInt GetOutputSize(const UInt output) const { return output < Outputs.size() ? Outputs[output]->CDHW() : 0; }
+		LayerTypes GetOutputType(const UInt output) const { return Outputs.at(output)->LayerType; }
+		UInt GetOutputsSize() const
+		{
+			auto size = UInt(0);
+			for (const auto layer : Outputs)
+				size += layer->CDHW();
+
+			return size;
+		}
+
+		// input is batchSize samples in NCDHW order, output receives every output layer in turn as batchSize x CDHW
+		bool Run(const Byte* input, const UInt batchSize, Float* output)
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			if (batchSize < 1 || batchSize > BatchSize)
+				return false;
+
+			const auto size = GetInputSize();
+			const auto neurons = model->Layers[0]->Neurons.data();
+
+			SetInput(input, batchSize);
+			std::fill(neurons + batchSize * size, neurons + BatchSize * size, Float(0));
+
+			Forward(BatchSize);
+			CopyOutputs(batchSize, output);
+
+			return true;
+		}
+
+		// input is batchSize already normalized samples in NCDHW order
+		bool Run(const Float* input, const UInt batchSize, Float* output)
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			if (batchSize < 1 || batchSize > BatchSize)
+				return false;
+
+			const auto size = GetInputSize();
+			const auto neurons = model->Layers[0]->Neurons.data();
+
+			std::copy(input, input + batchSize * size, neurons);
+			std::fill(neurons + batchSize * size, neurons + BatchSize * size, Float(0));
+
+			Forward(BatchSize);
+			CopyOutputs(batchSize, output);
+
+			return true;
+		}
+
+		// input is batchSize samples in NCDHW order, output receives the last output as batchSize x CDHW and exits for
+		// every sample the index of the output that answered it. The batch runs at its real size and shrinks at each exit.
+		bool RunEarlyExit(const Byte* input, const UInt batchSize, Float* output, UInt* exits)
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			if (batchSize < 1 || batchSize > BatchSize)
+				return false;
+
+			model->SwitchBatchSize(batchSize);
+			SetInput(input, batchSize);
+
+			const auto last = Outputs.back();
+			const auto size = last->CDHW();
+
+			auto samples = std::vector<UInt>(batchSize);
+			std::iota(samples.begin(), samples.end(), 0ull);
+			auto keep = std::vector<UInt>(batchSize);
+			auto sample = std::vector<Float>(size);
+
+			auto exit = 0ull;
+			for (auto i = 1ull; i < model->Layers.size() && !samples.empty(); i++)
+			{
+				if (model->Layers[i]->LayerType != LayerTypes::Cost)
+					model->Layers[i]->ForwardProp(samples.size(), false);
+
+				if (exit < Exits.size() && Exits[exit].LayerIndex == i)
+				{
+					const auto head = Outputs[Exits[exit].Output];
+
+					auto survivors = 0ull;
+					for (auto p = 0ull; p < samples.size(); p++)
+					{
+						if (Confidence(head, p, sample.data()) >= ExitThreshold)
+						{
+							std::copy(sample.begin(), sample.end(), output + samples[p] * size);
+							exits[samples[p]] = Exits[exit].Output;
+						}
+						else
+						{
+							keep[survivors] = p;
+							samples[survivors++] = samples[p];
+						}
+					}
+
+					if (survivors < samples.size())
+					{
+						Compact(Exits[exit], keep, survivors, samples.size());
+						samples.resize(survivors);
+						// every layer switches, the ones up to the exit still feed the layers behind it
+						model->SwitchBatchSize(survivors);
+					}
+
+					exit++;
+				}
+			}
+
+			for (auto p = 0ull; p < samples.size(); p++)
+			{
+				CopySample(last, p, output + samples[p] * size);
+				exits[samples[p]] = Outputs.size() - 1ull;
+			}
+
+			model->SwitchBatchSize(BatchSize);
+
+			return true;
+		}
+	};
+}
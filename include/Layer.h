@@ -4,6 +4,7 @@
 namespace dnn
 {
 	class Model;
+	class Layer;
 	
 	enum class Optimizers
 	{
@@ -224,6 +225,39 @@ namespace dnn
 		}
 	};
 
+	// non-owning view of the inputs of a layer, switching between the forward and the backward (inplace) inputs only moves the view
+	class LayerInputs
+	{
+	private:
+		Layer* const* First;
+		UInt Count;
+
+	public:
+		LayerInputs() noexcept :
+			First(nullptr),
+			Count(0)
+		{
+		}
+
+		LayerInputs(Layer* const* first, const UInt count) noexcept :
+			First(first),
+			Count(count)
+		{
+		}
+
+		LayerInputs(const std::vector<Layer*>& inputs) noexcept :
+			First(inputs.data()),
+			Count(inputs.size())
+		{
+		}
+
+		inline auto operator[](const UInt index) const noexcept { return First[index]; }
+		inline auto size() const noexcept { return Count; }
+		inline auto empty() const noexcept { return Count == 0; }
+		inline auto begin() const noexcept { return First; }
+		inline auto end() const noexcept { return First + Count; }
+	};
+
 	class Layer
 	{
 	protected:
@@ -269,19 +303,22 @@ namespace dnn
 			}
 		}
 
-		auto EqualDimensions(const std::vector<Layer*>& inputs) const
+		template<typename T>
+		auto EqualDimensions(const T& inputs) const
 		{
 			return 
 				(inputs[0]->H == inputs[1]->H) && 
 				(inputs[0]->W == inputs[1]->W);
 		}
 
-		auto GetFirst(const std::vector<Layer*>& inputs) const
+		template<typename T>
+		auto GetFirst(const T& inputs) const
 		{
 			return EqualDimensions(inputs) ? Byte(0) : ((inputs[0]->H == 1 && inputs[0]->W == 1) ? Byte(1) : Byte(0));
 		}
 
-		auto GetSecond(const std::vector<Layer*>& inputs) const
+		template<typename T>
+		auto GetSecond(const T& inputs) const
 		{
 			return EqualDimensions(inputs) ? Byte(1) : ((inputs[0]->H == 1 && inputs[0]->W == 1) ? Byte(0) : Byte(1));
 		}
@@ -300,10 +337,10 @@ namespace dnn
 		const UInt PadH;
 		const UInt PadW;
 		const bool HasPadding;
-		std::vector<Layer*> Inputs;
 		std::vector<Layer*> Outputs;
 		const std::vector<Layer*> InputsFwd;
 		const std::vector<Layer*> InputsBwd;
+		LayerInputs Inputs;
 		Layer* InputLayer;
 		Layer* InputLayerBwd;
 		Layer* InputLayerFwd;
@@ -318,6 +355,8 @@ namespace dnn
 		const bool InplaceBwd;
 		bool Enabled;
 		bool Skip;
+		bool Checkpoint;
+		bool ForwardOnly;		// an inference session never allocates the gradients of its layers
 		bool UseDefaultParameters;
 		Fillers WeightsFiller;
 		FillerModes WeightsFillerMode;
@@ -341,6 +380,12 @@ namespace dnn
 		FloatVector BiasesD1;
 		FloatVector BiasesPar1;
 		FloatVector BiasesPar2;
+		FloatVector EmaWeights;		// exponential moving average of the weights, kept by UpdateWeights (see SetEma)
+		FloatVector EmaBiases;
+		std::vector<FloatVector> EmaStats;	// average of RunningStats
+		Float EmaDecay;
+		UInt EmaSteps;
+		bool EmaSwapped;		// the averages are in Weights, Biases and the running statistics (see SwapEma)
 		Float B1;
 		Float B2;
 		Float Gamma;
@@ -375,15 +420,17 @@ namespace dnn
 			PadD(padD),
 			PadH(padH),
 			PadW(padW),
-			Inputs(std::vector<Layer*>(inputs)),		// Inputs is switched between non-inplace (forward) and inplace (backprop) during training 
 			InputsFwd(std::vector<Layer*>(inputs)),		// InputsFwd = the non-inplace inputs 
 			InputsBwd(GetInputsBwd(layerType, inputs)),	// InputsBwd = the inplace inputs for backward prop
+			Inputs(InputsFwd),							// Inputs is switched between non-inplace (forward) and inplace (backprop) during training 
 			InputLayer(inputs.size() > 0 ? inputs[0] : nullptr),
 			InputLayerFwd(inputs.size() > 0 ? inputs[0] : nullptr),
 			InputLayerBwd(GetInputsBwd(layerType, inputs).size() > 0 ? GetInputsBwd(layerType, inputs)[0] : nullptr),
 			InplaceBwd(IsInplaceBwd(layerType, inputs)),
 			Enabled(enabled),
 			Skip(false),
+			Checkpoint(true),
+			ForwardOnly(false),
 			Scaling(scaling),
 			HasBias(hasBias && biasCount > 0),
 			HasWeights(weightCount > 0),
@@ -405,13 +452,19 @@ namespace dnn
 			Neurons(FloatArray()),
 			NeuronsD1(FloatArray()),
 			Weights(FloatVector(weightCount)),
-			WeightsD1(FloatVector(weightCount)),
+			WeightsD1(FloatVector()),			// sized with the optimizer state (see ResetOptimizer)
 			Biases(FloatVector(biasCount)),
-			BiasesD1(FloatVector(biasCount)),
+			BiasesD1(FloatVector()),
 			WeightsPar1(FloatVector()),
 			WeightsPar2(FloatVector()),
 			BiasesPar1(FloatVector()),
 			BiasesPar2(FloatVector()),
+			EmaWeights(FloatVector()),
+			EmaBiases(FloatVector()),
+			EmaStats(std::vector<FloatVector>()),
+			EmaDecay(Float(0)),
+			EmaSteps(0),
+			EmaSwapped(false),
 			B1(Float(0)),
 			B2(Float(0)),
 			Gamma(Float(0)),
@@ -529,8 +582,37 @@ namespace dnn
 			return WeightCount > 0;
 		}
 
+		// false when running ForwardProp a second time on the same batch doesn't reproduce the same Neurons (e.g. random dropout masks)
+		virtual bool Recomputable() const
+		{
+			return true;
+		}
+
+		// false when the backward pass reads only the Neurons of the inputs, an input of a bit mask Activation can then be released early (see MemoryPlanner::MaskedLifetimes)
+		virtual bool BackwardReadsNeurons() const
+		{
+			return true;
+		}
+
+		// state that isn't trained but is averaged together with the weights, the running statistics of a batch normalization
+		virtual std::vector<FloatVector*> RunningStats()
+		{
+			return std::vector<FloatVector*>();
+		}
+
 		virtual void InitializeDescriptors(const UInt) = 0;
 
+		// memory format conversions done in every pass because the primitive of the layer wants another layout than its input
+		virtual UInt ForwardReorders() const
+		{
+			return 0ull;
+		}
+
+		virtual UInt BackwardReorders() const
+		{
+			return 0ull;
+		}
+
 #ifdef DNN_LEAN
 		inline void ZeroGradient(const UInt batchSize)
 		{
@@ -560,7 +642,8 @@ namespace dnn
 			
 			Neurons.resize(batchSize, C, H, W, dnnl::memory::data_type::f32, BlockedFmt, Device.engine);
 #ifndef DNN_LEAN
-			if (!InplaceBwd)
+			// ChannelZeroPad clears its gradient in the inference pass as well
+			if (!InplaceBwd && (!ForwardOnly || LayerType == LayerTypes::ChannelZeroPad))
 				NeuronsD1.resize(batchSize, C, H, W, dnnl::memory::data_type::f32, BlockedFmt, Device.engine);
 #else
 			ReleaseGradient();
@@ -569,6 +652,18 @@ namespace dnn
 			InitializeDescriptors(batchSize);
 		}
 
+		// used by activation checkpointing: Neurons are dropped after the forward pass and recomputed before they are needed in the backward pass
+		inline void ReleaseNeurons()
+		{
+			Neurons.release();
+		}
+
+		inline void RestoreNeurons(const UInt batchSize)
+		{
+			if (Neurons.empty())
+				Neurons.resize(batchSize, C, H, W, dnnl::memory::data_type::f32, BlockedFmt, Device.engine);
+		}
+
 		virtual void ForwardProp(const UInt batchSize, const bool training) = 0;
 
 		virtual void BackwardProp(const UInt batchSize) = 0;
@@ -903,7 +998,7 @@ namespace dnn
 
 		void ResetOptimizer(const Optimizers optimizer)
 		{
-			if (HasWeights)
+			if (HasWeights && !ForwardOnly)
 			{
 				B1 = Float(0);
 				B2 = Float(0);
@@ -960,7 +1055,7 @@ namespace dnn
 
 		void SetOptimizer(const Optimizers optimizer)
 		{
-			if (HasWeights)
+			if (HasWeights && !ForwardOnly)
 			{
 				const auto weightsSize = WeightsMemDesc->get_size() / sizeof(Float);
 				const auto biasesSize = HasBias ? BiasCount : 0;
@@ -1005,6 +1100,13 @@ namespace dnn
 			}
 		}
 
+		// the filler draws from a stream of its own, the weights don't depend on the order the layers are reset in
+		void SeedRandomEngine(const UInt seed, const UInt stream)
+		{
+			auto sequence = std::seed_seq{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), static_cast<uint32_t>(stream) };
+			RandomEngine.seed(sequence);
+		}
+
 		virtual void ResetWeights(const Fillers weightsFiller, const FillerModes weightsFillerMode, const Float weightsGain, const Float weightsScale, const Fillers biasesFiller, const FillerModes biasesFillerMode, const Float biasesGain, const Float biasesScale)
 		{
 			if (HasWeights)
@@ -1120,18 +1222,18 @@ namespace dnn
 				if (*PersistWeightsMemDesc != *WeightsMemDesc)
 				{
 					Weights.resize(WeightsMemDesc->get_size() / sizeof(Float));
-					WeightsD1.resize(WeightsMemDesc->get_size() / sizeof(Float));
 
 					auto memWeights = dnnl::memory(*PersistWeightsMemDesc, Device.engine, weights.data());
 					auto weightsMem = dnnl::memory(*WeightsMemDesc, Device.engine, Weights.data());
 
-					dnnl::reorder(memWeights, weightsMem).execute(Device.stream, { {DNNL_ARG_FROM, memWeights}, {DNNL_ARG_TO, weightsMem} });
-					Device.stream.wait();
+					// layers are reset concurrently, the shared stream isn't safe to submit to from several threads
+					auto stream = dnnl::stream(Device.engine);
+					dnnl::reorder(memWeights, weightsMem).execute(stream, { {DNNL_ARG_FROM, memWeights}, {DNNL_ARG_TO, weightsMem} });
+					stream.wait();
 				}
 				else
 				{
 					Weights.resize(WeightCount);
-					WeightsD1.resize(WeightCount);
 
 					std::copy(weights.begin(), weights.end(), Weights.begin());
 				}
@@ -1307,9 +1409,112 @@ namespace dnn
 					SGDW(rate);
 					break;
 				}
+
+				// while the weights of the layer are still in cache, on the update worker when the updates overlap
+				if (EmaDecay > Float(0))
+					UpdateEma();
+			}
+		}
+
+		// the primitive of the layer wants the weights in another layout, the averages follow them (see SetEma)
+		void ReorderWeights(const dnnl::memory::desc& weightsDesc)
+		{
+			auto stream = dnnl::stream(Device.engine);	// layers initialize concurrently (see Model::InitializeLayers)
+
+			const auto reorder = [&](FloatVector& vector)
+			{
+				auto weights = FloatVector(weightsDesc.get_size() / sizeof(Float));
+				auto memWeights = dnnl::memory(*WeightsMemDesc, Device.engine, vector.data());
+				auto weightsMem = dnnl::memory(weightsDesc, Device.engine, weights.data());
+
+				dnnl::reorder(memWeights, weightsMem).execute(stream, std::unordered_map<int, dnnl::memory>{ {DNNL_ARG_FROM, memWeights}, { DNNL_ARG_TO, weightsMem } });
+				stream.wait();
+
+				vector = std::move(weights);	// a view on shared weights is replaced, not written
+			};
+
+			reorder(Weights);
+			if (!EmaWeights.empty())
+				reorder(EmaWeights);
+
+			WeightsMemDesc = std::make_unique<dnnl::memory::desc>(weightsDesc);
+		}
+
+		// a decay of 0 releases the averages, a batch normalization without scaling only averages its running statistics
+		void SetEma(const Float decay)
+		{
+			if (EmaSwapped)
+				SwapEma();
+
+			EmaDecay = HasWeights || !RunningStats().empty() ? decay : Float(0);
+			EmaSteps = 0;
+
+			if (EmaDecay > Float(0))
+			{
+				EmaWeights = HasWeights ? Weights : FloatVector();
+				EmaBiases = HasWeights ? Biases : FloatVector();
+				EmaStats.clear();
+				for (const auto stats : RunningStats())
+					EmaStats.push_back(*stats);
+			}
+			else
+			{
+				EmaWeights = FloatVector();
+				EmaBiases = FloatVector();
+				EmaStats = std::vector<FloatVector>();
 			}
 		}
 
+		// average += (1 - decay) * (value - average), the decay warms up with the number of steps
+		static inline void Ema(const Float* value, Float* average, const UInt size, const Float rate)
+		{
+			const auto part = size - (size % VectorSize);
+			const auto vecRate = VecFloat(rate);
+
+			for (auto i = 0ull; i < part; i += VectorSize)
+			{
+				const auto avg = VecFloat().load_a(average + i);
+				mul_add(VecFloat().load_a(value + i) - avg, vecRate, avg).store_a(average + i);
+			}
+			for (auto i = part; i < size; i++)
+				average[i] += rate * (value[i] - average[i]);
+		}
+
+		inline void UpdateEma()
+		{
+			EmaSteps++;
+			const auto rate = Float(1) - std::min(EmaDecay, Float(1 + EmaSteps) / Float(10 + EmaSteps));
+
+			// the full vector, in a blocked layout the weights are spread over the padded size (see ReorderWeights)
+			if (HasWeights)
+				Ema(Weights.data(), EmaWeights.data(), EmaWeights.size(), rate);
+			if (HasWeights && HasBias)
+				Ema(Biases.data(), EmaBiases.data(), BiasCount, rate);
+
+			const auto stats = RunningStats();
+			for (auto i = 0ull; i < stats.size(); i++)
+				Ema(stats[i]->data(), EmaStats[i].data(), EmaStats[i].size(), rate);
+		}
+
+		// exchanges the weights with their averages, only the vectors are swapped
+		void SwapEma()
+		{
+			if (EmaDecay <= Float(0))
+				return;
+
+			if (HasWeights)
+			{
+				std::swap(Weights, EmaWeights);
+				std::swap(Biases, EmaBiases);
+			}
+
+			const auto stats = RunningStats();
+			for (auto i = 0ull; i < stats.size(); i++)
+				std::swap(*stats[i], EmaStats[i]);
+
+			EmaSwapped = !EmaSwapped;
+		}
+
 		inline void AdaBound(const TrainingRate& rate, const bool amsbound = false)
 		{
 			const auto beta1 = rate.Momentum;
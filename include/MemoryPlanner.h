@@ -0,0 +1,371 @@
+#pragma once
+#include "Activation.h"
+#include "Concat.h"
+#include "ChannelSplit.h"
+
+namespace dnn
+{
+	struct MemoryBlock
+	{
+		UInt LayerIndex;
+		bool Gradient;	// false = Neurons, true = NeuronsD1
+		UInt Size;		// bytes, rounded up to the arena alignment
+		UInt First;		// first step in which the buffer is live
+		UInt Last;		// last step in which the buffer is live
+		UInt Offset;	// offset in the arena
+
+		MemoryBlock(const UInt layerIndex, const bool gradient, const UInt size, const UInt first, const UInt last) :
+			LayerIndex(layerIndex),
+			Gradient(gradient),
+			Size(size),
+			First(first),
+			Last(last),
+			Offset(0)
+		{
+		}
+
+		inline auto Overlaps(const MemoryBlock& block) const noexcept
+		{
+			return First <= block.Last && block.First <= Last;
+		}
+	};
+
+	// the Neurons of a layer live inside the Neurons of Root, Offset floats from its start
+	struct MemoryView
+	{
+		UInt Root;
+		UInt Offset;
+	};
+
+	struct MemoryPlan
+	{
+		std::vector<MemoryBlock> Blocks;
+		std::vector<MemoryView> Views;
+		UInt BlocksSize;	// sum of all blocks, what the layers allocate on their own
+		UInt ArenaSize;		// planned peak
+
+		MemoryPlan() :
+			Blocks(std::vector<MemoryBlock>()),
+			Views(std::vector<MemoryView>()),
+			BlocksSize(0),
+			ArenaSize(0)
+		{
+		}
+	};
+
+	// Static activation memory planner: the lifetime of every Neurons/NeuronsD1 buffer is derived from the layer graph
+	// and the buffers are packed in one arena with a greedy interval coloring (largest buffer first, lowest free offset).
+	// Steps are the layer indices in the forward pass and 2 * layers - 1 - index in the backward pass.
+	// Cost layers keep their own buffers, they are small and written in every pass.
+// In training the input of Activations with a bit mask is only live in the forward pass (see MaskedLifetimes).
+	// In a forward-only plan at batch size 1 a channel slice is a contiguous sub-buffer, so the inputs of a Concat are
+	// written straight into their slice of its output and a ChannelSplit reads its slice of the parent in place (see Views).
+	// That's the only case with views of channel slices: with more samples a slice is strided by the sample size, and the
+	// training plan aliases neither Neurons nor NeuronsD1, Concat and ChannelSplit copy their slices in both passes there.
+	// At any batch size an Add, Average or Substract overwrites its full-size input once nothing else reads it anymore and
+	// an Activation or BatchNormActivation that is the only consumer of a merge layer works in place on it (see FusedEpilogue).
+	class MemoryPlanner
+	{
+	public:
+		static constexpr UInt Alignment = 64ull;
+
+		static std::vector<MemoryView> Views(const std::vector<std::unique_ptr<Layer>>& layers, const UInt batchSize, const bool training)
+		{
+			const auto layerCount = layers.size();
+
+			auto views = std::vector<MemoryView>(layerCount);
+			for (auto i = 0ull; i < layerCount; i++)
+				views[i] = MemoryView{ i, 0ull };
+
+			if (training)
+				return views;
+
+			auto index = std::unordered_map<const Layer*, UInt>();
+			for (auto i = 0ull; i < layerCount; i++)
+				index[layers[i].get()] = i;
+
+			auto parent = std::vector<MemoryView>(views);
+
+			for (auto k = 0ull; k < layerCount; k++)
+			{
+				const auto& layer = layers[k];
+				if (batchSize != 1ull || layer->LayerType != LayerTypes::Concat)
+					continue;
+
+				const auto plain = layer->IsPlainFormat();
+				auto eligible = true;
+				for (auto j = 0ull; j < layer->Inputs.size(); j++)
+				{
+					const auto input = layer->Inputs[j];
+					const auto i = index[input];
+
+					eligible &= input->LayerType != LayerTypes::Input && input->LayerType != LayerTypes::Cost && parent[i].Root == i;
+					eligible &= input->H == layer->H && input->W == layer->W && input->ChosenFormat == layer->ChosenFormat;
+					eligible &= std::count(layer->Inputs.begin(), layer->Inputs.end(), input) == 1;
+					// in a blocked format an input only lines up with the channels of the concat when it fills its blocks
+					eligible &= plain || input->C % VectorSize == 0ull;
+				}
+
+				if (!eligible)
+					continue;
+
+				auto channelOffset = 0ull;
+				for (const auto input : layer->Inputs)
+				{
+					parent[index[input]] = MemoryView{ k, channelOffset * layer->HW() };
+					channelOffset += plain ? input->C : input->PaddedC;
+				}
+			}
+
+			for (auto k = 0ull; k < layerCount; k++)
+			{
+				const auto& layer = layers[k];
+				if (batchSize != 1ull || layer->LayerType != LayerTypes::ChannelSplit || parent[k].Root != k)
+					continue;
+
+				const auto split = dynamic_cast<const ChannelSplit*>(layer.get());
+				const auto groupC = (split->Group - 1ull) * layer->C;
+
+				if (layer->IsPlainFormat() || (layer->C % VectorSize == 0ull && groupC % VectorSize == 0ull))
+					parent[k] = MemoryView{ index[layer->InputLayer], groupC * layer->HW() };
+			}
+
+			const auto root = [&](UInt i)
+			{
+				for (auto depth = 0ull; depth < layerCount && parent[i].Root != i; depth++)
+					i = parent[i].Root;
+				return i;
+			};
+
+			// layers placed in place by the merge rules, every other view is a channel slice that must stay intact
+			auto inplace = std::vector<bool>(layerCount, false);
+
+			for (auto k = 0ull; k < layerCount; k++)
+			{
+				const auto& layer = layers[k];
+				if (parent[k].Root != k)
+					continue;
+
+				if (IsMerge(*layer) && layer->Inputs.size() == 2ull && layer->Inputs[0] != layer->Inputs[1])
+				{
+					// the full-size input, as Layer::GetFirst
+					const auto input = layer->Inputs[layer->Inputs[0]->H == layer->H && layer->Inputs[0]->W == layer->W ? 0 : 1];
+					const auto i = index[input];
+					const auto r = root(i);
+
+					auto eligible = input->LayerType != LayerTypes::Input && input->LayerType != LayerTypes::Cost && SameShape(*input, *layer);
+					for (auto j = 0ull; j < layerCount && eligible; j++)
+					{
+						if (root(j) != r)
+							continue;
+
+						eligible &= (j == r || inplace[j]) && !layers[j]->LayerBeforeCost;
+						for (const auto output : layers[j]->Outputs)
+							eligible &= index[output] <= k;
+					}
+
+					if (eligible)
+					{
+						parent[k] = MemoryView{ i, 0ull };
+						inplace[k] = true;
+					}
+				}
+				else if ((layer->LayerType == LayerTypes::Activation || layer->LayerType == LayerTypes::BatchNormActivation) && layer->Inputs.size() == 1ull)
+				{
+					const auto input = layer->InputLayer;
+
+					if (IsMerge(*input) && input->Outputs.size() == 1ull && !input->LayerBeforeCost && SameShape(*input, *layer))
+					{
+						parent[k] = MemoryView{ index[input], 0ull };
+						inplace[k] = true;
+					}
+				}
+			}
+
+			for (auto i = 0ull; i < layerCount; i++)
+			{
+				auto view = parent[i];
+				for (auto depth = 0ull; depth < layerCount && parent[view.Root].Root != view.Root; depth++)
+					view = MemoryView{ parent[view.Root].Root, view.Offset + parent[view.Root].Offset };
+
+				views[i] = view;
+			}
+
+			return views;
+		}
+
+		// The last forward step that reads the Neurons of a layer when its own backward pass doesn't and every consumer is an
+		// Activation with a bit mask (see Activation::SetBitMask), which writes the mask in its forward pass and never reads
+		// its input again. 0 when the Neurons are needed in the backward pass. A consumer that isn't a checkpoint reads the
+		// input again when its segment is recomputed, so its input stays.
+		static std::vector<UInt> MaskedLifetimes(const std::vector<std::unique_ptr<Layer>>& layers)
+		{
+			const auto layerCount = layers.size();
+
+			auto index = std::unordered_map<const Layer*, UInt>();
+			for (auto i = 0ull; i < layerCount; i++)
+				index[layers[i].get()] = i;
+
+			auto lifetimes = std::vector<UInt>(layerCount, 0ull);
+			for (auto i = 1ull; i < layerCount; i++)
+			{
+				const auto& layer = layers[i];
+				if (layer->LayerType == LayerTypes::Cost || layer->LayerBeforeCost || layer->Outputs.empty() || layer->BackwardReadsNeurons())
+					continue;
+
+				auto eligible = true;
+				auto last = i;
+				for (const auto output : layer->Outputs)
+				{
+					eligible &= output->LayerType == LayerTypes::Activation && output->Checkpoint && dynamic_cast<const Activation*>(output)->BitMask;
+					last = std::max<UInt>(last, index[output]);
+				}
+
+				if (eligible)
+					lifetimes[i] = last;
+			}
+
+			return lifetimes;
+		}
+
+		static UInt GetBufferSize(const Layer& layer, const UInt batchSize)
+		{
+			const auto md = dnnl::memory::desc(dnnl::memory::dims({ dnnl::memory::dim(batchSize), dnnl::memory::dim(layer.C), dnnl::memory::dim(layer.H), dnnl::memory::dim(layer.W) }), dnnl::memory::data_type::f32, BlockedFmt);
+
+			return ((md.get_size() + Alignment - 1ull) / Alignment) * Alignment;
+		}
+
+		static MemoryPlan Plan(const std::vector<std::unique_ptr<Layer>>& layers, const UInt batchSize, const bool training)
+		{
+			auto plan = MemoryPlan();
+
+			const auto layerCount = layers.size();
+			const auto lastStep = training ? 2ull * layerCount - 1ull : layerCount - 1ull;
+
+			auto index = std::unordered_map<const Layer*, UInt>();
+			for (auto i = 0ull; i < layerCount; i++)
+				index[layers[i].get()] = i;
+
+			// the gradient of a layer is live from the first backward step that writes into it (lazily zeroed like in DNN_LEAN) until its own backward step
+			auto firstGradientWrite = std::vector<UInt>(layerCount, 0ull);
+			if (training)
+			{
+				for (auto i = 0ull; i < layerCount; i++)
+					firstGradientWrite[i] = BackwardStep(layerCount, i);
+
+				for (auto k = 1ull; k < layerCount; k++)
+					for (const auto input : layers[k]->InputsBwd)
+					{
+						const auto i = index[input];
+						firstGradientWrite[i] = std::min(firstGradientWrite[i], BackwardStep(layerCount, k));
+					}
+			}
+
+			plan.Views = Views(layers, batchSize, training);
+
+			const auto masked = training ? MaskedLifetimes(layers) : std::vector<UInt>(layerCount, 0ull);
+
+			// a root is live as long as any of the views inside it
+			auto first = std::vector<UInt>(layerCount);
+			auto last = std::vector<UInt>(layerCount);
+			for (auto i = 0ull; i < layerCount; i++)
+			{
+				first[i] = i;
+				last[i] = i;
+				for (const auto output : layers[i]->Outputs)
+					last[i] = std::max<UInt>(last[i], index[output]);
+				if (layers[i]->LayerBeforeCost || layers[i]->Outputs.empty())
+					last[i] = lastStep;
+			}
+			for (auto i = 0ull; i < layerCount; i++)
+			{
+				const auto root = plan.Views[i].Root;
+				first[root] = std::min(first[root], first[i]);
+				last[root] = std::max(last[root], last[i]);
+			}
+
+			for (auto i = 0ull; i < layerCount; i++)
+			{
+				const auto& layer = layers[i];
+
+				if (layer->LayerType == LayerTypes::Cost)
+					continue;
+
+				const auto size = GetBufferSize(*layer, batchSize);
+
+				if (training)
+				{
+					plan.Blocks.push_back(MemoryBlock(i, false, size, i, masked[i] > 0ull ? masked[i] : layer->LayerBeforeCost || layer->Outputs.empty() ? lastStep : BackwardStep(layerCount, i)));
+
+					if (!layer->InplaceBwd)
+						plan.Blocks.push_back(MemoryBlock(i, true, size, firstGradientWrite[i], BackwardStep(layerCount, i)));
+				}
+				else if (plan.Views[i].Root == i)
+					plan.Blocks.push_back(MemoryBlock(i, false, size, first[i], last[i]));
+			}
+
+			for (const auto& block : plan.Blocks)
+				plan.BlocksSize += block.Size;
+
+			plan.ArenaSize = Assign(plan.Blocks);
+
+			return plan;
+		}
+
+	private:
+		static inline bool IsMerge(const Layer& layer)
+		{
+			return layer.LayerType == LayerTypes::Add || layer.LayerType == LayerTypes::Average || layer.LayerType == LayerTypes::Substract;
+		}
+
+		static inline bool SameShape(const Layer& a, const Layer& b)
+		{
+			return a.C == b.C && a.D == b.D && a.H == b.H && a.W == b.W && a.ChosenFormat == b.ChosenFormat;
+		}
+
+		static inline UInt BackwardStep(const UInt layerCount, const UInt layerIndex)
+		{
+			return 2ull * layerCount - 1ull - layerIndex;
+		}
+
+		static UInt Assign(std::vector<MemoryBlock>& blocks)
+		{
+			auto order = std::vector<UInt>(blocks.size());
+			for (auto i = 0ull; i < blocks.size(); i++)
+				order[i] = i;
+
+			std::stable_sort(order.begin(), order.end(), [&](const UInt a, const UInt b) { return blocks[a].Size > blocks[b].Size; });
+
+			auto arenaSize = UInt(0);
+			auto placed = std::vector<UInt>();
+			auto live = std::vector<UInt>();
+
+			for (const auto b : order)
+			{
+				auto& block = blocks[b];
+
+				live.clear();
+				for (const auto p : placed)
+					if (blocks[p].Overlaps(block))
+						live.push_back(p);
+
+				std::sort(live.begin(), live.end(), [&](const UInt x, const UInt y) { return blocks[x].Offset < blocks[y].Offset; });
+
+				auto offset = UInt(0);
+				for (const auto p : live)
+				{
+					if (blocks[p].Offset >= offset + block.Size)
+						break;
+
+					offset = std::max(offset, blocks[p].Offset + blocks[p].Size);
+				}
+
+				block.Offset = offset;
+				arenaSize = std::max(arenaSize, offset + block.Size);
+				placed.push_back(b);
+			}
+
+			return arenaSize;
+		}
+	};
+}
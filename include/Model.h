@@ -33,6 +33,9 @@
 #include "Softmax.h"
 #include "Substract.h"
 #include "Resampling.h"
+#include "MemoryPlanner.h"
+#include "UpdateWorker.h"
+#include "Profiler.h"
 
 
 namespace dnn
@@ -301,6 +304,8 @@ namespace dnn
 		Float TestLoss;
 		Float AvgTestLoss;
 		Float TestErrorPercentage;
+		UInt TrainErrorsTop5;
+		UInt TestErrorsTop5;
 	};
 
 	struct StatsInfo
@@ -318,6 +323,82 @@ namespace dnn
 		bool Locked;
 	};
 
+	struct ReorderInfo
+	{
+		dnnl::memory::format_tag Format;
+		UInt Forward;
+		UInt Backward;
+		UInt Layers;	// layers doing at least one reorder
+	};
+
+	struct CheckpointInfo
+	{
+		bool Enabled;
+		UInt Segments;
+		UInt Checkpoints;
+		UInt NeuronsSize;
+		UInt CheckpointNeuronsSize;
+		Float FPropTime;
+		Float BPropTime;
+		Float RecomputeTime;
+	};
+
+	struct MemoryPlanInfo
+	{
+		UInt NeuronsSize;
+		UInt InferenceSize;
+		UInt InferenceArenaSize;
+		UInt TrainingSize;
+		UInt TrainingArenaSize;
+		bool Applied;
+	};
+
+	// the forward and backward (inplace) inputs of all layers in compressed sparse rows, the inputs of layer i are [Offsets[i], Offsets[i + 1])
+	struct InputGraph
+	{
+		std::vector<UInt> Offsets;
+		std::vector<Layer*> Fwd;
+		std::vector<Layer*> Bwd;
+	};
+
+	struct StepBenchmarkInfo
+	{
+		Float Forward;		// milliseconds, medians over the iterations
+		Float Backward;
+		Float Update;
+		Float Step;
+		Float Throughput;	// samples per second
+	};
+
+	struct TTAView
+	{
+		Positions Position;
+		bool HorizontalFlip;
+		Float Scale;		// of the image before it is padded and cropped
+	};
+
+	struct TTAInfo
+	{
+		UInt Views;
+		UInt Samples;
+		Float Accuracy;		// top-1, percent
+		Float AccuracyTop5;
+		Float SampleTime;	// milliseconds, forward pass of all views of a sample
+		Float ViewTime;		// milliseconds, forward pass of one view
+	};
+
+	struct BatcherBenchmarkInfo
+	{
+		UInt Requests;
+		UInt Batches;
+		Float AvgBatchSize;
+		Float Throughput;	// requests per second
+		Float LatencyP50;	// milliseconds
+		Float LatencyP90;
+		Float LatencyP99;
+		Float LatencyMax;
+	};
+
 	
 
 	class Model
@@ -329,6 +410,14 @@ namespace dnn
 		std::vector<bool> TrainingSamplesVFlip;
 		std::vector<bool> TestingSamplesHFlip;
 		std::vector<bool> TestingSamplesVFlip;
+		FloatVector RunningStatsBackup;
+		UpdateWorker Updater;
+		Profiler Profile;
+		bool NeuronsReleased;
+		std::vector<std::vector<Layer*>> MaskedInputs;	// released after the forward pass of the layer at the index
+		FloatVector Arena;
+		bool MemoryPlanned;
+		InputGraph Graph;
 		
 	public:
 		const std::string Name;
@@ -353,12 +442,6 @@ namespace dnn
 		//UInt LogInterval;
 		UInt BatchSize;
 		UInt GoToEpoch;
-		UInt AdjustedTrainingSamplesCount;
-		UInt AdjustedTestingSamplesCount;
-		UInt TrainSkipCount;
-		UInt TestSkipCount;
-		UInt TrainOverflowCount;
-		UInt TestOverflowCount;
 		UInt C;
 		UInt D;
 		UInt H;
@@ -416,6 +499,19 @@ namespace dnn
 		std::atomic<UInt> FirstUnlockedLayer;
 		std::atomic<bool> BatchSizeChanging;
 		std::atomic<bool> ResettingWeights;
+		bool Checkpointing;
+		UInt CheckpointSegmentLength;
+		std::vector<UInt> CheckpointSegments;
+		std::chrono::duration<Float> recomputeTime;
+		bool OverlapUpdates;
+		bool FusedCost;
+		UInt DropoutSeed;	// with the training step the dropout masks are reproducible, whatever the thread count
+		UInt DropoutStep;
+		UInt WeightsSeed;	// every layer fills its weights from its own stream derived from it and the layer index
+		bool BitMasks;
+		Float EmaDecay;		// the layers keep an exponential moving average of their weights and running statistics (see Layer::SetEma)
+		bool EmaTesting;	// the test passes run with the averages
+		std::function<std::future<void>(const UInt)> Teacher;	// fills the Targets of the KullbackLeibler cost layers from the input of the training batch (see Distillation.h)
 
 		void(*NewEpoch)(UInt, UInt, UInt, UInt, Float, Float, Float, bool, bool, Float, Float, bool, Float, Float, UInt, Float, UInt, Float, Float, Float, UInt, UInt, UInt, Float, Float, Float, Float, Float, Float, UInt, Float, Float, Float, UInt);
 
@@ -505,14 +601,25 @@ namespace dnn
 			updateTime(std::chrono::duration<Float>(Float(0))),
 			SampleSpeed(Float(0)),
 			NewEpoch(nullptr),
-			AdjustedTrainingSamplesCount(0),
-			AdjustedTestingSamplesCount(0),
-			TrainOverflowCount(0),
-			TestOverflowCount(0),
-			TrainSkipCount(0),
-			TestSkipCount(0),
 			BatchSizeChanging(false),
 			ResettingWeights(false),
+			NeuronsReleased(false),
+			MaskedInputs(std::vector<std::vector<Layer*>>()),
+			MemoryPlanned(false),
+			Graph(InputGraph()),
+			Checkpointing(false),
+			CheckpointSegmentLength(0),
+			CheckpointSegments(std::vector<UInt>()),
+			recomputeTime(std::chrono::duration<Float>(Float(0))),
+			OverlapUpdates(true),
+			FusedCost(true),
+			DropoutSeed(Seed<UInt>()),
+			DropoutStep(0),
+			WeightsSeed(Seed<UInt>()),
+			BitMasks(false),
+			EmaDecay(Float(0)),
+			EmaTesting(false),
+			Teacher(nullptr),
 			FirstUnlockedLayer(1),
 			UseTrainingStrategy(false),
 			TrainingStrategies(std::vector<TrainingStrategy>())
@@ -524,19 +631,24 @@ namespace dnn
 			dnnl_set_verbose(0);
 #endif
 
+			// the isa can only be set before the first primitive is created, several models (inference sessions) can live side by side
+			static std::once_flag isaFlag;
+			std::call_once(isaFlag, []()
+			{
 #if defined(DNN_AVX512BW) || defined(DNN_AVX512)
-			dnnl::set_max_cpu_isa(dnnl::cpu_isa::all);
-			dnnl::set_cpu_isa_hints(dnnl::cpu_isa_hints::prefer_ymm);
+				dnnl::set_max_cpu_isa(dnnl::cpu_isa::all);
+				dnnl::set_cpu_isa_hints(dnnl::cpu_isa_hints::prefer_ymm);
 #elif defined(DNN_AVX2)
-			dnnl::set_max_cpu_isa(dnnl::cpu_isa::avx2);
-			dnnl::set_cpu_isa_hints(dnnl::cpu_isa_hints::prefer_ymm);
+				dnnl::set_max_cpu_isa(dnnl::cpu_isa::avx2);
+				dnnl::set_cpu_isa_hints(dnnl::cpu_isa_hints::prefer_ymm);
 #elif defined(DNN_AVX)
-			dnnl::set_max_cpu_isa(dnnl::cpu_isa::avx);
-			dnnl::set_cpu_isa_hints(dnnl::cpu_isa_hints::prefer_ymm);
+				dnnl::set_max_cpu_isa(dnnl::cpu_isa::avx);
+				dnnl::set_cpu_isa_hints(dnnl::cpu_isa_hints::prefer_ymm);
 #elif defined(DNN_SSE42) || defined(DNN_SSE41)
-			dnnl::set_max_cpu_isa(dnnl::cpu_isa::sse41);
-			dnnl::set_cpu_isa_hints(dnnl::cpu_isa_hints::no_hints);
+				dnnl::set_max_cpu_isa(dnnl::cpu_isa::sse41);
+				dnnl::set_cpu_isa_hints(dnnl::cpu_isa_hints::no_hints);
 #endif
+			});
 			//dnnl::set_primitive_cache_capacity(1000);
 			//dnnl::set_default_fpmath_mode(dnnl::fpmath_mode::any);
 		}
@@ -563,6 +675,155 @@ namespace dnn
 			return neuronsSize;
 		}
 
+		// peak activation memory of a training step when only the checkpoints and one recomputed segment are resident
+		auto GetCheckpointNeuronsSize(const UInt batchSize) const
+		{
+			UInt neuronsSize = 0;
+			UInt segmentSize = 0;
+			UInt peakSegmentSize = 0;
+
+			auto segment = 0ull;
+			for (auto i = 0ull; i < Layers.size(); i++)
+			{
+				neuronsSize += Layers[i]->GetNeuronsSize(batchSize);
+
+				if (!Layers[i]->Checkpoint)
+				{
+					const auto size = batchSize * Layers[i]->PaddedCDHW() * sizeof(Float);
+					neuronsSize -= size;
+					segmentSize += size;
+				}
+
+				if (segment < CheckpointSegments.size() && i == CheckpointSegments[segment])
+				{
+					peakSegmentSize = std::max(peakSegmentSize, segmentSize);
+					segmentSize = 0;
+					segment++;
+				}
+			}
+
+			return neuronsSize + peakSegmentSize;
+		}
+
+		auto GetMemoryPlanInfo() const
+		{
+			const auto inference = MemoryPlanner::Plan(Layers, BatchSize, false);
+			const auto training = MemoryPlanner::Plan(Layers, BatchSize, true);
+
+			auto info = MemoryPlanInfo();
+			info.NeuronsSize = GetNeuronsSize(BatchSize);
+			info.InferenceSize = inference.BlocksSize;
+			info.InferenceArenaSize = inference.ArenaSize;
+			info.TrainingSize = training.BlocksSize;
+			info.TrainingArenaSize = training.ArenaSize;
+			info.Applied = MemoryPlanned;
+
+			return info;
+		}
+
+		// a Concat whose inputs all live in its output, or a ChannelSplit living in its input, has nothing left to copy
+		// and a merge layer sharing its Neurons with the Activation or BatchNormActivation behind it runs that one as well
+		void SetZeroCopy(const bool enable)
+		{
+			for (auto& layer : Layers)
+			{
+				if (layer->LayerType == LayerTypes::ChannelSplit)
+				{
+					auto split = dynamic_cast<ChannelSplit*>(layer.get());
+					split->ZeroCopy = enable && split->Neurons.data() == split->InputLayer->Neurons.data() + (split->Group - 1ull) * split->C * split->HW();
+				}
+				else if (layer->LayerType == LayerTypes::Concat)
+				{
+					auto concat = dynamic_cast<Concat*>(layer.get());
+					auto zeroCopy = enable;
+					auto channelOffset = 0ull;
+					for (const auto input : concat->Inputs)
+					{
+						zeroCopy &= input->Neurons.data() == concat->Neurons.data() + channelOffset * concat->HW();
+						channelOffset += concat->IsPlainFormat() ? input->C : input->PaddedC;
+					}
+
+					concat->ZeroCopy = zeroCopy;
+				}
+				else if (layer->LayerType == LayerTypes::Add)
+					dynamic_cast<Add*>(layer.get())->Epilogue.Set(*layer, enable);
+				else if (layer->LayerType == LayerTypes::Average)
+					dynamic_cast<Average*>(layer.get())->Epilogue.Set(*layer, enable);
+				else if (layer->LayerType == LayerTypes::Substract)
+					dynamic_cast<Substract*>(layer.get())->Epilogue.Set(*layer, enable);
+			}
+		}
+
+		// forward-only: the Neurons share one planned arena and the gradients are released until the next training or resolution change.
+		// The arena can be a buffer of another model that is large enough and never runs at the same time as this one.
+		bool ApplyMemoryPlan(const Float* arena = nullptr, const UInt arenaSize = 0ull)
+		{
+			if (TaskState.load() != TaskStates::Stopped || BatchSizeChanging.load() || ResettingWeights.load())
+				return false;
+
+			ReleaseMemoryPlan();
+
+			const auto plan = MemoryPlanner::Plan(Layers, BatchSize, false);
+			if (arena && arenaSize >= plan.ArenaSize / sizeof(Float))
+				Arena = View<FloatVector>(arena, plan.ArenaSize / sizeof(Float));
+			else
+				Arena = FloatVector(plan.ArenaSize / sizeof(Float));
+
+			for (const auto& block : plan.Blocks)
+			{
+				auto& layer = Layers[block.LayerIndex];
+
+				layer->Neurons.bind(dnnl::memory::desc(dnnl::memory::dims({ dnnl::memory::dim(BatchSize), dnnl::memory::dim(layer->C), dnnl::memory::dim(layer->H), dnnl::memory::dim(layer->W) }), dnnl::memory::data_type::f32, BlockedFmt), Device.engine, Arena.data() + block.Offset / sizeof(Float));
+				
+				// ChannelZeroPad clears its gradient in the inference pass as well
+				if (layer->LayerType != LayerTypes::ChannelZeroPad)
+					layer->NeuronsD1.release();
+			}
+
+			// zero-copy Concat/ChannelSplit and in-place merges: the views are bound inside their root once all roots have their place
+			for (auto i = 0ull; i < Layers.size(); i++)
+			{
+				const auto& view = plan.Views[i];
+				if (view.Root == i)
+					continue;
+
+				auto& layer = Layers[i];
+				layer->Neurons.bind(dnnl::memory::desc(dnnl::memory::dims({ dnnl::memory::dim(BatchSize), dnnl::memory::dim(layer->C), dnnl::memory::dim(layer->H), dnnl::memory::dim(layer->W) }), dnnl::memory::data_type::f32, BlockedFmt), Device.engine, Layers[view.Root]->Neurons.data() + view.Offset);
+
+				if (layer->LayerType != LayerTypes::ChannelZeroPad)
+					layer->NeuronsD1.release();
+			}
+			SetZeroCopy(true);
+
+			for (auto& layer : Layers)
+				layer->InitializeDescriptors(BatchSize);
+
+			MemoryPlanned = true;
+
+			return true;
+		}
+
+		// the planned activations, another model can place its own in them (see ApplyMemoryPlan)
+		const FloatVector& GetArena() const { return Arena; }
+
+		void ReleaseMemoryPlan()
+		{
+			if (MemoryPlanned)
+			{
+				for (auto& layer : Layers)
+					if (layer->LayerType != LayerTypes::Cost)
+						layer->Neurons.release();
+
+				SetZeroCopy(false);
+
+				for (auto& layer : Layers)
+					layer->SetBatchSize(BatchSize);
+
+				Arena = FloatVector();
+				MemoryPlanned = false;
+			}
+		}
+
 		void SaveDefinition(const std::string& fileName)
 		{
 			std::fstream file;
@@ -584,6 +845,116 @@ namespace dnn
 			return false;
 		}
 
+		// true for the layers whose Neurons are released during a training step, by checkpointing or after the forward pass
+		// of a bit mask activation, a reserved buffer would stay allocated through release()
+		bool ReleasesNeurons(const Layer* layer) const
+		{
+			if (!layer->Checkpoint)
+				return true;
+
+			for (const auto& inputs : MaskedInputs)
+				if (std::find(inputs.begin(), inputs.end(), layer) != inputs.end())
+					return true;
+
+			return false;
+		}
+
+		// The activations of every layer are reserved at the largest shape of the training schedule, a change of batch
+		// size or resolution then rebinds the reserved buffers instead of reallocating them. Only the memory is kept, the
+		// layers rebuild their descriptors and primitives on every change of shape. Layers that release their Neurons keep
+		// freeing their memory.
+		void ReserveShapes()
+		{
+			if (TrainingRates.empty())
+				return;
+
+			const auto h = Layers[0]->H;
+			const auto w = Layers[0]->W;
+
+			auto sizes = std::vector<UInt>(Layers.size(), 0ull);
+			for (const auto& rate : TrainingRates)
+			{
+				Layers[0]->H = rate.Height;
+				Layers[0]->W = rate.Width;
+				for (auto& layer : Layers)
+					layer->UpdateResolution();
+
+				for (auto i = 0ull; i < Layers.size(); i++)
+					sizes[i] = std::max(sizes[i], MemoryPlanner::GetBufferSize(*Layers[i], rate.BatchSize) / sizeof(Float));
+			}
+
+			Layers[0]->H = h;
+			Layers[0]->W = w;
+			for (auto& layer : Layers)
+				layer->UpdateResolution();
+
+			for (auto i = 0ull; i < Layers.size(); i++)
+			{
+				auto& layer = Layers[i];
+				if (layer->LayerType == LayerTypes::Cost || ReleasesNeurons(layer.get()))
+					continue;
+
+				layer->Neurons.reserve(sizes[i], Device.engine);
+#ifndef DNN_LEAN
+				if (!layer->InplaceBwd)
+					layer->NeuronsD1.reserve(sizes[i], Device.engine);
+#endif
+			}
+		}
+
+		// A batch normalization has no batch statistics of a single sample, so with one in the model a tail batch of one sample
+		// is left out of the training pass. The samples are shuffled in every epoch, another one is left out each time.
+		UInt GetTrainingPassSamples(const UInt batchSize) const
+		{
+			const auto samples = DataProv->TrainingSamplesCount;
+			const auto batchNorm = std::any_of(Layers.begin(), Layers.end(), [](const std::unique_ptr<Layer>& layer) { return layer->IsBatchNorm(); });
+
+			return batchNorm && samples > batchSize && samples % batchSize == 1ull ? samples - 1ull : samples;
+		}
+
+		// The last batch of a pass runs at its real size instead of being padded with samples from the start of the set,
+		// so the padding adds no loss, gradients or batch statistics. The activations keep the buffers of the full batch
+		// (a smaller batch is a prefix of them), the descriptors and primitives of every layer are rebuilt.
+		void SwitchBatchSize(const UInt batchSize)
+		{
+			if (batchSize == BatchSize || batchSize < 1)
+				return;
+
+			if (MemoryPlanned)
+			{
+				for (auto& layer : Layers)
+				{
+					if (layer->LayerType == LayerTypes::Cost)
+						layer->SetBatchSize(batchSize);
+					else
+					{
+						layer->Neurons.bind(dnnl::memory::desc(dnnl::memory::dims({ dnnl::memory::dim(batchSize), dnnl::memory::dim(layer->C), dnnl::memory::dim(layer->H), dnnl::memory::dim(layer->W) }), dnnl::memory::data_type::f32, BlockedFmt), Device.engine, layer->Neurons.data());
+						layer->InitializeDescriptors(batchSize);
+					}
+				}
+			}
+			else
+			{
+				// the same layers as ReserveShapes, the ones that release their Neurons keep freeing them
+				if (batchSize < BatchSize)
+					for (auto& layer : Layers)
+					{
+						if (layer->LayerType == LayerTypes::Cost || ReleasesNeurons(layer.get()))
+							continue;
+
+						layer->Neurons.reserve(layer->Neurons.size(), Device.engine);
+#ifndef DNN_LEAN
+						if (!layer->InplaceBwd)
+							layer->NeuronsD1.reserve(layer->NeuronsD1.size(), Device.engine);
+#endif
+					}
+
+				InitializeLayers(batchSize);
+			}
+
+			BatchSize = batchSize;
+		}
+
 		bool ChangeResolution(const UInt batchSize, const UInt h, const UInt w, const UInt padH, const UInt padW)
 		{
 			if (batchSize < 1 || h < 1 || w < 1 || padH < 1 || padW < 1)
@@ -596,6 +967,8 @@ namespace dnn
 
 				return true;
 			}
+
+			ReleaseMemoryPlan();
 						
 			const auto currentSize = GetNeuronsSize(BatchSize) + GetWeightsSize(PersistOptimizer, Optimizer);
 
@@ -634,15 +1007,11 @@ namespace dnn
 				}
 			}
 
-			for (auto& layer : Layers)
-				layer->SetBatchSize(batchSize);
-				
-			AdjustedTrainingSamplesCount = (DataProv->TrainingSamplesCount % batchSize == 0) ? DataProv->TrainingSamplesCount : ((DataProv->TrainingSamplesCount / batchSize) + 1) * batchSize;
-			AdjustedTestingSamplesCount = (DataProv->TestingSamplesCount % batchSize == 0) ? DataProv->TestingSamplesCount : ((DataProv->TestingSamplesCount / batchSize) + 1) * batchSize;
-			TrainSkipCount = batchSize - (AdjustedTrainingSamplesCount - DataProv->TrainingSamplesCount);
-			TestSkipCount = batchSize - (AdjustedTestingSamplesCount - DataProv->TestingSamplesCount);
-			TrainOverflowCount = AdjustedTrainingSamplesCount - batchSize;
-			TestOverflowCount = AdjustedTestingSamplesCount - batchSize;;
+			InitializeLayers(batchSize);
+
+			const auto reorders = GetReorders();
+			if (reorders.Layers > 0ull)
+				std::cout << std::string("Reorders: ") << std::to_string(reorders.Forward) << std::string(" forward, ") << std::to_string(reorders.Backward) << std::string(" backward per step in ") << std::to_string(reorders.Layers) << std::string(" layers") << std::endl << std::endl;
 
 			BatchSize = batchSize;
 			H = h;
@@ -655,6 +1024,20 @@ namespace dnn
 			return true;
 		}
 
+		// the next training step draws fresh dropout masks, its backward pass regenerates the same ones
+		void NextDropoutStep()
+		{
+			DropoutStep++;
+
+			for (auto& layer : Layers)
+			{
+				if (layer->LayerType == LayerTypes::BatchNormActivationDropout)
+					dynamic_cast<BatchNormActivationDropout*>(layer.get())->SetStep(DropoutSeed, DropoutStep);
+				else if (layer->LayerType == LayerTypes::Dropout)
+					dynamic_cast<dnn::Dropout*>(layer.get())->SetStep(DropoutSeed, DropoutStep);
+			}
+		}
+
 		void ChangeDropout(const Float dropout, const UInt batchSize)
 		{
 			if (dropout < 0 || dropout >= 1)
@@ -694,13 +1077,13 @@ namespace dnn
 			Dropout = dropout;
 		}
 
+		// the plain format is a hint, the layout is negotiated for the whole network in NegotiateFormats
 		bool SetFormat(bool plain = false)
 		{
 			if (TaskState.load() == TaskStates::Stopped)
 			{
 				Format = plain ? dnnl::memory::format_tag::nchw : dnnl::memory::format_tag::any;
-				for (auto& layer : Layers)
-					layer->Format = Format;
+				NegotiateFormats();
 				
 				return true;
 			}
@@ -708,22 +1091,279 @@ namespace dnn
 			    return false;
 		}
 
+		// One layout end-to-end: the layers building their oneDNN primitive from Format are pinned to the negotiated layout, 
+		// every other layer runs natively in the layout of its input (plain and blocked kernels). The layers right after the 
+		// Input keep format any, their primitive reads the plain input without a reorder. Where a primitive can't be created 
+		// in the negotiated layout the layer falls back to any when its descriptors are initialized (see InitializeFormat).
+		void NegotiateFormats()
+		{
+			const auto layout = Format == dnnl::memory::format_tag::any ? BlockedFmt : PlainFmt;
+
+			for (auto& layer : Layers)
+			{
+				switch (layer->LayerType)
+				{
+				case LayerTypes::Convolution:
+				case LayerTypes::ConvolutionTranspose:
+				case LayerTypes::DepthwiseConvolution:
+				case LayerTypes::PartialDepthwiseConvolution:
+				case LayerTypes::Resampling:
+					layer->Format = layer->InputLayer->LayerType == LayerTypes::Input ? dnnl::memory::format_tag::any : layout;
+					break;
+
+				case LayerTypes::Dense:
+					layer->Format = Format;
+					break;
+
+				default:
+					layer->Format = dnnl::memory::format_tag::any;
+				}
+			}
+		}
+
+		void InitializeFormat(Layer& layer, const UInt batchSize)
+		{
+			try
+			{
+				layer.SetBatchSize(batchSize);
+			}
+			catch (const dnnl::error&)
+			{
+				if (layer.Format == dnnl::memory::format_tag::any)
+					throw;
+
+				layer.Format = dnnl::memory::format_tag::any;
+				layer.SetBatchSize(batchSize);
+			}
+		}
+
+		// A layer only depends on its inputs: the layers are grouped in waves, one past the deepest wave of their inputs,
+		// and the descriptors of a wave (primitive descriptors and JIT code generation) are created concurrently.
+		std::vector<std::vector<UInt>> GetWaves() const
+		{
+			auto index = std::unordered_map<const Layer*, UInt>();
+			for (auto i = 0ull; i < Layers.size(); i++)
+				index[Layers[i].get()] = i;
+
+			auto depth = std::vector<UInt>(Layers.size(), 0ull);
+			auto waves = std::vector<std::vector<UInt>>();
+			for (auto i = 0ull; i < Layers.size(); i++)
+			{
+				for (const auto inputs : { &Layers[i]->InputsFwd, &Layers[i]->InputsBwd })
+					for (const auto input : *inputs)
+					{
+						const auto j = index.find(input);
+						if (j != index.end() && j->second < i)
+							depth[i] = std::max<UInt>(depth[i], depth[j->second] + 1ull);
+					}
+
+				if (waves.size() <= depth[i])
+					waves.resize(depth[i] + 1ull);
+				waves[depth[i]].push_back(i);
+			}
+
+			return waves;
+		}
+
+		void InitializeLayers(const UInt batchSize)
+		{
+			for (const auto& wave : GetWaves())
+			{
+				auto errors = std::vector<std::exception_ptr>(wave.size());
+
+				for_i(wave.size(), std::min<UInt>(wave.size(), MAX_THREADS), [&](const UInt i)
+				{
+					try
+					{
+						InitializeFormat(*Layers[wave[i]], batchSize);
+					}
+					catch (...)
+					{
+						errors[i] = std::current_exception();
+					}
+				});
+
+				for (const auto& error : errors)
+					if (error)
+						std::rethrow_exception(error);
+			}
+		}
+
+		ReorderInfo GetReorders() const
+		{
+			auto info = ReorderInfo{ Format == dnnl::memory::format_tag::any ? BlockedFmt : PlainFmt, 0ull, 0ull, 0ull };
+
+			for (const auto& layer : Layers)
+			{
+				const auto forward = layer->ForwardReorders();
+				const auto backward = layer->BackwardReorders();
+
+				info.Forward += forward;
+				info.Backward += backward;
+				if (forward + backward > 0ull)
+					info.Layers++;
+			}
+
+			return info;
+		}
+
+		// Times training steps (forward, backward and the optimizer) on random inputs and labels without a dataprovider.
+		// Each layer keeps the median of its own timers in fpropTime, bpropTime and updateTime.
+		StepBenchmarkInfo BenchmarkStep(const UInt batchSize, const UInt iterations)
+		{
+			auto timer = std::chrono::high_resolution_clock();
+
+			ReleaseMemoryPlan();
+			InitializeLayers(batchSize);
+			BatchSize = batchSize;
+			SetMaskedInputs();
+
+			const auto inputSize = batchSize * Layers[0]->PaddedCDHW();
+			for (auto i = 0ull; i < inputSize; i++)
+				Layers[0]->Neurons[i] = UniformReal<Float>(Float(-1), Float(1));
+
+			auto classes = std::vector<UInt>();
+			for (const auto cost : CostLayers)
+			{
+				if (classes.size() <= cost->LabelIndex)
+					classes.resize(cost->LabelIndex + 1ull, std::numeric_limits<UInt>::max());
+				classes[cost->LabelIndex] = std::min(classes[cost->LabelIndex], cost->C);
+			}
+
+			auto labels = std::vector<std::vector<LabelInfo>>(batchSize, std::vector<LabelInfo>(classes.size()));
+			for (auto& sample : labels)
+				for (auto index = 0ull; index < classes.size(); index++)
+				{
+					const auto label = UniformInt<UInt>(0ull, classes[index] - 1ull);
+					sample[index] = LabelInfo{ label, label, Float(1) };
+				}
+			for (const auto cost : CostLayers)
+				cost->SetSampleLabels(labels);
+
+			const auto layerCount = Layers.size();
+			auto forward = std::vector<std::vector<Float>>(layerCount);
+			auto backward = std::vector<std::vector<Float>>(layerCount);
+			auto update = std::vector<std::vector<Float>>(layerCount);
+			auto steps = std::vector<StepBenchmarkInfo>();
+
+			const auto ms = [](const std::chrono::duration<Float>& duration) { return duration.count() * Float(1000); };
+			const auto median = [](std::vector<Float> values)
+			{
+				if (values.empty())
+					return Float(0);
+
+				std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+				return values[values.size() / 2];
+			};
+
+			// the first step warms up the primitives and the caches
+			for (auto iteration = 0ull; iteration <= iterations; iteration++)
+			{
+				auto step = StepBenchmarkInfo{ Float(0), Float(0), Float(0), Float(0), Float(0) };
+				const auto timePointGlobal = timer.now();
+
+				for (auto i = 1ull; i < layerCount; i++)
+				{
+					Layers[i]->RestoreNeurons(batchSize);
+
+					const auto timePoint = timer.now();
+					Layers[i]->ForwardProp(batchSize, true);
+					Layers[i]->fpropTime = timer.now() - timePoint;
+					step.Forward += ms(Layers[i]->fpropTime);
+
+					ReleaseMaskedInputs(i);
+				}
+
+				SwitchInplaceBwd(true);
+				for (auto i = layerCount - 1ull; i > 0ull; i--)
+				{
+					auto timePoint = timer.now();
+					if (Layers[i]->HasWeights)
+						Layers[i]->ResetGradients();
+					Layers[i]->BackwardProp(batchSize);
+					Layers[i]->bpropTime = timer.now() - timePoint;
+					step.Backward += ms(Layers[i]->bpropTime);
+
+					Layers[i]->updateTime = std::chrono::duration<Float>(Float(0));
+					if (Layers[i]->HasWeights)
+					{
+						timePoint = timer.now();
+						Layers[i]->UpdateWeights(CurrentTrainingRate, Optimizer, DisableLocking);
+						Layers[i]->updateTime = timer.now() - timePoint;
+						step.Update += ms(Layers[i]->updateTime);
+					}
+				}
+				SwitchInplaceBwd(false);
+
+				step.Step = ms(timer.now() - timePointGlobal);
+
+				if (iteration > 0ull)
+				{
+					steps.push_back(step);
+					for (auto i = 1ull; i < layerCount; i++)
+					{
+						forward[i].push_back(ms(Layers[i]->fpropTime));
+						backward[i].push_back(ms(Layers[i]->bpropTime));
+						update[i].push_back(ms(Layers[i]->updateTime));
+					}
+				}
+			}
+
+			for (auto i = 1ull; i < layerCount; i++)
+			{
+				Layers[i]->fpropTime = std::chrono::duration<Float>(median(forward[i]) / Float(1000));
+				Layers[i]->bpropTime = std::chrono::duration<Float>(median(backward[i]) / Float(1000));
+				Layers[i]->updateTime = std::chrono::duration<Float>(median(update[i]) / Float(1000));
+			}
+
+			auto values = std::vector<Float>();
+			const auto stepMedian = [&](Float StepBenchmarkInfo::* field)
+			{
+				values.clear();
+				for (const auto& step : steps)
+					values.push_back(step.*field);
+				return median(values);
+			};
+
+			auto info = StepBenchmarkInfo{ stepMedian(&StepBenchmarkInfo::Forward), stepMedian(&StepBenchmarkInfo::Backward), stepMedian(&StepBenchmarkInfo::Update), stepMedian(&StepBenchmarkInfo::Step), Float(0) };
+			info.Throughput = info.Step > Float(0) ? Float(batchSize) * Float(1000) / info.Step : Float(0);
+
+			return info;
+		}
+
 		void ResetWeights()
 		{
 			if (!BatchSizeChanging.load() && !ResettingWeights.load())
 			{
 				ResettingWeights.store(true);
 
-				for (auto& layer : Layers)
+				auto errors = std::vector<std::exception_ptr>(Layers.size());
+
+				for_i_dynamic(Layers.size(), MAX_THREADS, [&](const UInt i)
 				{
+					auto& layer = Layers[i];
+
 					while (layer->RefreshingStats.load())
 						std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
-					layer->ResetWeights(WeightsFiller, WeightsFillerMode, WeightsGain, WeightsScale, BiasesFiller, BiasesFillerMode, BiasesGain, BiasesScale);
-					layer->ResetOptimizer(Optimizer);
-				}
+					try
+					{
+						layer->SeedRandomEngine(WeightsSeed, i);
+						layer->ResetWeights(WeightsFiller, WeightsFillerMode, WeightsGain, WeightsScale, BiasesFiller, BiasesFillerMode, BiasesGain, BiasesScale);
+						layer->ResetOptimizer(Optimizer);
+						layer->SetEma(EmaDecay);
+					}
+					catch (...)
+					{
+						errors[i] = std::current_exception();
+					}
+				});
 
 				ResettingWeights.store(false);
+
+				for (const auto& error : errors)
+					if (error)
+						std::rethrow_exception(error);
 			}
 		}
 
@@ -1123,64 +1763,179 @@ namespace dnn
 		}
 #endif
 
-		void CostFunctionBatch(const States state, const UInt batchSize, const bool overflow, const UInt skipCount)
+		// a decay of 0 disables the averages, otherwise they start from the current weights
+		bool SetEma(const Float decay)
+		{
+			if (TaskState.load() != TaskStates::Stopped || decay < Float(0) || decay >= Float(1))
+				return false;
+
+			EmaDecay = decay;
+			for (auto& layer : Layers)
+				layer->SetEma(decay);
+
+			return true;
+		}
+
+		// puts the averages (ema = true) or the trained weights in place, without copying
+		void SwapEma(const bool ema)
+		{
+			for (auto& layer : Layers)
+				if (layer->EmaSwapped != ema)
+					layer->SwapEma();
+		}
+
+		// replaces the Softmax/LogSoftmax -> Cost -> CostFunctionBatch -> RecognizedBatch passes with Cost::ForwardPropFused where the graph allows it.
+		// Only the forward pass is fused: the backward pass still runs Cost::BackwardProp and the Softmax/LogSoftmax backward
+		// on the outputs the fused pass wrote, and the logits stay a checkpoint (see SetCheckpoints).
+		void FuseCostLayers()
 		{
 			for (auto cost : CostLayers)
 			{
-				for (auto b = 0ull; b < batchSize; b++)
+				cost->Fused = FusedCost && cost->CanFuse();
+
+				if (cost->InputLayer->LayerType == LayerTypes::Softmax)
+					dynamic_cast<Softmax*>(cost->InputLayer)->FusedWithCost = cost->Fused;
+				else if (cost->InputLayer->LayerType == LayerTypes::LogSoftmax)
+					dynamic_cast<LogSoftmax*>(cost->InputLayer)->FusedWithCost = cost->Fused;
+			}
+		}
+
+		void CostFunctionBatch(const States state, const UInt batchSize)
+		{
+			for (auto cost : CostLayers)
+			{
+				if (cost->Fused)
 				{
-					if (overflow && b >= skipCount)
-						return;
+					auto loss = Float(0);
+					for (auto b = 0ull; b < batchSize; b++)
+						loss += cost->SampleLoss[b] * cost->Weight;
+
+					if (state == States::Training)
+						cost->TrainLoss += loss;
+					else
+						cost->TestLoss += loss;
 
+					continue;
+				}
+
+				for (auto b = 0ull; b < batchSize; b++)
+				{
 					const auto batchOffset = b * cost->C;
 					auto loss = Float(0);
 
 					for (auto i = 0ull; i < cost->C; i++)
 						loss += cost->Neurons[batchOffset + i] * cost->Weight;
 
-					if (state == States::Training)
-						cost->TrainLoss += loss;
-					else
-						cost->TestLoss += loss;
+					if (state == States::Training)
+						cost->TrainLoss += loss;
+					else
+						cost->TestLoss += loss;
+				}
+			}
+		}
+
+		void RecognizedBatch(const States state, const UInt batchSize, const std::vector<std::vector<LabelInfo>>& sampleLabels)
+		{
+			for (auto cost : CostLayers)
+			{
+				const auto &inputLayer = cost->InputLayer;
+				const auto labelIndex = cost->LabelIndex;
+
+				for (auto b = 0ull; b < batchSize; b++)
+				{
+					const auto sampleOffset = b * inputLayer->C;
+					const auto label = sampleLabels[b][labelIndex].LabelA;
+
+					auto hotIndex = 0ull;
+					auto top5 = true;
+					if (cost->Fused)
+					{
+						hotIndex = cost->SampleHot[b];
+						top5 = cost->SampleTop5[b] != 0;
+					}
+					else
+					{
+						auto maxValue = std::numeric_limits<Float>::lowest();
+						auto greater = 0ull;
+						for (auto i = 0ull; i < inputLayer->C; i++)
+						{
+							if (inputLayer->Neurons[i + sampleOffset] > maxValue)
+							{
+								maxValue = inputLayer->Neurons[i + sampleOffset];
+								hotIndex = i;
+							}
+							if (inputLayer->Neurons[i + sampleOffset] > inputLayer->Neurons[label + sampleOffset])
+								greater++;
+						}
+						top5 = greater < 5ull;
+					}
+
+					if (hotIndex != label)
+					{
+						if (state == States::Training)
+							cost->TrainErrors++;
+						else
+							cost->TestErrors++;
+					}
+
+					if (!top5)
+					{
+						if (state == States::Training)
+							cost->TrainErrorsTop5++;
+						else
+							cost->TestErrorsTop5++;
+					}
+
+					if (state == States::Testing)
+						cost->ConfusionMatrix[hotIndex][sampleLabels[b][labelIndex].LabelA]++;
 				}
 			}
 		}
 
-		void RecognizedBatch(const States state, const UInt batchSize, const bool overflow, const UInt skipCount, const std::vector<std::vector<LabelInfo>>& sampleLabels)
+		// the views of a sample are adjacent in the batch, their outputs are summed before the sample is scored
+		void RecognizedTTA(const UInt samples, const UInt views, const bool logits, const std::vector<std::vector<LabelInfo>>& sampleLabels)
 		{
 			for (auto cost : CostLayers)
 			{
-				const auto &inputLayer = cost->InputLayer;
+				const auto softmax = cost->InputLayer->LayerType == LayerTypes::Softmax || cost->InputLayer->LayerType == LayerTypes::LogSoftmax;
+				const auto outputLayer = logits && softmax ? cost->InputLayer->InputLayer : cost->InputLayer;
 				const auto labelIndex = cost->LabelIndex;
+				const auto channels = outputLayer->C;
 
-				for (auto b = 0ull; b < batchSize; b++)
+				auto outputs = std::vector<Float>(channels);
+				for (auto s = 0ull; s < samples; s++)
 				{
-					if (overflow && b >= skipCount)
-						return;
+					std::fill(outputs.begin(), outputs.end(), Float(0));
+					for (auto v = 0ull; v < views; v++)
+					{
+						const auto sampleOffset = (s * views + v) * channels;
+						for (auto i = 0ull; i < channels; i++)
+							outputs[i] += outputLayer->Neurons[i + sampleOffset];
+					}
 
-					const auto sampleOffset = b * inputLayer->C;
+					const auto label = sampleLabels[s * views][labelIndex].LabelA;
 
-					auto hotIndex = 0ull;
 					auto maxValue = std::numeric_limits<Float>::lowest();
-					for (auto i = 0ull; i < inputLayer->C; i++)
+					auto hotIndex = 0ull;
+					auto greater = 0ull;
+					for (auto i = 0ull; i < channels; i++)
 					{
-						if (inputLayer->Neurons[i + sampleOffset] > maxValue)
+						if (outputs[i] > maxValue)
 						{
-							maxValue = inputLayer->Neurons[i + sampleOffset];
+							maxValue = outputs[i];
 							hotIndex = i;
 						}
+						if (outputs[i] > outputs[label])
+							greater++;
 					}
 
-					if (hotIndex != sampleLabels[b][labelIndex].LabelA)
-					{
-						if (state == States::Training)
-							cost->TrainErrors++;
-						else
-							cost->TestErrors++;
-					}
+					if (hotIndex != label)
+						cost->TestErrors++;
 
-					if (state == States::Testing)
-						cost->ConfusionMatrix[hotIndex][sampleLabels[b][labelIndex].LabelA]++;
+					if (greater >= 5ull)
+						cost->TestErrorsTop5++;
+
+					cost->ConfusionMatrix[hotIndex][label]++;
 				}
 			}
 		}
@@ -1195,13 +1950,6 @@ namespace dnn
 				for (auto &layer : Layers)
 					layer->SetBatchSize(batchSize);
 
-				AdjustedTrainingSamplesCount = (DataProv->TrainingSamplesCount % batchSize == 0) ? DataProv->TrainingSamplesCount : ((DataProv->TrainingSamplesCount / batchSize) + 1) * batchSize;
-				AdjustedTestingSamplesCount = (DataProv->TestingSamplesCount % batchSize == 0) ? DataProv->TestingSamplesCount : ((DataProv->TestingSamplesCount / batchSize) + 1) * batchSize;
-				TrainSkipCount = batchSize - (AdjustedTrainingSamplesCount - DataProv->TrainingSamplesCount);
-				TestSkipCount = batchSize - (AdjustedTestingSamplesCount - DataProv->TestingSamplesCount);
-				TrainOverflowCount = AdjustedTrainingSamplesCount - batchSize;
-				TestOverflowCount = AdjustedTestingSamplesCount - batchSize;;
-
 				BatchSize = batchSize;
 
 				BatchSizeChanging.store(false);
@@ -1213,21 +1961,34 @@ namespace dnn
 		{
 			if constexpr (Inplace)
 			{
-				if (enable)
-					for (auto& layer : Layers)
-					{
-						layer->Inputs = std::vector<Layer*>(layer->InputsBwd);
-						layer->InputLayer = layer->InputLayerBwd;
-						layer->SharesInput = layer->SharesInputInplace;
-					}
-				else
-					for (auto& layer : Layers)
-					{
-						layer->Inputs = std::vector<Layer*>(layer->InputsFwd);
-						layer->InputLayer = layer->InputLayerFwd;
-						layer->SharesInput = layer->SharesInputOriginal;
-					}
+				const auto& inputs = enable ? Graph.Bwd : Graph.Fwd;
+
+				for (auto i = 0ull; i < Layers.size(); i++)
+				{
+					auto& layer = Layers[i];
+					layer->Inputs = LayerInputs(inputs.data() + Graph.Offsets[i], Graph.Offsets[i + 1] - Graph.Offsets[i]);
+					layer->InputLayer = enable ? layer->InputLayerBwd : layer->InputLayerFwd;
+					layer->SharesInput = enable ? layer->SharesInputInplace : layer->SharesInputOriginal;
+				}
+			}
+		}
+
+		// SwitchInplaceBwd runs twice per training step, with the adjacency in one place it only moves the views of the layers
+		void BuildInputGraph()
+		{
+			Graph = InputGraph();
+			Graph.Offsets.reserve(Layers.size() + 1ull);
+			Graph.Offsets.push_back(0ull);
+
+			for (const auto& layer : Layers)
+			{
+				Graph.Fwd.insert(Graph.Fwd.end(), layer->InputsFwd.begin(), layer->InputsFwd.end());
+				Graph.Bwd.insert(Graph.Bwd.end(), layer->InputsBwd.begin(), layer->InputsBwd.end());
+				Graph.Offsets.push_back(Graph.Fwd.size());
 			}
+
+			for (auto i = 0ull; i < Layers.size(); i++)
+				Layers[i]->Inputs = LayerInputs(Graph.Fwd.data() + Graph.Offsets[i], Graph.Offsets[i + 1] - Graph.Offsets[i]);
 		}
 
 		auto IsSkippable(const Layer& layer) const
@@ -1310,6 +2071,237 @@ namespace dnn
 			}
 		}
 
+		std::pair<FloatVector*, FloatVector*> GetRunningStats(Layer* layer) const
+		{
+			switch (layer->LayerType)
+			{
+			case LayerTypes::BatchNorm:
+			{
+				auto bn = dynamic_cast<BatchNorm*>(layer);
+				return { &bn->RunningMean, &bn->RunningVariance };
+			}
+			case LayerTypes::BatchNormActivation:
+			{
+				auto bn = dynamic_cast<BatchNormActivation*>(layer);
+				return { &bn->RunningMean, &bn->RunningVariance };
+			}
+			case LayerTypes::BatchNormActivationDropout:
+			{
+				auto bn = dynamic_cast<BatchNormActivationDropout*>(layer);
+				return { &bn->RunningMean, &bn->RunningVariance };
+			}
+			case LayerTypes::BatchNormRelu:
+			{
+				auto bn = dynamic_cast<BatchNormRelu*>(layer);
+				return { &bn->RunningMean, &bn->RunningVariance };
+			}
+			default:
+				return { nullptr, nullptr };
+			}
+		}
+
+		// Activation checkpointing: the layers are split in segments which end at a layer where no earlier layer in the segment is consumed anymore 
+		// (the block boundaries in resnet/densenet style graphs). After the forward pass only the Neurons of the checkpoints are kept, 
+		// a segment is recomputed right before its backward pass.
+		void SetCheckpoints()
+		{
+			CheckpointSegments.clear();
+			for (auto& layer : Layers)
+				layer->Checkpoint = true;
+
+			if (!Checkpointing || Layers.size() < 3)
+				return;
+
+			const auto layerCount = Layers.size();
+			const auto segmentLength = CheckpointSegmentLength > 0 ? CheckpointSegmentLength : std::max<UInt>(2ull, static_cast<UInt>(std::sqrt(Float(layerCount))));
+
+			auto index = std::unordered_map<const Layer*, UInt>();
+			for (auto i = 0ull; i < layerCount; i++)
+				index[Layers[i].get()] = i;
+
+			auto releasable = std::vector<bool>(layerCount, false);
+			auto lastConsumer = std::vector<UInt>(layerCount, 0ull);
+			for (auto i = 1ull; i < layerCount; i++)
+			{
+				const auto& layer = Layers[i];
+
+				releasable[i] = layer->Recomputable() && layer->LayerType != LayerTypes::Cost && !layer->LayerBeforeCost && !layer->Outputs.empty();
+				lastConsumer[i] = i;
+				for (const auto output : layer->Outputs)
+					lastConsumer[i] = std::max(lastConsumer[i], index[output]);
+			}
+
+			// a fused cost layer reads the logits before the Softmax/LogSoftmax in its forward pass (see FuseCostLayers)
+			for (const auto cost : CostLayers)
+				if (FusedCost && cost->CanFuse())
+					releasable[index[cost->InputLayer->InputLayer]] = false;
+
+			auto boundaries = std::vector<UInt>();
+			auto first = UInt(1);
+			auto reach = UInt(0);
+			for (auto i = 1ull; i < layerCount; i++)
+			{
+				if (i - first >= segmentLength && reach <= i)
+				{
+					for (auto j = first; j < i; j++)
+						if (releasable[j])
+							Layers[j]->Checkpoint = false;
+
+					boundaries.push_back(i);
+					first = i + 1;
+					reach = UInt(0);
+				}
+				else if (releasable[i])
+					reach = std::max(reach, lastConsumer[i]);
+			}
+
+			// an inplace backward layer writes its gradient in the NeuronsD1 of its input, which is cleared when that input is recomputed
+			for (auto& layer : Layers)
+				if (layer->Checkpoint && layer->InplaceBwd)
+					layer->InputLayerFwd->Checkpoint = true;
+
+			first = UInt(1);
+			for (const auto boundary : boundaries)
+			{
+				for (auto j = first; j < boundary; j++)
+					if (!Layers[j]->Checkpoint)
+					{
+						CheckpointSegments.push_back(boundary);
+						break;
+					}
+
+				first = boundary + 1;
+			}
+		}
+
+		bool SetCheckpointing(const bool enable, const UInt segmentLength = 0)
+		{
+			if (TaskState.load() != TaskStates::Stopped)
+				return false;
+
+			RestoreCheckpoints(BatchSize);
+
+			Checkpointing = enable;
+			CheckpointSegmentLength = segmentLength;
+			SetCheckpoints();
+			SetMaskedInputs();
+
+			if (Checkpointing)
+				std::cout << std::string("Checkpointing: ") << std::to_string(CheckpointSegments.size()) << std::string(" segments, ") << std::to_string(GetCheckpointNeuronsSize(BatchSize) / 1024 / 1024) << std::string(" MB instead of ") << std::to_string(GetNeuronsSize(BatchSize) / 1024 / 1024) << std::string(" MB activation memory") << std::endl << std::endl;
+
+			return true;
+		}
+
+		// activations with a step function derivative keep a 1-bit mask of the forward pass for their backward pass
+		bool SetBitMasks(const bool enable)
+		{
+			if (TaskState.load() != TaskStates::Stopped)
+				return false;
+
+			BitMasks = enable;
+			for (auto& layer : Layers)
+				if (layer->LayerType == LayerTypes::Activation)
+					dynamic_cast<Activation*>(layer.get())->SetBitMask(enable, BatchSize);
+
+			SetMaskedInputs();
+
+			return true;
+		}
+
+		// the inputs of the Activations with a bit mask which no backward pass reads are released as soon as their last consumer
+		// has written its mask, the next forward pass brings them back (see MemoryPlanner::MaskedLifetimes)
+		void SetMaskedInputs()
+		{
+			MaskedInputs = std::vector<std::vector<Layer*>>(Layers.size());
+
+			const auto lifetimes = MemoryPlanner::MaskedLifetimes(Layers);
+			for (auto i = 0ull; i < Layers.size(); i++)
+				if (lifetimes[i] > 0ull)
+					MaskedInputs[lifetimes[i]].push_back(Layers[i].get());
+		}
+
+		void ReleaseMaskedInputs(const UInt index)
+		{
+			if (index < MaskedInputs.size() && !MaskedInputs[index].empty())
+			{
+				for (const auto layer : MaskedInputs[index])
+					layer->ReleaseNeurons();
+
+				NeuronsReleased = true;
+			}
+		}
+
+		inline auto GetSegmentStart(const UInt segment) const
+		{
+			return segment > 0ull ? CheckpointSegments[segment - 1] + 1 : 1ull;
+		}
+
+		void ReleaseSegment(const UInt segment)
+		{
+			for (auto i = GetSegmentStart(segment); i < CheckpointSegments[segment]; i++)
+				if (!Layers[i]->Checkpoint)
+					Layers[i]->ReleaseNeurons();
+
+			NeuronsReleased = true;
+		}
+
+		void RecomputeSegment(const UInt segment, const UInt batchSize)
+		{
+			SwitchInplaceBwd(false);
+
+			for (auto i = GetSegmentStart(segment); i < CheckpointSegments[segment]; i++)
+			{
+				auto layer = Layers[i].get();
+
+				if (!layer->Checkpoint)
+				{
+					layer->RestoreNeurons(batchSize);
+
+					if (!layer->Skip)
+					{
+						// the running statistics must only be updated once per batch
+						const auto [runningMean, runningVariance] = GetRunningStats(layer);
+						const auto channels = runningMean ? runningMean->size() : 0ull;
+						if (runningMean)
+						{
+							if (RunningStatsBackup.size() < 2 * channels)
+								RunningStatsBackup.resize(2 * channels);
+							std::copy(runningMean->begin(), runningMean->end(), RunningStatsBackup.begin());
+							std::copy(runningVariance->begin(), runningVariance->end(), RunningStatsBackup.begin() + channels);
+						}
+
+						while (layer->RefreshingStats.load()) { std::this_thread::yield(); }
+						layer->Fwd.store(true);
+						layer->ForwardProp(batchSize, true);
+						layer->Fwd.store(false);
+
+						if (runningMean)
+						{
+							std::copy(RunningStatsBackup.begin(), RunningStatsBackup.begin() + channels, runningMean->begin());
+							std::copy(RunningStatsBackup.begin() + channels, RunningStatsBackup.begin() + 2 * channels, runningVariance->begin());
+						}
+					}
+				}
+			}
+
+			SwitchInplaceBwd(true);
+		}
+
+		void RestoreCheckpoints(const UInt batchSize)
+		{
+			if (NeuronsReleased)
+			{
+				for (auto& layer : Layers)
+					layer->RestoreNeurons(batchSize);
+
+				// the inference path of the merge layers binds the Neurons in InitializeDescriptors
+				for (auto& layer : Layers)
+					layer->InitializeDescriptors(batchSize);
+
+				NeuronsReleased = false;
+			}
+		}
+
 		std::vector<Layer*> GetLayerInputs(const std::vector<std::string>& inputs) const
 		{
 			auto list = std::vector<Layer*>();
@@ -1420,6 +2412,8 @@ namespace dnn
 				}
 			}
 
+			BuildInputGraph();
+
 			return unreferencedLayers;
 		}
 	
@@ -1446,6 +2440,7 @@ namespace dnn
 				auto timePointGlobal = timer.now();
 				auto bpropTimeCount = std::chrono::duration<Float>(Float(0));
 				auto updateTimeCount = std::chrono::duration<Float>(Float(0));
+				auto recomputeTimeCount = std::chrono::duration<Float>(Float(0));
                 auto elapsedTime = std::chrono::duration<Float>(Float(0));
 
 				TotalEpochs = 0;
@@ -1463,12 +2458,18 @@ namespace dnn
 				Rate = CurrentTrainingRate.MaximumRate;
 				CurrentCycle = CurrentTrainingRate.Cycles;
 			
+				ReleaseMemoryPlan();
 				if (!ChangeResolution(CurrentTrainingRate.BatchSize, CurrentTrainingRate.Height, CurrentTrainingRate.Width, CurrentTrainingRate.PadH, CurrentTrainingRate.PadW))
 					return;
 				
 				if (Dropout != CurrentTrainingRate.Dropout)
 					ChangeDropout(CurrentTrainingRate.Dropout, BatchSize);
 
+				FuseCostLayers();
+				SetCheckpoints();
+				SetMaskedInputs();
+				ReserveShapes();
+
 				auto learningRateEpochs = CurrentTrainingRate.Epochs;
 				auto learningRateIndex = 0ull;
 
@@ -1566,6 +2567,8 @@ namespace dnn
 								if (DepthDrop > 0)
 									StochasticDepth(totalSkipConnections, DepthDrop, FixedDepthDrop);
 
+								NextDropoutStep();
+
 								// Forward
 								timePointGlobal = timer.now();
 								auto SampleLabel = TrainSample(SampleIndex);
@@ -1611,7 +2614,11 @@ namespace dnn
 									{
 										timePoint = timer.now();
 										if (!Layers[i]->Skip && TaskState.load() == TaskStates::Running)
+										{
 											Layers[i]->BackwardProp(1);
+											if (Layers[i]->EmaDecay > Float(0))
+												Layers[i]->UpdateEma();
+										}
 										Layers[i]->bpropTime = timer.now() - timePoint;
 									}
 									bpropTimeCount += Layers[i]->bpropTime;
@@ -1620,6 +2627,9 @@ namespace dnn
 								bpropTime = bpropTimeCount;
 								updateTime = updateTimeCount;
 
+								if (Profile.Enabled())
+									Profile.Step(Layers, 1ull, timePointGlobal, timer.now() - timePointGlobal, std::chrono::duration<Float>(Float(0)), false);
+
 								if (TaskState.load() != TaskStates::Running && !CheckTaskState())
 									break;
 							}
@@ -1627,13 +2637,18 @@ namespace dnn
 						else
 						{
 #endif
-							auto overflow = false;
-							for (SampleIndex = 0; SampleIndex < AdjustedTrainingSamplesCount; SampleIndex += BatchSize)
+							const auto batchSize = BatchSize;
+							const auto samples = GetTrainingPassSamples(batchSize);
+							for (SampleIndex = 0; SampleIndex < samples; SampleIndex += BatchSize)
 							{
+								SwitchBatchSize(std::min<UInt>(batchSize, samples - SampleIndex));
+
 								// Forward
 								if (DepthDrop > 0)
 									StochasticDepth(totalSkipConnections, DepthDrop, FixedDepthDrop);
 
+								NextDropoutStep();
+
 								while (Layers[0]->RefreshingStats.load()) {	std::this_thread::yield(); }
 								Layers[0]->Fwd.store(true);
 								timePointGlobal = timer.now();
@@ -1644,8 +2659,17 @@ namespace dnn
 								for (auto cost : CostLayers)
 									cost->SetSampleLabels(SampleLabels);
 
+								// the teacher runs on the same augmented input while the student goes forward
+								auto teacher = Teacher ? Teacher(BatchSize) : std::future<void>();
+
+								auto segment = 0ull;
 								for (auto i = 1ull; i < Layers.size(); i++)
 								{
+									Layers[i]->RestoreNeurons(BatchSize);
+
+									if (teacher.valid() && Layers[i]->LayerType == LayerTypes::Cost)
+										teacher.get();
+
 									if (!Layers[i]->Skip && TaskState.load() == TaskStates::Running)
 									{
 										while (Layers[i]->RefreshingStats.load()) { std::this_thread::yield(); }
@@ -1654,24 +2678,38 @@ namespace dnn
 										Layers[i]->ForwardProp(BatchSize, true);
 										Layers[i]->fpropTime = timer.now() - timePoint;
 										Layers[i]->Fwd.store(false);
+
+										ReleaseMaskedInputs(i);
 									}
 									else
 										Layers[i]->fpropTime = std::chrono::duration<Float>(Float(0));
+
+									if (segment < CheckpointSegments.size() && i == CheckpointSegments[segment])
+										ReleaseSegment(segment++);
 								}
-								
-								overflow = SampleIndex >= TrainOverflowCount;
-								CostFunctionBatch(State.load(), BatchSize, overflow, TrainSkipCount);
-								RecognizedBatch(State.load(), BatchSize, overflow, TrainSkipCount, SampleLabels);
+
+								CostFunctionBatch(State.load(), BatchSize);
+								RecognizedBatch(State.load(), BatchSize, SampleLabels);
 								fpropTime = timer.now() - timePointGlobal;
 
 								// Backward
 								bpropTimeCount = std::chrono::duration<Float>(Float(0));
 								updateTimeCount = std::chrono::duration<Float>(Float(0));
+								recomputeTimeCount = std::chrono::duration<Float>(Float(0));
 								SwitchInplaceBwd(true);
 								for (auto i = Layers.size() - 1; i >= FirstUnlockedLayer.load(); --i)
 								{
 									if (TaskState.load() == TaskStates::Running)
 									{
+										if (segment > 0ull && i == CheckpointSegments[segment - 1])
+										{
+											timePoint = timer.now();
+											if (segment < CheckpointSegments.size())
+												ReleaseSegment(segment);
+											RecomputeSegment(--segment, BatchSize);
+											recomputeTimeCount += timer.now() - timePoint;
+										}
+
 										Layers[i]->bpropTime = std::chrono::duration<Float>(Float(0));
 										Layers[i]->updateTime = std::chrono::duration<Float>(Float(0));
 
@@ -1686,37 +2724,55 @@ namespace dnn
 												Layers[i]->ResetGradients();
 												Layers[i]->BackwardProp(BatchSize);
 												Layers[i]->bpropTime = timer.now() - timePoint;
-
-												timePoint = timer.now();
-												Layers[i]->UpdateWeights(CurrentTrainingRate, Optimizer, DisableLocking);
-												Layers[i]->updateTime = timer.now() - timePoint;
-									     
-												updateTimeCount += Layers[i]->updateTime;
+												bpropTimeCount += Layers[i]->bpropTime;
+
+												if (OverlapUpdates)
+													Updater.Push(Layers[i].get(), CurrentTrainingRate, Optimizer, DisableLocking);	// lowers Bwd when applied
+												else
+												{
+													timePoint = timer.now();
+													Layers[i]->UpdateWeights(CurrentTrainingRate, Optimizer, DisableLocking);
+													Layers[i]->updateTime = timer.now() - timePoint;
+
+													updateTimeCount += Layers[i]->updateTime;
+													Layers[i]->Bwd.store(false);
+												}
 											}
 											else
 											{
 												Layers[i]->BackwardProp(BatchSize);
 												Layers[i]->bpropTime = timer.now() - timePoint;
-											}
+												bpropTimeCount += Layers[i]->bpropTime;
 
-											bpropTimeCount += Layers[i]->bpropTime;
-											Layers[i]->Bwd.store(false);
+												// a batch normalization without scaling has no update, only its running statistics are averaged
+												if (Layers[i]->EmaDecay > Float(0))
+													Layers[i]->UpdateEma();
+
+												Layers[i]->Bwd.store(false);
+											}
 										}										
 									}
 								}
 								SwitchInplaceBwd(false);
+								updateTimeCount += Updater.Join();
 								bpropTime = bpropTimeCount;
 								updateTime = updateTimeCount;
+								recomputeTime = recomputeTimeCount;
 
 								elapsedTime = timer.now() - timePointGlobal;
 								SampleSpeed = BatchSize / (Float(std::chrono::duration_cast<std::chrono::microseconds>(elapsedTime).count()) / 1000000);
 
+								if (Profile.Enabled())
+									Profile.Step(Layers, BatchSize, timePointGlobal, elapsedTime, recomputeTime, OverlapUpdates);
+
 								if (TaskState.load() != TaskStates::Running && !CheckTaskState())
 									break;
 							}
+							SwitchBatchSize(batchSize);
 #ifdef DNN_STOCHASTIC
 						}
 #endif
+						RestoreCheckpoints(BatchSize);
 					}
 					else
 						break;
@@ -1724,6 +2780,7 @@ namespace dnn
 					if (CheckTaskState())
 					{
 						State.store(States::Testing);
+						SwapEma(EmaTesting);
 #ifdef DNN_STOCHASTIC	
 						if (BatchSize == 1)
 						{
@@ -1747,9 +2804,11 @@ namespace dnn
 						else
 						{
 #endif
-							auto overflow = false;
-							for (SampleIndex = 0; SampleIndex < AdjustedTestingSamplesCount; SampleIndex += BatchSize)
+							const auto batchSize = BatchSize;
+							for (SampleIndex = 0; SampleIndex < DataProv->TestingSamplesCount; SampleIndex += BatchSize)
 							{
+								SwitchBatchSize(std::min<UInt>(batchSize, DataProv->TestingSamplesCount - SampleIndex));
+
 								timePointGlobal = timer.now();
 
 								while (Layers[0]->RefreshingStats.load()) { std::this_thread::yield(); }
@@ -1774,9 +2833,8 @@ namespace dnn
 
 								fpropTime = timer.now() - timePointGlobal;
 
-								overflow = SampleIndex >= TestOverflowCount;
-								CostFunctionBatch(State.load(), BatchSize, overflow, TestSkipCount);
-								RecognizedBatch(State.load(), BatchSize, overflow, TestSkipCount, SampleLabels);
+								CostFunctionBatch(State.load(), BatchSize);
+								RecognizedBatch(State.load(), BatchSize, SampleLabels);
 
 								elapsedTime = timer.now() - timePointGlobal;
 								SampleSpeed = BatchSize / (Float(std::chrono::duration_cast<std::chrono::microseconds>(elapsedTime).count()) / 1000000);
@@ -1784,16 +2842,19 @@ namespace dnn
 								if (TaskState.load() != TaskStates::Running && !CheckTaskState())
 									break;
 							}
+							SwitchBatchSize(batchSize);
 #ifdef DNN_STOCHASTIC
 						}
 #endif
+						SwapEma(false);
+
 						if (CheckTaskState())
 						{
 							for (auto cost : CostLayers)
 							{
-								cost->AvgTrainLoss = cost->TrainLoss / DataProv->TrainingSamplesCount;
+								cost->AvgTrainLoss = cost->TrainLoss / GetTrainingPassSamples(BatchSize);
 								cost->AvgTestLoss = cost->TestLoss / DataProv->TestingSamplesCount;
-								cost->TrainErrorPercentage = cost->TrainErrors / Float(DataProv->TrainingSamplesCount / 100);
+								cost->TrainErrorPercentage = cost->TrainErrors / Float(GetTrainingPassSamples(BatchSize) / 100);
 								cost->TestErrorPercentage = cost->TestErrors / Float(DataProv->TestingSamplesCount / 100);
 							}
 
@@ -1829,6 +2890,7 @@ namespace dnn
 						break;
 				}
 
+				RestoreCheckpoints(BatchSize);
 				State.store(States::Completed);
 			}
 		}
@@ -1870,6 +2932,8 @@ namespace dnn
 				if (Dropout != CurrentTrainingRate.Dropout)
 					ChangeDropout(CurrentTrainingRate.Dropout, BatchSize);
 
+				FuseCostLayers();
+
 				auto learningRateEpochs = CurrentTrainingRate.Epochs;
 				auto learningRateIndex = 0ull;
 
@@ -1920,7 +2984,6 @@ namespace dnn
 						cost->Reset();
 
 
-					auto overflow = false;
 					SampleIndex = 0;
 
 					timePointGlobal = timer.now();
@@ -1956,9 +3019,8 @@ namespace dnn
 							Layers[i]->fpropTime = timer.now() - timePoint;
 						}
 						fpropTime = timer.now() - timePointGlobal;
-						overflow = SampleIndex >= TrainOverflowCount;
-						CostFunctionBatch(State.load(), BatchSize, overflow, TrainSkipCount);
-						RecognizedBatch(State.load(), BatchSize, overflow, TrainSkipCount, SampleLabels);
+						CostFunctionBatch(State.load(), BatchSize);
+						RecognizedBatch(State.load(), BatchSize, SampleLabels);
 
 						for (auto i = Layers.size() - 1; i >= FirstUnlockedLayer.load(); --i)
 						{
@@ -2037,6 +3099,7 @@ namespace dnn
 				if (Dropout != CurrentTrainingRate.Dropout)
 					ChangeDropout(CurrentTrainingRate.Dropout, BatchSize);
 
+				FuseCostLayers();
 
 				TrainingSamplesHFlip = std::vector<bool>();
 				TrainingSamplesVFlip = std::vector<bool>();
@@ -2062,6 +3125,8 @@ namespace dnn
 					for (auto cost : CostLayers)
 						cost->Reset();
 
+					SwapEma(EmaTesting);
+
 #ifdef DNN_STOCHASTIC
 					if (BatchSize == 1)
 					{
@@ -2085,9 +3150,11 @@ namespace dnn
 					else
 					{
 #endif
-						auto overflow = false;
-						for (SampleIndex = 0; SampleIndex < AdjustedTestingSamplesCount; SampleIndex += BatchSize)
+						const auto batchSize = BatchSize;
+						for (SampleIndex = 0; SampleIndex < DataProv->TestingSamplesCount; SampleIndex += BatchSize)
 						{
+							SwitchBatchSize(std::min<UInt>(batchSize, DataProv->TestingSamplesCount - SampleIndex));
+
 							timePointGlobal = timer.now();
 
 							while (Layers[0]->RefreshingStats.load()) { std::this_thread::yield(); }
@@ -2109,9 +3176,8 @@ namespace dnn
 								Layers[i]->Fwd.store(false);
 							}
 
-							overflow = SampleIndex >= TestOverflowCount;
-							CostFunctionBatch(State.load(), BatchSize, overflow, TestSkipCount);
-							RecognizedBatch(State.load(), BatchSize, overflow, TestSkipCount, SampleLabels);
+							CostFunctionBatch(State.load(), BatchSize);
+							RecognizedBatch(State.load(), BatchSize, SampleLabels);
 
 							fpropTime = timer.now() - timePointGlobal;
 
@@ -2120,9 +3186,12 @@ namespace dnn
 							if (TaskState.load() != TaskStates::Running && !CheckTaskState())
 								break;
 						}
+						SwitchBatchSize(batchSize);
 #ifdef DNN_STOCHASTIC
 					}
 #endif
+					SwapEma(false);
+
 					for (auto cost : CostLayers)
 					{
 						cost->AvgTestLoss = cost->TestLoss / DataProv->TestingSamplesCount;
@@ -2152,6 +3221,116 @@ namespace dnn
 			}
 		}
 
+		// Deterministic test-time augmentation views: the center, the corner crops of Positions (they differ by the padding
+		// of the training rate) and two scales, each without and with a horizontal flip. The first count are used.
+		static std::vector<TTAView> GetTTAViews(const UInt count)
+		{
+			auto views = std::vector<TTAView>();
+
+			for (const auto position : { Positions::Center, Positions::TopLeft, Positions::TopRight, Positions::BottomLeft, Positions::BottomRight })
+				for (const auto flip : { false, true })
+					views.push_back(TTAView{ position, flip, Float(1) });
+
+			for (const auto scale : { Float(0.875), Float(1.125) })
+				for (const auto flip : { false, true })
+					views.push_back(TTAView{ Positions::Center, flip, scale });
+
+			views.resize(std::clamp<UInt>(count, 1ull, views.size()));
+
+			return views;
+		}
+
+		// Test-time augmentation: every test sample is scored on the average of its views. The views of a group of samples
+		// go through one forward pass at the batch size of the training rate, then the outputs of the cost layers (or the
+		// logits in front of their Softmax/LogSoftmax) are summed per sample before it is scored.
+		TTAInfo TestingTTA(const UInt viewCount, const bool logits)
+		{
+			auto info = TTAInfo{ 0ull, 0ull, Float(0), Float(0), Float(0), Float(0) };
+
+			if (TaskState.load() != TaskStates::Stopped || BatchSizeChanging.load() || ResettingWeights.load() || !DataProv || DataProv->TestingSamplesCount == 0ull)
+				return info;
+
+			TaskState.store(TaskStates::Running);
+			State.store(States::Idle);
+
+			auto timer = std::chrono::high_resolution_clock();
+			auto forwardTime = std::chrono::duration<Float>(Float(0));
+
+			CurrentTrainingRate = TrainingRates[0];
+			Rate = CurrentTrainingRate.MaximumRate;
+
+			if (!ChangeResolution(CurrentTrainingRate.BatchSize, CurrentTrainingRate.Height, CurrentTrainingRate.Width, CurrentTrainingRate.PadH, CurrentTrainingRate.PadW))
+			{
+				TaskState.store(TaskStates::Stopped);
+				return info;
+			}
+
+			if (Dropout != CurrentTrainingRate.Dropout)
+				ChangeDropout(CurrentTrainingRate.Dropout, BatchSize);
+
+			FuseCostLayers();
+			SwitchInplaceBwd(false);
+
+			for (auto cost : CostLayers)
+				cost->Reset();
+
+			SwapEma(EmaTesting);
+
+			State.store(States::Testing);
+
+			const auto views = GetTTAViews(viewCount);
+			const auto batchSize = BatchSize;
+			const auto groupSize = std::max<UInt>(1ull, batchSize / views.size());
+
+			// more views than the batch size grow the batch beyond the planned arena
+			if (views.size() > batchSize)
+				ReleaseMemoryPlan();
+
+			auto samples = 0ull;
+			for (SampleIndex = 0; SampleIndex < DataProv->TestingSamplesCount; SampleIndex += groupSize)
+			{
+				const auto group = std::min<UInt>(groupSize, DataProv->TestingSamplesCount - SampleIndex);
+				SwitchBatchSize(group * views.size());
+
+				auto SampleLabels = TestTTABatch(SampleIndex, group, views);
+
+				for (auto cost : CostLayers)
+					cost->SetSampleLabels(SampleLabels);
+
+				const auto timePoint = timer.now();
+				for (auto i = 1ull; i < Layers.size(); i++)
+					Layers[i]->ForwardProp(BatchSize, false);
+				forwardTime += timer.now() - timePoint;
+
+				RecognizedTTA(group, views.size(), logits, SampleLabels);
+				samples += group;
+
+				if (TaskState.load() != TaskStates::Running && !CheckTaskState())
+					break;
+			}
+			SwitchBatchSize(batchSize);
+			SwapEma(false);
+
+			for (auto cost : CostLayers)
+				cost->TestErrorPercentage = samples > 0ull ? cost->TestErrors / Float(samples) * Float(100) : Float(0);
+
+			TestErrors = CostLayers[CostIndex]->TestErrors;
+			TestErrorPercentage = CostLayers[CostIndex]->TestErrorPercentage;
+			Accuracy = Float(100) - TestErrorPercentage;
+
+			info.Views = views.size();
+			info.Samples = samples;
+			info.Accuracy = Accuracy;
+			info.AccuracyTop5 = samples > 0ull ? Float(100) - CostLayers[CostIndex]->TestErrorsTop5 / Float(samples) * Float(100) : Float(0);
+			info.SampleTime = samples > 0ull ? forwardTime.count() * Float(1000) / samples : Float(0);
+			info.ViewTime = info.SampleTime / views.size();
+
+			State.store(States::Completed);
+			TaskState.store(TaskStates::Stopped);
+
+			return info;
+		}
+
 		bool GetInputSnapShot(std::vector<Float>* snapshot, std::vector<UInt>* label)
 		{
 			if (!Layers[0]->Neurons.empty() && !BatchSizeChanging.load() && !ResettingWeights.load() && !Layers[0]->Fwd.load())
@@ -2419,10 +3598,10 @@ namespace dnn
 
 			for_i_dynamic(batchSize, threads, [=, &SampleLabels](const UInt batchIndex)
 			{
-				const auto randomIndex = (index + batchIndex >= DataProv->TrainingSamplesCount) ? RandomTrainingSamples[batchIndex] : RandomTrainingSamples[index + batchIndex];
+				const auto randomIndex = RandomTrainingSamples[index + batchIndex];
 				auto imgByte = DataProv->TrainingSamples[randomIndex];
 
-				const auto randomIndexMix = (index + batchSize - (batchIndex + 1) >= DataProv->TrainingSamplesCount) ? RandomTrainingSamples[batchSize - (batchIndex + 1)] : RandomTrainingSamples[index + batchSize - (batchIndex + 1)];
+				const auto randomIndexMix = RandomTrainingSamples[index + batchSize - (batchIndex + 1)];
 				auto imgByteMix = DataProv->TrainingSamples[randomIndexMix];
 
 				auto labels = DataProv->TrainingLabels[randomIndex];
@@ -2589,6 +3768,52 @@ namespace dnn
 
 			return SampleLabels;
 		}
+
+		// the views of sample index + s are at s * views.size() + v
+		std::vector<std::vector<LabelInfo>> TestTTABatch(const UInt index, const UInt samples, const std::vector<TTAView>& views)
+		{
+			const auto batchSize = samples * views.size();
+			auto SampleLabels = std::vector<std::vector<LabelInfo>>(batchSize, std::vector<LabelInfo>(DataProv->Hierarchies));
+
+			const auto elements = batchSize * C * D * H * W;
+			const auto threads = GetThreads(elements, Float(10));
+
+			for_i_dynamic(batchSize, threads, [=, &SampleLabels, &views](const UInt batchIndex)
+			{
+				const auto sampleIndex = index + batchIndex / views.size();
+				const auto& view = views[batchIndex % views.size()];
+
+				auto labels = DataProv->TestingLabels[sampleIndex];
+				SampleLabels[batchIndex] = GetLabelInfo(labels);
+
+				auto imgByte = DataProv->TestingSamples[sampleIndex];
+
+				if (view.HorizontalFlip)
+					Image<Byte>::HorizontalMirror(imgByte);
+
+				const auto height = std::max<UInt>(1ull, static_cast<UInt>(std::round(H * view.Scale)));
+				const auto width = std::max<UInt>(1ull, static_cast<UInt>(std::round(W * view.Scale)));
+				if (DataProv->D != D || DataProv->H != height || DataProv->W != width)
+					Image<Byte>::Resize(imgByte, D, height, width, Interpolations(CurrentTrainingRate.Interpolation));
+
+				imgByte = Image<Byte>::Padding(imgByte, PadD, PadH, PadW, DataProv->Mean, MirrorPad);
+
+				imgByte = Image<Byte>::Crop(imgByte, view.Position, D, H, W, DataProv->Mean);
+
+				for (auto c = 0u; c < imgByte.C(); c++)
+				{
+					const auto mean = MeanStdNormalization ? DataProv->Mean[c] : imgByte.GetChannelMean(c);
+					const auto stddev = MeanStdNormalization ? DataProv->StdDev[c] : imgByte.GetChannelStdDev(c);
+					
+					for (auto d = 0u; d < imgByte.D(); d++)
+						for (auto h = 0u; h < imgByte.H(); h++)
+							for (auto w = 0u; w < imgByte.W(); w++)
+								Layers[0]->Neurons[batchIndex * imgByte.Size() + (c * imgByte.ChannelSize()) + (d * imgByte.Area()) + (h * imgByte.W()) + w] = (imgByte(c, d, h, w) - mean) / stddev;
+				}
+			});
+
+			return SampleLabels;
+		}
 			
 		void ForwardProp(const UInt batchSize)
 		{
@@ -2648,7 +3873,10 @@ namespace dnn
 				if (!is.bad() && is.is_open())
 				{
 					for (auto& layer : Layers)
+					{
 						layer->Load(is, persistOptimizer, Optimizer);
+						layer->SetEma(EmaDecay);
+					}
 
 					is.close();
 
@@ -61,6 +61,16 @@ namespace dnn
 			return 1;
 		}
 
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdSrc) + UInt(reorderBwdDiffSrc) + UInt(reorderBwdDiffWeights);
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			if (InputLayer->DstMemDesc->get_ndims() == 2)
@@ -98,10 +108,11 @@ namespace dnn
 				auto weights = FloatVector(fwdDescPRelu->weights_desc().get_size() / sizeof(Float));
 				auto weightsMem = dnnl::memory(fwdDescPRelu->weights_desc(), Device.engine, weights.data());
 
-				dnnl::reorder(memWeights, weightsMem).execute(Device.stream, std::unordered_map<int, dnnl::memory>{ {DNNL_ARG_FROM, memWeights}, { DNNL_ARG_TO, weightsMem } });
-				Device.stream.wait();
+				auto stream = dnnl::stream(Device.engine);	// layers initialize concurrently (see Model::InitializeLayers)
+				dnnl::reorder(memWeights, weightsMem).execute(stream, std::unordered_map<int, dnnl::memory>{ {DNNL_ARG_FROM, memWeights}, { DNNL_ARG_TO, weightsMem } });
+				stream.wait();
 
-				Biases = weights;
+				Biases = std::move(weights);
 				WeightsMemDesc = std::make_unique<dnnl::memory::desc>(fwdDescPRelu->weights_desc());
 			}
 
@@ -115,6 +115,16 @@ namespace dnn
 			return Multiplier * KernelH * KernelW / StrideH * StrideW;
 		}
 
+		UInt ForwardReorders() const final override
+		{
+			return UInt(reorderFwdSrc);
+		}
+
+		UInt BackwardReorders() const final override
+		{
+			return UInt(reorderBwdSrc) + UInt(reorderBwdDiffSrc) + UInt(reorderBwdDiffDst) + UInt(reorderBwdWeights) + UInt(reorderBwdDiffWeights);
+		}
+
 		void InitializeDescriptors(const UInt batchSize) final override
 		{
 			if (InputLayer->PaddedC % Groups != 0)
@@ -137,17 +147,7 @@ namespace dnn
 			bwdDataDesc = std::make_unique<dnnl::convolution_backward_data::primitive_desc>(dnnl::convolution_backward_data::primitive_desc(Device.engine, dnnl::algorithm::convolution_auto, memDesc[0], memDesc[2], memDesc[1], strides, dilates, padding, padding, *fwdDesc));
 
 			if (*WeightsMemDesc != fwdDesc->weights_desc())
-			{
-				auto weights = FloatVector(fwdDesc->weights_desc().get_size() / sizeof(Float));
-				auto memWeights = dnnl::memory(*WeightsMemDesc, Device.engine, Weights.data());
-				auto weightsMem = dnnl::memory(fwdDesc->weights_desc(), Device.engine, weights.data());
-
-				dnnl::reorder(memWeights, weightsMem).execute(Device.stream, std::unordered_map<int, dnnl::memory>{ {DNNL_ARG_FROM, memWeights}, { DNNL_ARG_TO, weightsMem } });
-				Device.stream.wait();
-
-				Weights = weights;
-				WeightsMemDesc = std::make_unique<dnnl::memory::desc>(fwdDesc->weights_desc());
-			}
+				ReorderWeights(fwdDesc->weights_desc());
 
 			DstMemDesc = std::make_unique<dnnl::memory::desc>(fwdDesc->dst_desc());
 			DiffDstMemDesc = std::make_unique<dnnl::memory::desc>(fwdDesc->dst_desc());
@@ -0,0 +1,449 @@
+#pragma once
+#include "Layer.h"
+
+namespace dnn
+{
+	enum class ProfilePhases
+	{
+		Input = 0,		// loading the batch
+		Forward = 1,
+		Backward = 2,
+		Update = 3,		// optimizer
+		Recompute = 4,	// activation checkpointing
+		Wait = 5		// cost, stats refresh, joining the update worker and everything else inside the step
+	};
+
+	// durations in microseconds, power of two buckets: bucket 0 holds everything below 1 us, bucket b up to 2^b us
+	struct Histogram
+	{
+		static constexpr UInt Buckets = 32ull;
+
+		std::array<UInt, Buckets> Counts;
+		UInt Samples;
+		Float Sum;
+		Float Min;
+		Float Max;
+
+		Histogram() :
+			Counts(),
+			Samples(0),
+			Sum(0),
+			Min(std::numeric_limits<Float>::max()),
+			Max(0)
+		{
+			Counts.fill(0ull);
+		}
+
+		void Add(const Float microseconds)
+		{
+			const auto bucket = microseconds < Float(1) ? 0ull : std::min<UInt>(Buckets - 1ull, UInt(std::log2(microseconds)) + 1ull);
+
+			Counts[bucket]++;
+			Samples++;
+			Sum += microseconds;
+			Min = std::min(Min, microseconds);
+			Max = std::max(Max, microseconds);
+		}
+
+		Float Mean() const
+		{
+			return Samples > 0ull ? Sum / Float(Samples) : Float(0);
+		}
+
+		// upper bound of the bucket holding the percentile, clamped to the observed range
+		Float Percentile(const Float percentile) const
+		{
+			if (Samples == 0ull)
+				return Float(0);
+
+			const auto rank = UInt(std::ceil(percentile * Float(Samples)));
+			auto count = 0ull;
+			for (auto bucket = 0ull; bucket < Buckets; bucket++)
+			{
+				count += Counts[bucket];
+				if (count >= rank)
+					return std::max(Min, std::min(Max, std::ldexp(Float(1), int(bucket))));
+			}
+
+			return Max;
+		}
+	};
+
+	struct LayerProfile
+	{
+		Histogram Forward;
+		Histogram Backward;
+		Histogram Update;
+		Float ForwardFlops;		// totals over the profiled steps
+		Float BackwardFlops;
+		Float ForwardBytes;
+		Float BackwardBytes;
+		UInt Reorders;			// per step, see Layer::ForwardReorders
+	};
+
+	// Per-layer profiler for the training steps: the layer timers of every step are aggregated in histograms, the FLOPs and the
+	// compulsory memory traffic are derived from the layer shapes, so the achieved GFLOP/s and GB/s show which layers are 
+	// memory-bound and which are compute-bound. The first TraceSteps steps are kept as a Chrome/Perfetto trace (chrome://tracing),
+	// the timeline is rebuilt from the layer timers: forward and backward run in order on the training thread, the updates 
+	// handed to the update worker start when the backward pass of their layer ends.
+	class Profiler
+	{
+	private:
+		struct TraceEvent
+		{
+			UInt Layer;
+			ProfilePhases Phase;
+			UInt Step;
+			UInt Thread;	// 0 = training thread, 1 = update worker
+			Float Start;	// microseconds since Start
+			Float Duration;
+		};
+
+		std::mutex Lock;
+		std::atomic<bool> Running;
+		std::chrono::high_resolution_clock::time_point Origin;
+		std::vector<std::string> Names;
+		std::vector<LayerTypes> Types;
+		std::vector<LayerProfile> Layers;
+		std::array<Histogram, 6> Phases;
+		std::vector<TraceEvent> Trace;
+		UInt Steps;
+		UInt BatchSize;
+
+		static inline Float Microseconds(const std::chrono::duration<Float>& duration)
+		{
+			return duration.count() * Float(1000000);
+		}
+
+		static inline Float Elements(const Layer& layer, const UInt batchSize)
+		{
+			return Float(batchSize * layer.PaddedCDHW());
+		}
+
+		// one operation per input or output element for the layers without weights
+		static Float ForwardFlops(const Layer& layer, const UInt batchSize)
+		{
+			switch (layer.LayerType)
+			{
+			case LayerTypes::Convolution:
+			case LayerTypes::DepthwiseConvolution:
+			case LayerTypes::PartialDepthwiseConvolution:
+				// WeightCount is C * InputLayer->C / Groups * KernelH * KernelW (times the multiplier for the depthwise ones)
+				return Float(2) * Float(batchSize * layer.H * layer.W) * Float(layer.WeightCount);
+
+			case LayerTypes::ConvolutionTranspose:
+				return Float(2) * Float(batchSize * layer.InputLayer->H * layer.InputLayer->W) * Float(layer.WeightCount);
+
+			case LayerTypes::Dense:
+				return Float(2) * Float(batchSize) * Float(layer.WeightCount);
+
+			case LayerTypes::Input:
+				return Float(0);
+
+			default:
+			{
+				auto elements = Float(batchSize * layer.CDHW());
+				for (const auto input : layer.Inputs)
+					elements = std::max(elements, Float(batchSize * input->CDHW()));
+
+				return elements;
+			}
+			}
+		}
+
+		// the layers with weights compute the gradient of their input and of their weights
+		static Float BackwardFlops(const Layer& layer, const UInt batchSize)
+		{
+			return (layer.HasWeights ? Float(2) : Float(1)) * ForwardFlops(layer, batchSize);
+		}
+
+		// reads the inputs and the weights, writes the output
+		static Float ForwardBytes(const Layer& layer, const UInt batchSize)
+		{
+			auto elements = Elements(layer, batchSize) + Float(layer.WeightCount + layer.BiasCount);
+			for (const auto input : layer.Inputs)
+				elements += Elements(*input, batchSize);
+
+			return elements * Float(sizeof(Float));
+		}
+
+		// reads the output gradient, the inputs and the weights, updates the input gradients and writes the weight gradients
+		static Float BackwardBytes(const Layer& layer, const UInt batchSize)
+		{
+			auto elements = Elements(layer, batchSize) + Float(2) * Float(layer.WeightCount + layer.BiasCount);
+			for (const auto input : layer.Inputs)
+				elements += Float(2) * Elements(*input, batchSize);
+
+			return elements * Float(sizeof(Float));
+		}
+
+		// layers running a oneDNN primitive, the others run the kernels of this library
+		static bool IsPrimitive(const LayerTypes type)
+		{
+			switch (type)
+			{
+			case LayerTypes::AvgPooling:
+			case LayerTypes::BatchNorm:
+			case LayerTypes::BatchNormRelu:
+			case LayerTypes::Convolution:
+			case LayerTypes::ConvolutionTranspose:
+			case LayerTypes::Dense:
+			case LayerTypes::DepthwiseConvolution:
+			case LayerTypes::GlobalAvgPooling:
+			case LayerTypes::GlobalMaxPooling:
+			case LayerTypes::LayerNorm:
+			case LayerTypes::LocalResponseNorm:
+			case LayerTypes::LogSoftmax:
+			case LayerTypes::MaxPooling:
+			case LayerTypes::PartialDepthwiseConvolution:
+			case LayerTypes::PRelu:
+			case LayerTypes::Resampling:
+			case LayerTypes::Shuffle:
+			case LayerTypes::Softmax:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		static std::string Escape(const std::string& text)
+		{
+			auto escaped = std::string();
+			for (const auto character : text)
+			{
+				if (character == '"' || character == '\\')
+					escaped.push_back('\\');
+				escaped.push_back(character);
+			}
+
+			return escaped;
+		}
+
+		void AddEvent(const UInt layer, const ProfilePhases phase, const UInt thread, const Float start, const Float duration)
+		{
+			if (duration > Float(0))
+				Trace.push_back(TraceEvent{ layer, phase, Steps, thread, start, duration });
+		}
+
+	public:
+		UInt TraceSteps;
+		Float RidgePoint;	// FLOP/byte where the machine turns from memory-bound to compute-bound
+
+		Profiler() :
+			Running(false),
+			Names(std::vector<std::string>()),
+			Types(std::vector<LayerTypes>()),
+			Layers(std::vector<LayerProfile>()),
+			Phases(),
+			Trace(std::vector<TraceEvent>()),
+			Steps(0),
+			BatchSize(0),
+			TraceSteps(20),
+			RidgePoint(Float(10))
+		{
+		}
+
+		inline bool Enabled() const
+		{
+			return Running.load();
+		}
+
+		void Start(const std::vector<std::unique_ptr<Layer>>& layers, const UInt traceSteps)
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			Names.clear();
+			Types.clear();
+			for (const auto& layer : layers)
+			{
+				Names.push_back(layer->Name);
+				Types.push_back(layer->LayerType);
+			}
+			Layers = std::vector<LayerProfile>(layers.size());
+			Phases = std::array<Histogram, 6>();
+			Trace.clear();
+			Steps = 0ull;
+			BatchSize = 0ull;
+			TraceSteps = traceSteps;
+			Origin = std::chrono::high_resolution_clock::now();
+
+			Running.store(true);
+		}
+
+		void Stop()
+		{
+			Running.store(false);
+		}
+
+		// called once per training step with the layer timers of that step
+		void Step(const std::vector<std::unique_ptr<Layer>>& layers, const UInt batchSize, const std::chrono::high_resolution_clock::time_point& start, const std::chrono::duration<Float>& elapsed, const std::chrono::duration<Float>& recompute, const bool overlapUpdates)
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			if (layers.size() != Layers.size())
+				return;
+
+			const auto trace = Steps < TraceSteps;
+			auto time = Microseconds(start - Origin);
+			auto busy = Float(0);
+			auto update = Float(0);
+
+			const auto input = Microseconds(layers[0]->fpropTime);
+			Phases[UInt(ProfilePhases::Input)].Add(input);
+			if (trace)
+				AddEvent(0ull, ProfilePhases::Input, 0ull, time, input);
+			time += input;
+			busy += input;
+
+			for (auto i = 1ull; i < layers.size(); i++)
+			{
+				const auto& layer = *layers[i];
+				auto& profile = Layers[i];
+
+				const auto forward = Microseconds(layer.fpropTime);
+				if (forward > Float(0))
+				{
+					profile.Forward.Add(forward);
+					profile.ForwardFlops += ForwardFlops(layer, batchSize);
+					profile.ForwardBytes += ForwardBytes(layer, batchSize);
+				}
+				profile.Reorders = layer.ForwardReorders() + layer.BackwardReorders();
+
+				if (trace)
+					AddEvent(i, ProfilePhases::Forward, 0ull, time, forward);
+				time += forward;
+				busy += forward;
+			}
+			Phases[UInt(ProfilePhases::Forward)].Add(busy - input);
+
+			const auto recomputed = Microseconds(recompute);
+			Phases[UInt(ProfilePhases::Recompute)].Add(recomputed);
+			if (trace)
+				AddEvent(0ull, ProfilePhases::Recompute, 0ull, time, recomputed);
+			time += recomputed;
+			busy += recomputed;
+
+			auto backward = Float(0);
+			for (auto i = layers.size() - 1ull; i > 0ull; i--)
+			{
+				const auto& layer = *layers[i];
+				auto& profile = Layers[i];
+
+				const auto bprop = Microseconds(layer.bpropTime);
+				if (bprop > Float(0))
+				{
+					profile.Backward.Add(bprop);
+					profile.BackwardFlops += BackwardFlops(layer, batchSize);
+					profile.BackwardBytes += BackwardBytes(layer, batchSize);
+				}
+				if (trace)
+					AddEvent(i, ProfilePhases::Backward, 0ull, time, bprop);
+				time += bprop;
+				backward += bprop;
+
+				const auto updated = Microseconds(layer.updateTime);
+				if (updated > Float(0))
+				{
+					profile.Update.Add(updated);
+					update += updated;
+
+					if (trace)
+						AddEvent(i, ProfilePhases::Update, overlapUpdates ? 1ull : 0ull, time, updated);
+					if (!overlapUpdates)
+						time += updated;
+				}
+			}
+			Phases[UInt(ProfilePhases::Backward)].Add(backward);
+			Phases[UInt(ProfilePhases::Update)].Add(update);
+			busy += backward + (overlapUpdates ? Float(0) : update);
+
+			const auto wait = std::max(Float(0), Microseconds(elapsed) - busy);
+			Phases[UInt(ProfilePhases::Wait)].Add(wait);
+			if (trace)
+				AddEvent(0ull, ProfilePhases::Wait, 0ull, time, wait);
+
+			BatchSize = batchSize;
+			Steps++;
+		}
+
+		bool SaveTrace(const std::string& fileName)
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			std::fstream file;
+			file.open(fileName, std::ios::out | std::ios::trunc);
+			if (!file)
+				return false;
+
+			file << std::fixed << std::setprecision(3);
+			file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << nwl;
+			file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Training\"}}," << nwl;
+			file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Update worker\"}}";
+
+			for (const auto& event : Trace)
+			{
+				const auto phase = std::string(magic_enum::enum_name<ProfilePhases>(event.Phase));
+				const auto layerPhase = event.Phase == ProfilePhases::Forward || event.Phase == ProfilePhases::Backward || event.Phase == ProfilePhases::Update;
+				const auto name = layerPhase ? Escape(Names[event.Layer]) : phase;
+
+				file << "," << nwl << "{\"name\":\"" << name << "\",\"cat\":\"" << phase << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.Thread << ",\"ts\":" << event.Start << ",\"dur\":" << event.Duration;
+				if (layerPhase)
+					file << ",\"args\":{\"type\":\"" << magic_enum::enum_name<LayerTypes>(Types[event.Layer]) << "\",\"step\":" << event.Step << "}";
+				file << "}";
+			}
+
+			file << nwl << "]}" << nwl;
+			file.close();
+
+			return true;
+		}
+
+		// one row per layer followed by the breakdown of a step in phases, times in milliseconds
+		bool SaveSummary(const std::string& fileName)
+		{
+			const std::lock_guard<std::mutex> lock(Lock);
+
+			std::fstream file;
+			file.open(fileName, std::ios::out | std::ios::trunc);
+			if (!file)
+				return false;
+
+			const auto ms = [](const Float microseconds) { return microseconds / Float(1000); };
+			const auto rate = [](const Float amount, const Float microseconds) { return microseconds > Float(0) ? amount / (microseconds * Float(1000)) : Float(0); };	// per second in G
+
+			file << std::fixed << std::setprecision(4);
+			file << "Layer,Type,Kernel,Steps,Forward,Forward p50,Forward p95,Forward max,Backward,Backward p50,Backward p95,Backward max,Update,Reorders,Forward GFLOP/s,Backward GFLOP/s,GB/s,FLOP/byte,Bound" << nwl;
+
+			for (auto i = 1ull; i < Layers.size(); i++)
+			{
+				const auto& profile = Layers[i];
+				const auto flops = profile.ForwardFlops + profile.BackwardFlops;
+				const auto bytes = profile.ForwardBytes + profile.BackwardBytes;
+				const auto intensity = bytes > Float(0) ? flops / bytes : Float(0);
+
+				file << Names[i] << "," << magic_enum::enum_name<LayerTypes>(Types[i]) << "," << (IsPrimitive(Types[i]) ? "oneDNN" : "custom") << "," << profile.Forward.Samples << ",";
+				file << ms(profile.Forward.Mean()) << "," << ms(profile.Forward.Percentile(Float(0.5))) << "," << ms(profile.Forward.Percentile(Float(0.95))) << "," << ms(profile.Forward.Max) << ",";
+				file << ms(profile.Backward.Mean()) << "," << ms(profile.Backward.Percentile(Float(0.5))) << "," << ms(profile.Backward.Percentile(Float(0.95))) << "," << ms(profile.Backward.Max) << ",";
+				file << ms(profile.Update.Mean()) << "," << profile.Reorders << ",";
+				file << rate(profile.ForwardFlops, profile.Forward.Sum) << "," << rate(profile.BackwardFlops, profile.Backward.Sum) << "," << rate(bytes, profile.Forward.Sum + profile.Backward.Sum) << ",";
+				file << intensity << "," << (intensity < RidgePoint ? "memory" : "compute") << nwl;
+			}
+
+			file << nwl << "Phase,Steps,Mean,p50,p95,Max,Share" << nwl;
+
+			auto total = Float(0);
+			for (const auto& phase : Phases)
+				total += phase.Sum;
+
+			for (auto p = 0ull; p < Phases.size(); p++)
+			{
+				const auto& phase = Phases[p];
+				file << magic_enum::enum_name<ProfilePhases>(ProfilePhases(p)) << "," << phase.Samples << "," << ms(phase.Mean()) << "," << ms(phase.Percentile(Float(0.5))) << "," << ms(phase.Percentile(Float(0.95))) << "," << ms(phase.Max) << "," << (total > Float(0) ? phase.Sum / total : Float(0)) << nwl;
+			}
+
+			file.close();
+
+			return true;
+		}
+	};
+}
@@ -0,0 +1,310 @@
+#pragma once
+#include "Definition.h"
+
+namespace dnn
+{
+	enum class PruneCriteria
+	{
+		Gamma = 0,	// |gamma| of the first batch normalization after the convolution, the L1 norm without a scaled one
+		L1 = 1		// L1 norm of the filters of the convolution
+	};
+
+	// a convolution, the channel-wise layers that only pass its channels on and the layers reading them
+	struct PruneGroup
+	{
+		Layer* Producer;
+		std::vector<Layer*> Chain;		// the producer and the channel-wise layers after it
+		std::vector<Layer*> Consumers;	// convolutions and dense layers, only their input channels change
+		std::vector<UInt> Keep;			// the channels that stay, ascending
+	};
+
+	struct PruneInfo
+	{
+		UInt Groups;
+		UInt Channels;			// output channels of the pruned convolutions
+		UInt PrunedChannels;
+		UInt Weights;			// weights of the whole model
+		UInt PrunedWeights;
+	};
+
+	// Structured channel pruning: the output channels of a convolution are ranked by |gamma| of its batch normalization
+	// or by the L1 norm of their filters and the weakest are removed from the convolution, from the channel-wise layers
+	// after it and from the input channels of the layers reading them. The result is a smaller dense definition with the
+	// remaining weights, ready to be fine-tuned. Kept channel counts are rounded up to the vector size of the blocked format.
+	class Pruner
+	{
+	public:
+		static std::vector<PruneGroup> Groups(const Model& model)
+		{
+			auto groups = std::vector<PruneGroup>();
+
+			for (const auto& layer : model.Layers)
+			{
+				if (!IsGroupConvolution(*layer, 1ull))
+					continue;
+
+				auto group = PruneGroup{ layer.get(), std::vector<Layer*>({ layer.get() }), std::vector<Layer*>(), std::vector<UInt>() };
+
+				auto last = layer.get();
+				while (last->Outputs.size() == 1ull && !last->LayerBeforeCost && IsChannelwise(*last->Outputs[0]))
+				{
+					last = last->Outputs[0];
+					group.Chain.push_back(last);
+				}
+
+				auto eligible = !last->LayerBeforeCost && !last->Outputs.empty();
+				for (const auto output : last->Outputs)
+					eligible &= IsGroupConvolution(*output, 1ull) || output->LayerType == LayerTypes::Dense;
+
+				if (eligible)
+				{
+					group.Consumers = last->Outputs;
+					groups.push_back(group);
+				}
+			}
+
+			return groups;
+		}
+
+		static std::vector<Float> Scores(Model& model, const PruneGroup& group, const PruneCriteria criteria)
+		{
+			const auto C = group.Producer->C;
+			auto scores = std::vector<Float>(C, Float(0));
+
+			if (criteria == PruneCriteria::Gamma)
+				for (const auto layer : group.Chain)
+					if (layer->IsBatchNorm() && layer->Scaling && layer->WeightCount == C)
+					{
+						const auto gamma = PersistedWeights(model, *layer);
+						for (auto c = 0ull; c < C; c++)
+							scores[c] = std::abs(gamma[c]);
+
+						return scores;
+					}
+
+			const auto weights = PersistedWeights(model, *group.Producer);
+			const auto filterSize = group.Producer->WeightCount / C;
+			for (auto c = 0ull; c < C; c++)
+				for (auto i = 0ull; i < filterSize; i++)
+					scores[c] += std::abs(weights[c * filterSize + i]);
+
+			return scores;
+		}
+
+		// the definition with the Channels of the pruned convolutions changed, in normalized form
+		static std::string PrunedDefinition(const std::string& definition, const std::vector<PruneGroup>& groups)
+		{
+			auto channels = std::unordered_map<std::string, UInt>();
+			for (const auto& group : groups)
+				channels[group.Producer->Name] = group.Keep.size();
+
+			const auto normalized = NormalizeDefinition(definition);
+
+			auto pruned = std::string();
+			pruned.reserve(normalized.size());
+
+			auto section = std::string();
+			auto begin = 0ull;
+			while (begin < normalized.size())
+			{
+				auto end = normalized.find(nwl, begin);
+				if (end == std::string::npos)
+					end = normalized.size();
+
+				const auto line = normalized.substr(begin, end - begin);
+				if (!line.empty() && line[0] == '[')
+					section = line.substr(1ull, line.find(']') - 1ull);
+
+				const auto found = channels.find(section);
+				if (found != channels.end() && line.rfind("Channels=", 0) == 0)
+					pruned += "Channels=" + std::to_string(found->second);
+				else
+					pruned += line;
+
+				if (end < normalized.size())
+					pruned += nwl;
+
+				begin = end + nwl.size();
+			}
+
+			return pruned;
+		}
+
+		// ratio is the part of the channels of every eligible convolution that is removed
+		static Model* Prune(Model& model, const Float ratio, const PruneCriteria criteria, CheckMsg& msg, PruneInfo& info)
+		{
+			info = PruneInfo{ 0ull, 0ull, 0ull, 0ull, 0ull };
+
+			if (ratio <= Float(0) || ratio >= Float(1))
+			{
+				msg = CheckMsg(0, 0, "The pruning ratio must be between 0 and 1", true);
+				return nullptr;
+			}
+
+			model.SwitchInplaceBwd(false);
+
+			auto groups = std::vector<PruneGroup>();
+			for (auto& group : Groups(model))
+			{
+				const auto C = group.Producer->C;
+				const auto removed = static_cast<UInt>(std::floor(Float(C) * ratio));
+				const auto rounded = ((C - removed + VectorSize - 1ull) / VectorSize) * VectorSize;
+				const auto keepCount = std::min<UInt>(C, std::max<UInt>(rounded, std::min<UInt>(VectorSize, C)));
+
+				if (keepCount == C)
+					continue;
+
+				const auto scores = Scores(model, group, criteria);
+				auto order = std::vector<UInt>(C);
+				std::iota(order.begin(), order.end(), 0ull);
+				std::stable_sort(order.begin(), order.end(), [&](const UInt a, const UInt b) { return scores[a] > scores[b]; });
+
+				group.Keep = std::vector<UInt>(order.begin(), order.begin() + keepCount);
+				std::sort(group.Keep.begin(), group.Keep.end());
+
+				info.Channels += C;
+				info.PrunedChannels += keepCount;
+				groups.push_back(group);
+			}
+
+			if (groups.empty())
+			{
+				msg = CheckMsg(0, 0, "No convolution can be pruned at this ratio", true);
+				return nullptr;
+			}
+
+			auto pruned = std::unique_ptr<Model>(Read(PrunedDefinition(model.Definition, groups), model.DataProv, msg));
+			if (!pruned || msg.Error || pruned->Layers.size() != model.Layers.size())
+				return nullptr;
+
+			// the channels that stay in the output of a layer
+			auto keep = std::unordered_map<const Layer*, const std::vector<UInt>*>();
+			for (const auto& group : groups)
+				for (const auto layer : group.Chain)
+					keep[layer] = &group.Keep;
+
+			for (auto i = 0ull; i < model.Layers.size(); i++)
+			{
+				auto& layer = *model.Layers[i];
+				auto& target = *pruned->Layers[i];
+
+				const auto output = keep.find(&layer);
+				const auto input = layer.InputLayerFwd ? keep.find(layer.InputLayerFwd) : keep.end();
+
+				if (output == keep.end() && input == keep.end())
+				{
+					auto stream = std::stringstream(std::ios::in | std::ios::out | std::ios::binary);
+					layer.Save(stream);
+					target.Load(stream);
+				}
+				else if (!PruneLayer(model, layer, target, output != keep.end() ? output->second : nullptr, input != keep.end() ? input->second : nullptr))
+				{
+					msg = CheckMsg(0, 0, "The weights of layer " + layer.Name + " can't be pruned", true);
+					return nullptr;
+				}
+
+				info.Weights += layer.WeightCount;
+				info.PrunedWeights += target.WeightCount;
+			}
+
+			info.Groups = groups.size();
+
+			return pruned.release();
+		}
+
+	private:
+		static bool IsGroupConvolution(const Layer& layer, const UInt groups)
+		{
+			return layer.LayerType == LayerTypes::Convolution && dynamic_cast<const Convolution&>(layer).Groups == groups;
+		}
+
+		static bool IsChannelwise(const Layer& layer)
+		{
+			return layer.Inputs.size() == 1ull && (layer.IsBatchNorm() || layer.LayerType == LayerTypes::Activation || layer.LayerType == LayerTypes::Dropout);
+		}
+
+		// the weights in the layout they are saved in (see Layer::Save)
+		static FloatVector PersistedWeights(Model& model, Layer& layer)
+		{
+			auto weights = FloatVector(layer.WeightCount);
+
+			if (*layer.WeightsMemDesc != *layer.PersistWeightsMemDesc)
+			{
+				auto memWeights = dnnl::memory(*layer.WeightsMemDesc, model.Device.engine, layer.Weights.data());
+				auto weightsMem = dnnl::memory(*layer.PersistWeightsMemDesc, model.Device.engine, weights.data());
+				dnnl::reorder(memWeights, weightsMem).execute(model.Device.stream, { {DNNL_ARG_FROM, memWeights}, {DNNL_ARG_TO, weightsMem} });
+				model.Device.stream.wait();
+			}
+			else
+				std::copy_n(layer.Weights.data(), layer.WeightCount, weights.data());
+
+			return weights;
+		}
+
+		template<typename T>
+		static bool CopyStats(Layer& layer, Layer& target, const std::vector<UInt>* output)
+		{
+			const auto source = dynamic_cast<T*>(&layer);
+			const auto destination = dynamic_cast<T*>(&target);
+			if (!source || !destination)
+				return false;
+
+			for (auto c = 0ull; c < target.C; c++)
+			{
+				const auto k = output ? (*output)[c] : c;
+				destination->RunningMean[c] = source->RunningMean[k];
+				destination->RunningVariance[c] = source->RunningVariance[k];
+			}
+
+			return true;
+		}
+
+		// output and input are the channels that stay in the output of the layer and in the output of its input layer
+		static bool PruneLayer(Model& model, Layer& layer, Layer& target, const std::vector<UInt>* output, const std::vector<UInt>* input)
+		{
+			if (layer.HasWeights)
+			{
+				// a layer that has not been initialized yet keeps its weights in the saved layout
+				if (*target.WeightsMemDesc != *target.PersistWeightsMemDesc)
+					return false;
+
+				const auto weights = PersistedWeights(model, layer);
+
+				if (layer.LayerType == LayerTypes::Convolution || layer.LayerType == LayerTypes::Dense)
+				{
+					if (!IsGroupConvolution(layer, 1ull) && layer.LayerType != LayerTypes::Dense)
+						return false;
+
+					// o, i, kernel
+					const auto I = layer.InputLayerFwd->C;
+					const auto kernel = layer.WeightCount / (layer.C * I);
+					const auto prunedI = target.InputLayerFwd->C;
+
+					for (auto o = 0ull; o < target.C; o++)
+						for (auto i = 0ull; i < prunedI; i++)
+						{
+							const auto src = (output ? (*output)[o] : o) * I + (input ? (*input)[i] : i);
+							std::copy_n(&weights[src * kernel], kernel, &target.Weights[(o * prunedI + i) * kernel]);
+						}
+				}
+				else if (layer.WeightCount == layer.C)
+				{
+					for (auto c = 0ull; c < target.C; c++)
+						target.Weights[c] = weights[output ? (*output)[c] : c];
+				}
+				else
+					return false;
+
+				for (auto c = 0ull; c < target.BiasCount; c++)
+					target.Biases[c] = layer.Biases[output ? (*output)[c] : c];
+
+				target.LockUpdate.store(layer.LockUpdate.load());
+			}
+
+			if (layer.IsBatchNorm())
+				return CopyStats<BatchNorm>(layer, target, output) || CopyStats<BatchNormActivation>(layer, target, output) || CopyStats<BatchNormActivationDropout>(layer, target, output) || CopyStats<BatchNormRelu>(layer, target, output);
+
+			return true;
+		}
+	};
+}
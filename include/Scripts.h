@@ -336,7 +336,7 @@ namespace scripts
         {
             if (activation == "Relu")
                 return "[" + group + prefix + std::to_string(id) + "]" + nwl +
-                    "Type=BatchNormActivationRelu" + nwl +
+                    "Type=BatchNormRelu" + nwl +
                     "Inputs=" + inputs + nwl + nwl;
             else
                 return "[" + group + prefix + std::to_string(id) + "]" + nwl +
@@ -352,7 +352,7 @@ namespace scripts
                 if (activation == scripts::Activations::Relu)
                     return 
                         "[" + group + prefix + std::to_string(id) + "]" + nwl +
-                        "Type=BatchNormActivationRelu" + nwl +
+                        "Type=BatchNormRelu" + nwl +
                         "Inputs=" + inputs + nwl + nwl;
                 else
                     return 
@@ -391,7 +391,7 @@ namespace scripts
                 if (activation == scripts::Activations::Relu)
                     return 
                         "[" + group + prefix + std::to_string(id) + "]" + nwl +
-                        "Type=BatchNormActivationRelu" + nwl +
+                        "Type=BatchNormRelu" + nwl +
                         "Inputs=" + inputs + nwl + nwl;
                 else
                     return 
@@ -1,5 +1,5 @@
 #pragma once
-#include "Layer.h"
+#include "FusedEpilogue.h"
 
 namespace dnn
 {
@@ -16,6 +16,7 @@ namespace dnn
 	public:
 		const Byte first, second;
 		FloatVector SurvivalProbability;
+		FusedEpilogue Epilogue;
 
 		Substract(const dnn::Device& device, const dnnl::memory::format_tag format, const std::string& name, const std::vector<Layer*>& inputs) :
 			Layer(device, format, name, LayerTypes::Substract, 0, 0, inputs[GetFirst(inputs)]->C, inputs[GetFirst(inputs)]->D, inputs[GetFirst(inputs)]->H, inputs[GetFirst(inputs)]->W, 0, 0, 0, inputs),
@@ -281,6 +282,8 @@ namespace dnn
 					}
 				}
 			}
+			else if (Epilogue.Enabled())
+				Epilogue.ForwardProp(*this, *Inputs[first], *Inputs[second], batchSize, [](const auto& a, const auto& b) { return a - b; });
 			else
 			{
 #ifdef DNN_CACHE_PRIMITIVES
@@ -0,0 +1,117 @@
+#pragma once
+#include "Layer.h"
+
+namespace dnn
+{
+	// Runs the optimizer step of the layers handed over during the backward pass on a background thread, so the
+	// bandwidth-bound weight updates overlap the compute-bound backward pass of the layers below.
+	// A layer keeps its Bwd flag raised until its update has been applied.
+	class UpdateWorker
+	{
+	private:
+		struct Update
+		{
+			Layer* Target;
+			TrainingRate Rate;
+			Optimizers Optimizer;
+			bool DisableLocking;
+		};
+
+		std::thread Worker;
+		std::mutex Lock;
+		std::condition_variable Changed;
+		std::condition_variable Drained;
+		std::deque<Update> Queue;
+		UInt Pending;
+		bool Stopping;
+		std::chrono::duration<Float> UpdateTime;
+
+		void Run()
+		{
+			auto timer = std::chrono::high_resolution_clock();
+
+			while (true)
+			{
+				auto update = Update();
+				{
+					auto lock = std::unique_lock<std::mutex>(Lock);
+
+					Changed.wait(lock, [this]() { return Stopping || !Queue.empty(); });
+					if (Queue.empty())
+						return;
+
+					update = Queue.front();
+					Queue.pop_front();
+				}
+
+				const auto timePoint = timer.now();
+				update.Target->UpdateWeights(update.Rate, update.Optimizer, update.DisableLocking);
+				update.Target->updateTime = timer.now() - timePoint;
+				update.Target->Bwd.store(false);
+
+				{
+					const std::lock_guard<std::mutex> lock(Lock);
+					UpdateTime += update.Target->updateTime;
+					Pending--;
+				}
+				Drained.notify_all();
+			}
+		}
+
+	public:
+		UpdateWorker() :
+			Queue(std::deque<Update>()),
+			Pending(0),
+			Stopping(false),
+			UpdateTime(std::chrono::duration<Float>(Float(0)))
+		{
+		}
+
+		~UpdateWorker()
+		{
+			Stop();
+		}
+
+		void Push(Layer* layer, const TrainingRate& rate, const Optimizers optimizer, const bool disableLocking)
+		{
+			{
+				const std::lock_guard<std::mutex> lock(Lock);
+
+				if (!Worker.joinable())
+				{
+					Stopping = false;
+					Worker = std::thread(&UpdateWorker::Run, this);
+				}
+
+				Queue.push_back(Update{ layer, rate, optimizer, disableLocking });
+				Pending++;
+			}
+			Changed.notify_one();
+		}
+
+		// waits until every handed over update is applied and returns their total time since the previous join
+		std::chrono::duration<Float> Join()
+		{
+			auto lock = std::unique_lock<std::mutex>(Lock);
+
+			Drained.wait(lock, [this]() { return Pending == 0ull; });
+
+			const auto updateTime = UpdateTime;
+			UpdateTime = std::chrono::duration<Float>(Float(0));
+
+			return updateTime;
+		}
+
+		void Stop()
+		{
+			{
+				const std::lock_guard<std::mutex> lock(Lock);
+				Stopping = true;
+			}
+			Changed.notify_all();
+
+			if (Worker.joinable())
+				Worker.join();
+		}
+	};
+}
@@ -57,7 +57,9 @@
 //#include <bit>
 #include <cfenv>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <exception>
 #include <execution>
 #include <filesystem>
@@ -114,7 +116,6 @@ namespace
 	constexpr auto Inplace = true;
 	constexpr auto Kahan = true;
 	constexpr auto Reference = false;
-	constexpr auto SingleMeanVariancePass = false;
 	constexpr auto TestActivations = false;
 	constexpr auto TestBatchNormalization = false;
 	// constexpr auto TestConcat = false;
@@ -158,16 +159,22 @@ namespace
 #if defined(DNN_AVX512BW) || defined(DNN_AVX512)
 	typedef Vec16f VecFloat;
 	typedef Vec16fb VecFloatBool;
+	typedef uint16_t VecFloatBits;
+	typedef Vec16ui VecUInt;
 	constexpr auto VectorSize = 16ull;
 	constexpr auto BlockedFmt = dnnl::memory::format_tag::nChw16c;
 #elif defined(DNN_AVX2) || defined(DNN_AVX)
 	typedef Vec8f VecFloat;
 	typedef Vec8fb VecFloatBool;
+	typedef uint8_t VecFloatBits;
+	typedef Vec8ui VecUInt;
 	constexpr auto VectorSize = 8ull;
 	constexpr auto BlockedFmt = dnnl::memory::format_tag::nChw8c;
 #elif defined(DNN_SSE42) || defined(DNN_SSE41)
 	typedef Vec4f VecFloat;
 	typedef Vec4fb VecFloatBool;
+	typedef uint8_t VecFloatBits;
+	typedef Vec4ui VecUInt;
 	constexpr auto VectorSize = 4ull;
 	constexpr auto BlockedFmt = dnnl::memory::format_tag::nChw4c;
 #endif
@@ -385,8 +392,11 @@ namespace
 		T* dataPtr = nullptr;
 		size_type nelems = 0;
 		dnnl::memory::desc description;
+		std::unique_ptr<dnnl::memory> reservedPtr = nullptr;
+		size_type capacity = 0;
 
 	public:
+		// drops the view, a reserved buffer is kept until unreserve()
 		void release() NOEXCEPT
 		{
 			if (arrPtr)
@@ -396,6 +406,31 @@ namespace
 			arrPtr = nullptr;
 			dataPtr = nullptr;			
 		}
+		// keeps a buffer of elements, a later resize up to that size binds to it instead of allocating
+		void reserve(const size_type elements, const dnnl::engine& engine) NOEXCEPT
+		{
+			if (elements <= capacity)
+				return;
+
+			const auto md = description;
+			const auto bound = nelems > 0;
+
+			AlignedMemory::release();
+
+			reservedPtr = std::make_unique<dnnl::memory>(dnnl::memory::desc(dnnl::memory::dims({ dnnl::memory::dim(elements * sizeof(T)) }), dnnl::memory::data_type::u8, dnnl::memory::format_tag::a), engine);
+			capacity = reservedPtr ? elements : 0;
+
+			if (bound)
+				AlignedMemory::resizeMem(md, engine);
+		}
+		void unreserve() NOEXCEPT
+		{
+			if (reservedPtr && dataPtr == static_cast<T*>(reservedPtr->get_data_handle()))
+				AlignedMemory::release();
+
+			reservedPtr = nullptr;
+			capacity = 0;
+		}
 		AlignedMemory() NOEXCEPT { }
 		AlignedMemory(const dnnl::memory::desc& md, const dnnl::engine& engine, const T value = T()) NOEXCEPT
 		{
@@ -442,7 +477,10 @@ namespace
 
 				if (md.get_size() / sizeof(T) > 0)
 				{
-					arrPtr = std::make_unique<dnnl::memory>(md, engine);
+					if (md.get_size() / sizeof(T) <= capacity)
+						arrPtr = std::make_unique<dnnl::memory>(md, engine, reservedPtr->get_data_handle());
+					else
+						arrPtr = std::make_unique<dnnl::memory>(md, engine);
 					if (arrPtr)
 					{
 						dataPtr = static_cast<T*>(arrPtr->get_data_handle());
@@ -465,6 +503,20 @@ namespace
 				}
 			}
 		}
+		// wraps memory owned by someone else (e.g. a planned arena), release() only drops the reference
+		void bind(const dnnl::memory::desc& md, const dnnl::engine& engine, T* handle) NOEXCEPT
+		{
+			AlignedMemory::unreserve();
+			AlignedMemory::release();
+
+			if (md && handle)
+			{
+				arrPtr = std::make_unique<dnnl::memory>(md, engine, handle);
+				dataPtr = handle;
+				nelems = md.get_size() / sizeof(T);
+				description = md;
+			}
+		}
 		void resize(const size_type n, const size_type c, const dnnl::memory::data_type dtype, const dnnl::memory::format_tag format, const dnnl::engine& engine, const T value = T()) NOEXCEPT
 		{
 			AlignedMemory::resizeMem(dnnl::memory::desc(dnnl::memory::dims({ dnnl::memory::dim(n), dnnl::memory::dim(c) }), dtype, format), engine, value);
@@ -518,6 +570,103 @@ namespace
 		else
 			sum += value;
 	}
+
+	/* https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Parallel_algorithm */
+	// Single pass mean and variance of a channel (T = Float) or of one channel per lane of a nChw8c/nChw16c block (T = VecFloat).
+	// Every tile is reduced while it sits in L1 (sum, then squared deviations from the tile mean) and the tile statistics
+	// are merged with Chan's formula, so no E[x^2] - E[x]^2 cancellation and only one pass over memory.
+	template<typename T>
+	struct MeanVariance
+	{
+		static constexpr auto TileSize = 4096ull;	// floats
+
+		T Mean;
+		T M2;
+		Float Count;
+
+		MeanVariance() :
+			Mean(T(0)),
+			M2(T(0)),
+			Count(Float(0))
+		{
+		}
+
+		inline void Merge(const T& mean, const T& m2, const Float count) NOEXCEPT
+		{
+			const auto total = Count + count;
+			const auto delta = mean - Mean;
+			Mean += delta * (count / total);
+			M2 += m2 + delta * delta * (Count * count / total);
+			Count = total;
+		}
+
+		// count contiguous floats (T = Float) or count contiguous vectors (T = VecFloat)
+		inline void Add(const Float* src, const UInt count) NOEXCEPT
+		{
+			if constexpr (std::is_same_v<T, Float>)
+			{
+				for (auto tile = 0ull; tile < count; tile += TileSize)
+				{
+					const auto p = src + tile;
+					const auto size = std::min<UInt>(TileSize, count - tile);
+					const auto part = GetVectorPart(size);
+
+					auto vecSum = VecFloat(0);
+					auto sum = Float(0);
+					for (auto i = 0ull; i < part; i += VectorSize)
+						vecSum += VecFloat().load(p + i);
+					for (auto i = part; i < size; i++)
+						sum += p[i];
+					const auto mean = (sum + horizontal_add(vecSum)) / Float(size);
+
+					auto vecM2 = VecFloat(0);
+					auto m2 = Float(0);
+					for (auto i = 0ull; i < part; i += VectorSize)
+					{
+						const auto delta = VecFloat().load(p + i) - mean;
+						vecM2 = mul_add(delta, delta, vecM2);
+					}
+					for (auto i = part; i < size; i++)
+						m2 += Square<Float>(p[i] - mean);
+
+					Merge(mean, m2 + horizontal_add(vecM2), Float(size));
+				}
+			}
+			else
+			{
+				constexpr auto tileVectors = TileSize / VectorSize;
+				for (auto tile = 0ull; tile < count; tile += tileVectors)
+				{
+					const auto p = src + tile * VectorSize;
+					const auto size = std::min<UInt>(tileVectors, count - tile) * VectorSize;
+
+					auto sum = VecFloat(0);
+					for (auto i = 0ull; i < size; i += VectorSize)
+						sum += VecFloat().load_a(p + i);
+					const auto mean = sum / Float(size / VectorSize);
+
+					auto m2 = VecFloat(0);
+					for (auto i = 0ull; i < size; i += VectorSize)
+					{
+						const auto delta = VecFloat().load_a(p + i) - mean;
+						m2 = mul_add(delta, delta, m2);
+					}
+
+					Merge(mean, m2, Float(size / VectorSize));
+				}
+			}
+		}
+
+		inline T Variance() const NOEXCEPT
+		{
+			return Count > Float(0) ? M2 / Count : T(0);
+		}
+
+		inline T UnbiasedVariance() const NOEXCEPT
+		{
+			return Count > Float(1) ? M2 / (Count - Float(1)) : T(0);
+		}
+	};
 	
 #if defined(_WIN32) || defined(__CYGWIN__) || defined(__MINGW32__)
 	const auto nwl = std::string("\r\n");
@@ -578,6 +727,51 @@ namespace
 #endif
 	}
 
+	/* Threefry-2x32-20, Salmon et al. "Parallel random numbers: as easy as 1, 2, 3" */
+	// Counter-based generator (T = uint32_t or VecUInt): the value depends only on the key and the counter,
+	// so any element of a random stream can be (re)generated by any thread in any order.
+	template<typename T>
+	inline T Threefry(T x0, T x1, const uint32_t key0, const uint32_t key1) NOEXCEPT
+	{
+		constexpr uint32_t rotations[8] = { 13u, 15u, 26u, 6u, 17u, 29u, 16u, 24u };
+		const uint32_t keys[3] = { key0, key1, 0x1BD11BDAu ^ key0 ^ key1 };
+
+		x0 += keys[0];
+		x1 += keys[1];
+		for (auto round = 0u; round < 20u; round++)
+		{
+			x0 += x1;
+			x1 = (x1 << rotations[round % 8u]) | (x1 >> (32u - rotations[round % 8u]));
+			x1 ^= x0;
+
+			if (round % 4u == 3u)
+			{
+				const auto injection = round / 4u + 1u;
+				x0 += keys[injection % 3u];
+				x1 += keys[(injection + 1u) % 3u] + injection;
+			}
+		}
+
+		return x0;
+	}
+
+	// Dropout keep mask (1 = kept) of element index in training step step, identical in the Float and the VecFloat path
+	inline Float DropoutMask(const UInt index, const UInt step, const UInt seed, const Float keep) NOEXCEPT
+	{
+		const auto bits = Threefry<uint32_t>(static_cast<uint32_t>(index), static_cast<uint32_t>(step), static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32));
+		
+		return Float(bits >> 8) * Float(1.0 / 16777216.0) < keep ? Float(1) : Float(0);
+	}
+
+	// masks of the elements index .. index + VectorSize - 1
+	inline VecFloat DropoutMaskVec(const UInt index, const UInt step, const UInt seed, const Float keep) NOEXCEPT
+	{
+		alignas(64) static constexpr uint32_t lanes[16] = { 0u, 1u, 2u, 3u, 4u, 5u, 6u, 7u, 8u, 9u, 10u, 11u, 12u, 13u, 14u, 15u };
+		const auto bits = Threefry<VecUInt>(VecUInt(static_cast<uint32_t>(index)) + VecUInt().load_a(lanes), VecUInt(static_cast<uint32_t>(step)), static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32));
+		
+		return select(to_float(bits >> 8) * Float(1.0 / 16777216.0) < keep, VecFloat(1), VecFloat(0));
+	}
+
 	template<typename T>
 	static auto Bernoulli(const Float p = Float(0.5)) NOEXCEPT
 	{
@@ -0,0 +1,127 @@
+#include "Definition.h"
+#include "Scripts.h"
+
+using namespace dnn;
+
+struct BatchNormBenchmarkInfo
+{
+    Float Forward;      // milliseconds, medians of the layer's own ForwardProp and BackwardProp in training steps
+    Float Backward;
+    Float Error;        // largest relative error of the batch variance against a double precision reference
+};
+
+// a 1x1 convolution feeds the layer under test (T1), the head makes it trainable
+std::string BatchNormDefinition(const std::string& type, const UInt channels, const UInt size)
+{
+    using namespace scripts;
+
+    auto net =
+        "[" + type + "]" + nwl +
+        "Dataset=cifar10" + nwl +
+        "Dim=3," + std::to_string(size) + "," + std::to_string(size) + nwl +
+        "WeightsFiller=HeNormal(In,1.000000)" + nwl +
+        "Biases=No" + nwl +
+        "Scaling=Yes" + nwl +
+        "Momentum=0.995000" + nwl +
+        "Eps=0.000100" + nwl + nwl;
+
+    net += ScriptsCatalog::Convolution(1, "Input", channels, 1, 1, 1, 1, 0, 0);
+
+    net +=
+        "[T1]" + nwl +
+        "Type=" + type + nwl +
+        "Inputs=C1" + nwl +
+        (type == "BatchNormActivation" ? "Activation=Relu" + nwl + nwl : nwl);
+
+    net += ScriptsCatalog::GlobalAvgPooling("T1");
+    net += ScriptsCatalog::Dense(1, "GAP", 10, true);
+    net += ScriptsCatalog::LogSoftmax("DS1");
+    net += ScriptsCatalog::Cost("LSM", scripts::Datasets::cifar10, 10);
+
+    return net;
+}
+
+template<typename T>
+BatchNormBenchmarkInfo Benchmark(const std::string& type, const UInt batchSize, const UInt channels, const UInt size, const UInt iterations)
+{
+    auto msg = CheckMsg();
+    auto model = std::unique_ptr<Model>(Read(BatchNormDefinition(type, channels, size), nullptr, msg));
+    if (!model || msg.Error)
+        throw std::runtime_error(type + std::string(": ") + msg.Message);
+
+    const auto found = std::find_if(model->Layers.begin(), model->Layers.end(), [](const std::unique_ptr<Layer>& l) { return l->Name == std::string("T1"); });
+    auto layer = found != model->Layers.end() ? dynamic_cast<T*>(found->get()) : nullptr;
+    if (!layer)
+        throw std::runtime_error(type + std::string(": layer T1 not found"));
+
+    model->BenchmarkStep(batchSize, iterations);
+
+    auto info = BatchNormBenchmarkInfo();
+    info.Forward = layer->fpropTime.count() * Float(1000);
+    info.Backward = layer->bpropTime.count() * Float(1000);
+
+    // a large offset with a small spread is where E[x^2] - E[x]^2 falls apart
+    auto& src = layer->InputLayer->Neurons;
+    const auto plain = layer->InputLayer->IsPlainFormat();
+    const auto paddedC = layer->InputLayer->PaddedC;
+    const auto HW = layer->InputLayer->HW();
+    const auto offset = [&](const UInt n, const UInt c, const UInt hw) { return plain ? (n * channels + c) * HW + hw : n * paddedC * HW + (c / VectorSize) * HW * VectorSize + hw * VectorSize + c % VectorSize; };
+
+    auto generator = std::mt19937(1234u);
+    auto distribution = std::normal_distribution<Float>(Float(8), Float(0.5));
+    for (auto n = 0ull; n < batchSize; n++)
+        for (auto c = 0ull; c < channels; c++)
+            for (auto hw = 0ull; hw < HW; hw++)
+                src[offset(n, c, hw)] = distribution(generator);
+
+    layer->ForwardProp(batchSize, true);
+
+    info.Error = Float(0);
+    for (auto c = 0ull; c < channels; c++)
+    {
+        auto sum = double(0);
+        for (auto n = 0ull; n < batchSize; n++)
+            for (auto hw = 0ull; hw < HW; hw++)
+                sum += double(src[offset(n, c, hw)]);
+        const auto mean = sum / double(batchSize * HW);
+        auto m2 = double(0);
+        for (auto n = 0ull; n < batchSize; n++)
+            for (auto hw = 0ull; hw < HW; hw++)
+                m2 += Square<double>(double(src[offset(n, c, hw)]) - mean);
+        const auto variance = m2 / double(batchSize * HW);
+
+        info.Error = std::max(info.Error, Float(std::abs(double(layer->Variance[c]) - variance) / variance));
+    }
+
+    return info;
+}
+
+// bnbench [batch size] [iterations]
+// BatchNormActivation (blocked Welford statistics) against BatchNormRelu (batch_normalization_forward with a fused ReLU)
+int main(int argc, char* argv[])
+{
+    const auto batchSize = argc > 1 ? std::stoull(argv[1]) : 16ull;
+    const auto iterations = argc > 2 ? std::stoull(argv[2]) : 20ull;
+
+    std::cout << std::string("Batch size: ") << std::to_string(batchSize) << std::string("  Iterations: ") << std::to_string(iterations) << std::endl << std::endl;
+    std::cout << std::string("    C    HW  dnn fwd/bwd ms  oneDNN fwd/bwd ms  speedup   dnn error  oneDNN error") << std::endl;
+
+    try
+    {
+        for (const auto channels : { 64ull, 128ull, 256ull, 512ull, 1024ull })
+            for (const auto size : { 7ull, 14ull, 28ull, 56ull })
+            {
+                const auto info = Benchmark<BatchNormActivation>("BatchNormActivation", batchSize, channels, size, iterations);
+                const auto oneDNN = Benchmark<BatchNormRelu>("BatchNormRelu", batchSize, channels, size, iterations);
+
+                std::cout << std::setw(5) << channels << std::setw(6) << (std::to_string(size) + std::string("^2")) << std::setw(8) << FloatToStringFixed(info.Forward, 3) << std::setw(8) << FloatToStringFixed(info.Backward, 3) << std::setw(11) << FloatToStringFixed(oneDNN.Forward, 3) << std::setw(8) << FloatToStringFixed(oneDNN.Backward, 3) << std::setw(9) << FloatToStringFixed((oneDNN.Forward + oneDNN.Backward) / (info.Forward + info.Backward), 2) << std::setw(12) << FloatToStringScientific(info.Error) << std::setw(14) << FloatToStringScientific(oneDNN.Error) << std::endl;
+            }
+    }
+    catch (const std::exception& exception)
+    {
+        std::cerr << exception.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
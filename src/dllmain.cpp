@@ -1,4 +1,6 @@
-#include "Definition.h"
+#include "Distillation.h"
+#include "InferenceBatcher.h"
+#include "Pruning.h"
 
 using namespace dnn;
 
@@ -107,6 +109,26 @@ extern "C" DNN_API void DNNDataprovider(const std::string& directory)
 	dataprovider = std::make_unique<Dataprovider>(directory);
 }
 
+// zero keeps the geometry, classes or sample counts of the dataset in the definition
+extern "C" DNN_API void DNNSetSyntheticDataset(const bool enable, const UInt c, const UInt d, const UInt h, const UInt w, const UInt classes, const UInt trainingSamples, const UInt testingSamples, const UInt seed)
+{
+	if (dataprovider)
+	{
+		auto parameters = SyntheticDataset();
+		parameters.C = c;
+		parameters.D = d;
+		parameters.H = h;
+		parameters.W = w;
+		if (classes > 0)
+			parameters.ClassCount = std::vector<UInt>({ classes });
+		parameters.TrainingSamplesCount = trainingSamples;
+		parameters.TestingSamplesCount = testingSamples;
+		parameters.Seed = seed;
+
+		dataprovider->SetSynthetic(enable, parameters);
+	}
+}
+
 extern "C" DNN_API bool DNNLoadDataset()
 {
 	if (model)
@@ -215,6 +237,321 @@ extern "C" DNN_API bool DNNSetFormat(const bool plain)
 	return false;
 }
 
+extern "C" DNN_API bool DNNSetCheckpointing(const bool enable, const UInt segmentLength)
+{
+	if (model)
+		return model->SetCheckpointing(enable, segmentLength);
+
+	return false;
+}
+
+extern "C" DNN_API void DNNSetOverlapUpdates(const bool enable)
+{
+	if (model)
+		model->OverlapUpdates = enable;
+}
+
+extern "C" DNN_API void DNNSetFusedCost(const bool enable)
+{
+	if (model)
+		model->FusedCost = enable;
+}
+
+extern "C" DNN_API bool DNNSetEma(const Float decay, const bool testing)
+{
+	if (model && model->SetEma(decay))
+	{
+		model->EmaTesting = testing && decay > Float(0);
+		return true;
+	}
+
+	return false;
+}
+
+extern "C" DNN_API void DNNSetDropoutSeed(const UInt seed)
+{
+	if (model)
+	{
+		model->DropoutSeed = seed;
+		model->DropoutStep = 0;
+	}
+}
+
+// the same seed gives the same initial weights, whatever the thread count
+extern "C" DNN_API void DNNSetWeightsSeed(const UInt seed)
+{
+	if (model)
+		model->WeightsSeed = seed;
+}
+
+extern "C" DNN_API bool DNNSetBitMasks(const bool enable)
+{
+	if (model)
+		return model->SetBitMasks(enable);
+
+	return false;
+}
+
+extern "C" DNN_API void DNNGetReorderInfo(ReorderInfo* info)
+{
+	if (model)
+		*info = model->GetReorders();
+}
+
+extern "C" DNN_API void DNNStartProfiler(const UInt traceSteps)
+{
+	if (model)
+		model->Profile.Start(model->Layers, traceSteps);
+}
+
+extern "C" DNN_API void DNNStopProfiler()
+{
+	if (model)
+		model->Profile.Stop();
+}
+
+extern "C" DNN_API bool DNNSaveProfile(const char* traceFileName, const char* summaryFileName)
+{
+	if (model)
+		return model->Profile.SaveTrace(std::string(traceFileName)) && model->Profile.SaveSummary(std::string(summaryFileName));
+
+	return false;
+}
+
+extern "C" DNN_API void DNNGetCheckpointInfo(CheckpointInfo* info)
+{
+	if (model)
+	{
+		auto checkpoints = 0ull;
+		for (const auto& layer : model->Layers)
+			if (layer->Checkpoint)
+				checkpoints++;
+
+		info->Enabled = model->Checkpointing;
+		info->Segments = model->CheckpointSegments.size();
+		info->Checkpoints = checkpoints;
+		info->NeuronsSize = model->GetNeuronsSize(model->BatchSize);
+		info->CheckpointNeuronsSize = model->GetCheckpointNeuronsSize(model->BatchSize);
+		info->FPropTime = Float(std::chrono::duration_cast<std::chrono::microseconds>(model->fpropTime).count()) / 1000;
+		info->BPropTime = Float(std::chrono::duration_cast<std::chrono::microseconds>(model->bpropTime).count()) / 1000;
+		info->RecomputeTime = Float(std::chrono::duration_cast<std::chrono::microseconds>(model->recomputeTime).count()) / 1000;
+	}
+}
+
+extern "C" DNN_API bool DNNApplyMemoryPlan(const bool enable)
+{
+	if (model)
+	{
+		if (enable)
+			return model->ApplyMemoryPlan();
+		
+		if (model->TaskState.load() == TaskStates::Stopped)
+		{
+			model->ReleaseMemoryPlan();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+extern "C" DNN_API void DNNGetMemoryPlanInfo(MemoryPlanInfo* info)
+{
+	if (model)
+		(*info) = model->GetMemoryPlanInfo();
+}
+
+// Inference sessions: opaque handles, plain C types and no dependency on the global model
+extern "C" DNN_API void* DNNInferenceCreate(const char* definition, const char* weightsFileName, const UInt batchSize, const bool meanStdNormalization)
+{
+	auto msg = CheckMsg();
+	
+	try
+	{
+		return InferenceSession::Create(std::string(definition), std::string(weightsFileName), batchSize, dataprovider.get(), meanStdNormalization, msg).release();
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+extern "C" DNN_API void* DNNInferenceClone(void* session)
+{
+	if (session)
+		return static_cast<InferenceSession*>(session)->Clone().release();
+
+	return nullptr;
+}
+
+extern "C" DNN_API void DNNInferenceDispose(void* session)
+{
+	delete static_cast<InferenceSession*>(session);
+}
+
+extern "C" DNN_API bool DNNInferenceSetBatchSize(void* session, const UInt batchSize)
+{
+	if (session)
+		return static_cast<InferenceSession*>(session)->SetBatchSize(batchSize);
+
+	return false;
+}
+
+extern "C" DNN_API UInt DNNInferenceGetInputSize(void* session)
+{
+	if (session)
+		return static_cast<InferenceSession*>(session)->GetInputSize();
+
+	return 0;
+}
+
+extern "C" DNN_API UInt DNNInferenceGetOutputCount(void* session)
+{
+	if (session)
+		return static_cast<InferenceSession*>(session)->GetOutputCount();
+
+	return 0;
+}
+
+extern "C" DNN_API UInt DNNInferenceGetOutputSize(void* session, const UInt output)
+{
+	if (session)
+		return static_cast<InferenceSession*>(session)->GetOutputSize(output);
+
+	return 0;
+}
+
+extern "C" DNN_API int DNNInferenceRun(void* session, const unsigned char* input, const UInt batchSize, Float* output)
+{
+	if (session)
+		return static_cast<InferenceSession*>(session)->Run(input, batchSize, output) ? 0 : -1;
+
+	return -10;
+}
+
+extern "C" DNN_API int DNNInferenceRunFloat(void* session, const Float* input, const UInt batchSize, Float* output)
+{
+	if (session)
+		return static_cast<InferenceSession*>(session)->Run(input, batchSize, output) ? 0 : -1;
+
+	return -10;
+}
+
+extern "C" DNN_API UInt DNNInferenceSetEarlyExit(void* session, const Float threshold)
+{
+	if (session)
+		return static_cast<InferenceSession*>(session)->SetEarlyExit(threshold);
+
+	return 0;
+}
+
+// output receives the last output per sample, exits the index of the output that answered it
+extern "C" DNN_API int DNNInferenceRunEarlyExit(void* session, const unsigned char* input, const UInt batchSize, Float* output, UInt* exits)
+{
+	if (session)
+		return static_cast<InferenceSession*>(session)->RunEarlyExit(input, batchSize, output, exits) ? 0 : -1;
+
+	return -10;
+}
+
+extern "C" DNN_API void* DNNInferenceBatcherCreate(void* session, const UInt maxBatchSize, const UInt maxDelayMicroseconds)
+{
+	if (session)
+	{
+		try
+		{
+			return new InferenceBatcher(*static_cast<InferenceSession*>(session), maxBatchSize, std::chrono::microseconds(maxDelayMicroseconds));
+		}
+		catch (...)
+		{
+		}
+	}
+
+	return nullptr;
+}
+
+extern "C" DNN_API void DNNInferenceBatcherDispose(void* batcher)
+{
+	delete static_cast<InferenceBatcher*>(batcher);
+}
+
+// blocks until the batch holding this sample has run, output receives InferenceSession::GetOutputsSize values
+extern "C" DNN_API int DNNInferenceBatcherRun(void* batcher, const unsigned char* input, Float* output)
+{
+	if (batcher)
+	{
+		try
+		{
+			const auto result = static_cast<InferenceBatcher*>(batcher)->Submit(input).get();
+			std::copy(result.begin(), result.end(), output);
+
+			return 0;
+		}
+		catch (...)
+		{
+			return -1;
+		}
+	}
+
+	return -10;
+}
+
+extern "C" DNN_API void DNNInferenceBatcherBenchmark(void* batcher, const UInt clients, const UInt requestsPerClient, BatcherBenchmarkInfo* info)
+{
+	if (batcher)
+		(*info) = static_cast<InferenceBatcher*>(batcher)->Benchmark(clients, requestsPerClient);
+}
+
+// runs training steps on random data in a model of its own, the loaded model is left untouched
+extern "C" DNN_API int DNNBenchmarkModel(const char* definition, const UInt batchSize, const UInt iterations, const bool plain, StepBenchmarkInfo* info)
+{
+	try
+	{
+		auto msg = CheckMsg();
+		auto benchmark = std::unique_ptr<Model>(Read(std::string(definition), nullptr, msg));
+		if (!benchmark || msg.Error)
+			return -1;
+
+		benchmark->SetFormat(plain);
+		(*info) = benchmark->BenchmarkStep(batchSize, iterations);
+
+		return 0;
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+// Forward, Backward and Update hold the median times of the named layer, Step and Throughput those of the whole model
+extern "C" DNN_API int DNNBenchmarkLayer(const char* definition, const char* layerName, const UInt batchSize, const UInt iterations, const bool plain, StepBenchmarkInfo* info)
+{
+	try
+	{
+		auto msg = CheckMsg();
+		auto benchmark = std::unique_ptr<Model>(Read(std::string(definition), nullptr, msg));
+		if (!benchmark || msg.Error)
+			return -1;
+
+		const auto name = std::string(layerName);
+		const auto layer = std::find_if(benchmark->Layers.begin(), benchmark->Layers.end(), [&](const std::unique_ptr<Layer>& l) { return l->Name == name; });
+		if (layer == benchmark->Layers.end())
+			return -1;
+
+		benchmark->SetFormat(plain);
+		(*info) = benchmark->BenchmarkStep(batchSize, iterations);
+		info->Forward = (*layer)->fpropTime.count() * Float(1000);
+		info->Backward = (*layer)->bpropTime.count() * Float(1000);
+		info->Update = (*layer)->updateTime.count() * Float(1000);
+
+		return 0;
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
 extern "C" DNN_API void DNNGetConfusionMatrix(const UInt costLayerIndex, std::vector<std::vector<UInt>>* confusionMatrix)
 {
 	if (model && costLayerIndex < model->CostLayers.size())
@@ -357,6 +694,50 @@ extern "C" DNN_API void DNNTesting()
 	}
 }
 
+// scores the test set on the first views of Model::GetTTAViews, averages the logits instead of the cost layer inputs when logits is set
+extern "C" DNN_API int DNNTestingTTA(const UInt views, const bool logits, TTAInfo* info)
+{
+	if (model && dataprovider)
+	{
+		(*info) = model->TestingTTA(views, logits);
+		return info->Samples > 0ull ? 0 : -1;
+	}
+
+	return -1;
+}
+
+extern "C" DNN_API int DNNSetTeacher(const std::string& definition, const std::string& weightsFileName, CheckMsg& checkMsg)
+{
+	if (model)
+	{
+		if (definition.empty())
+		{
+			Distillation::Detach(*model);
+			return 0;
+		}
+
+		return Distillation::Attach(*model, definition, weightsFileName, checkMsg) ? 0 : -1;
+	}
+
+	return -1;
+}
+
+extern "C" DNN_API int DNNPrune(const Float ratio, const UInt criteria, const std::string& definitionFileName, const std::string& weightsFileName, PruneInfo* info)
+{
+	if (model && dataprovider)
+	{
+		auto msg = CheckMsg();
+		auto pruned = std::unique_ptr<Model>(Pruner::Prune(*model, ratio, static_cast<PruneCriteria>(criteria), msg, *info));
+		if (!pruned)
+			return -1;
+
+		pruned->SaveDefinition(definitionFileName);
+		return pruned->SaveWeights(weightsFileName);
+	}
+
+	return -1;
+}
+
 extern "C" DNN_API void DNNStop()
 {
 	if (model)
@@ -394,6 +775,9 @@ extern "C" DNN_API void DNNGetCostInfo(const UInt index, CostInfo* info)
 		info->TestLoss = model->CostLayers[index]->TestLoss;
 		info->AvgTestLoss = model->CostLayers[index]->AvgTestLoss;
 		info->TestErrorPercentage = model->CostLayers[index]->TestErrorPercentage;
+
+		info->TrainErrorsTop5 = model->CostLayers[index]->TrainErrorsTop5;
+		info->TestErrorsTop5 = model->CostLayers[index]->TestErrorsTop5;
 	}
 }
 
@@ -417,22 +801,11 @@ extern "C" DNN_API void DNNGetModelInfo(ModelInfo* info)
 		info->MeanTrainSet.clear();
 		info->StdTrainSet.clear();
 		
-		switch (dataprovider->Dataset)
+		// a synthetic dataset can have any number of channels
+		for (auto c = 0ull; c < dataprovider->Mean.size(); c++)
 		{
-		case Datasets::cifar10:
-		case Datasets::cifar100:
-		case Datasets::tinyimagenet:
-			for (auto c = 0ull; c < 3ull; c++)
-			{
-				info->MeanTrainSet.push_back(dataprovider->Mean[c]);
-				info->StdTrainSet.push_back(dataprovider->StdDev[c]);
-			}
-			break;
-		case Datasets::fashionmnist:
-		case Datasets::mnist:
-			info->MeanTrainSet.push_back(dataprovider->Mean[0]);
-			info->StdTrainSet.push_back(dataprovider->StdDev[0]);
-			break;
+			info->MeanTrainSet.push_back(dataprovider->Mean[c]);
+			info->StdTrainSet.push_back(dataprovider->StdDev[c]);
 		}
 	}
 }
@@ -924,6 +1297,20 @@ extern "C" DNN_API int DNNSaveWeights(const std::string& fileName, const bool pe
 	return -10;
 }
 
+extern "C" DNN_API int DNNSaveEmaWeights(const std::string& fileName)
+{
+	if (model && model->EmaDecay > Float(0) && model->TaskState.load() == TaskStates::Stopped)
+	{
+		model->SwapEma(true);
+		const auto result = model->SaveWeights(fileName, false);
+		model->SwapEma(false);
+
+		return result;
+	}
+
+	return -10;
+}
+
 extern "C" DNN_API int DNNLoadLayerWeights(const std::string& fileName, const UInt layerIndex, const bool persistOptimizer)
 {
 	if (model)
@@ -0,0 +1,222 @@
+#ifndef _WIN32
+  #include <stdlib.h>
+  #define DNN_API extern "C" 
+#else
+#ifdef DNN_DLL
+  #define DNN_API extern "C" __declspec(dllimport)
+#else
+  #define DNN_API extern "C"
+#endif
+#endif
+
+#include "Model.h"
+#include "Scripts.h"
+
+using namespace dnn;
+
+DNN_API int DNNBenchmarkModel(const char* definition, const UInt batchSize, const UInt iterations, const bool plain, dnn::StepBenchmarkInfo* info);
+DNN_API int DNNBenchmarkLayer(const char* definition, const char* layerName, const UInt batchSize, const UInt iterations, const bool plain, dnn::StepBenchmarkInfo* info);
+DNN_API bool DNNCheck(std::string& definition, dnn::CheckMsg& checkMsg);
+
+// a 1x1 convolution feeds the layer under test (named T1, or T for GlobalAvgPooling), the head makes it trainable
+std::string LayerDefinition(const std::string& type, const UInt channels, const UInt size)
+{
+    using namespace scripts;
+
+    auto net =
+        "[" + type + "]" + nwl +
+        "Dataset=cifar10" + nwl +
+        "Dim=3," + std::to_string(size) + "," + std::to_string(size) + nwl +
+        "WeightsFiller=HeNormal(In,1.000000)" + nwl +
+        "Biases=No" + nwl +
+        "Scaling=Yes" + nwl +
+        "Momentum=0.995000" + nwl +
+        "Eps=0.000100" + nwl + nwl;
+
+    net += ScriptsCatalog::Convolution(1, "Input", channels, 1, 1, 1, 1, 0, 0);
+    if (type == "Add" || type == "Concat")
+        net += ScriptsCatalog::Convolution(2, "Input", channels, 1, 1, 1, 1, 0, 0);
+
+    if (type == "Convolution")
+        net += ScriptsCatalog::Convolution(1, "C1", channels, 3, 3, 1, 1, 1, 1, false, "", "T");
+    else if (type == "DepthwiseConvolution")
+        net += ScriptsCatalog::DepthwiseConvolution(1, "C1", 1, 3, 3, 1, 1, 1, 1, false, "", "T");
+    else if (type == "BatchNorm")
+        net += ScriptsCatalog::BatchNorm(1, "C1", "", "T");
+    else if (type == "BatchNormActivation")
+        net += ScriptsCatalog::BatchNormActivation(1, "C1", std::string("HardSwish"), "", "T");
+    else if (type == "BatchNormRelu")
+        net += ScriptsCatalog::BatchNormActivation(1, "C1", std::string("Relu"), "", "T");
+    else if (type == "Activation")
+        net += ScriptsCatalog::Activation(1, "C1", "HardSwish", "", "T");
+    else if (type == "Add")
+        net += ScriptsCatalog::Add(1, "C1,C2", "", "T");
+    else if (type == "Concat")
+        net += ScriptsCatalog::Concat(1, "C1,C2", "", "T");
+    else if (type == "AvgPooling")
+        net += ScriptsCatalog::AvgPooling(1, "C1", "3,3", "2,2", "1,1", "", "T");
+    else if (type == "ChannelSplit")
+        net += ScriptsCatalog::ChannelSplit(1, "C1", 2, 1, "", "T");
+    else if (type == "Shuffle")
+        net += ScriptsCatalog::Shuffle(1, "C1", 2, "", "T");
+    else if (type == "Dropout")
+        net += ScriptsCatalog::Dropout(1, "C1", "", "T");
+
+    if (type == "GlobalAvgPooling")
+        net += ScriptsCatalog::GlobalAvgPooling("C1", "", "T");
+    else
+        net += ScriptsCatalog::GlobalAvgPooling("T1");
+
+    net += ScriptsCatalog::Dense(1, type == "GlobalAvgPooling" ? "T" : "GAP", 10, true);
+    net += ScriptsCatalog::LogSoftmax("DS1");
+    net += ScriptsCatalog::Cost("LSM", scripts::Datasets::cifar10, 10);
+
+    return net;
+}
+
+scripts::ScriptParameters NetworkParameters(const scripts::Scripts script)
+{
+    scripts::ScriptParameters p;
+
+    p.Script = script;
+    p.Dataset = scripts::Datasets::cifar10;
+    p.C = 3;
+    p.H = 32;
+    p.W = 32;
+    p.Groups = 3;
+    p.Iterations = 4;
+    p.Width = script == scripts::Scripts::shufflenetv2 ? 12 : 4;
+    p.GrowthRate = 12;
+    p.Dropout = Float(0);
+    p.Compression = Float(0.5);
+    p.Bottleneck = script == scripts::Scripts::densenet;
+    p.SqueezeExcitation = true;
+    p.ChannelZeroPad = true;
+    p.DepthDrop = Float(0);
+    p.Activation = script == scripts::Scripts::resnet || script == scripts::Scripts::densenet ? scripts::Activations::Relu : scripts::Activations::HardSwish;
+    p.StrideHFirstConv = 1;
+    p.StrideWFirstConv = 1;
+
+    return p;
+}
+
+// the definitions are generated here, one that doesn't parse is a bug in the sweep and must not pass as a failed layer
+bool Parses(const std::string& name, std::string definition)
+{
+    auto msg = CheckMsg();
+    DNNCheck(definition, msg);
+    if (msg.Error)
+        std::cout << std::endl << name << std::string(" doesn't parse (line ") << std::to_string(msg.Row) << std::string(", column ") << std::to_string(msg.Column) << std::string("): ") << msg.Message << std::endl;
+
+    return !msg.Error;
+}
+
+std::string ToJson(const StepBenchmarkInfo& info)
+{
+    return
+        std::string("\"forward_ms\": ") + FloatToStringFixed(info.Forward, 4) +
+        std::string(", \"backward_ms\": ") + FloatToStringFixed(info.Backward, 4) +
+        std::string(", \"update_ms\": ") + FloatToStringFixed(info.Update, 4) +
+        std::string(", \"step_ms\": ") + FloatToStringFixed(info.Step, 4) +
+        std::string(", \"samples_per_second\": ") + FloatToStringFixed(info.Throughput, 1);
+}
+
+// dnn_bench [output.json] [iterations] [filter]
+int main(int argc, char* argv[])
+{
+    const auto fileName = argc > 1 ? std::string(argv[1]) : std::string("dnn_bench.json");
+    const auto iterations = argc > 2 ? std::stoull(argv[2]) : 10ull;
+    const auto filter = argc > 3 ? std::string(argv[3]) : std::string("");
+
+    const auto selected = [&](const std::string& name) { return filter.empty() || name.find(filter) != std::string::npos; };
+
+    auto layers = std::vector<std::string>();
+    auto networks = std::vector<std::string>();
+
+    std::cout << std::string("Iterations: ") << std::to_string(iterations) << std::endl << std::endl;
+    std::cout << std::string("Layer                      N     C    HW  format   fwd ms   bwd ms   upd ms  step ms") << std::endl;
+
+    for (const auto type : { "Convolution", "DepthwiseConvolution", "BatchNorm", "BatchNormActivation", "BatchNormRelu", "Activation", "Add", "Concat", "AvgPooling", "GlobalAvgPooling", "ChannelSplit", "Shuffle", "Dropout" })
+    {
+        const auto name = std::string(type);
+        if (!selected(name))
+            continue;
+
+        for (const auto batchSize : { 16ull, 64ull })
+            for (const auto channels : { 64ull, 128ull, 256ull })
+                for (const auto size : { 7ull, 14ull, 28ull, 56ull })
+                    for (const auto plain : { true, false })
+                    {
+                        const auto definition = LayerDefinition(name, channels, size);
+                        if (!Parses(name, definition))
+                            return 1;
+
+                        const auto layerName = name == "GlobalAvgPooling" ? std::string("T") : std::string("T1");
+                        const auto format = std::string(plain ? "plain" : "blocked");
+
+                        auto info = StepBenchmarkInfo();
+                        if (DNNBenchmarkLayer(definition.c_str(), layerName.c_str(), batchSize, iterations, plain, &info) != 0)
+                        {
+                            std::cout << std::setw(24) << std::left << name << std::right << std::setw(5) << batchSize << std::setw(6) << channels << std::setw(6) << size << std::setw(8) << format << std::string("   failed") << std::endl;
+                            continue;
+                        }
+
+                        std::cout << std::setw(24) << std::left << name << std::right << std::setw(5) << batchSize << std::setw(6) << channels << std::setw(6) << size << std::setw(8) << format << std::setw(9) << FloatToStringFixed(info.Forward, 3) << std::setw(9) << FloatToStringFixed(info.Backward, 3) << std::setw(9) << FloatToStringFixed(info.Update, 3) << std::setw(9) << FloatToStringFixed(info.Step, 3) << std::endl;
+
+                        layers.push_back(std::string("{ \"layer\": \"") + name + std::string("\", \"batch\": ") + std::to_string(batchSize) + std::string(", \"channels\": ") + std::to_string(channels) + std::string(", \"size\": ") + std::to_string(size) + std::string(", \"format\": \"") + format + std::string("\", ") + ToJson(info) + std::string(" }"));
+                    }
+    }
+
+    std::cout << std::endl << std::string("Network                                    N  format  step ms  samples/s") << std::endl;
+
+    for (const auto script : magic_enum::enum_values<scripts::Scripts>())
+    {
+        const auto p = NetworkParameters(script);
+        const auto name = p.GetName();
+        if (!selected(name))
+            continue;
+
+        const auto definition = scripts::ScriptsCatalog::Generate(p);
+        if (!Parses(name, definition))
+            return 1;
+
+        for (const auto batchSize : { 16ull, 64ull })
+            for (const auto plain : { true, false })
+            {
+                const auto format = std::string(plain ? "plain" : "blocked");
+
+                auto info = StepBenchmarkInfo();
+                if (DNNBenchmarkModel(definition.c_str(), batchSize, iterations, plain, &info) != 0)
+                {
+                    std::cout << std::setw(40) << std::left << name << std::right << std::setw(5) << batchSize << std::setw(8) << format << std::string("   failed") << std::endl;
+                    continue;
+                }
+
+                std::cout << std::setw(40) << std::left << name << std::right << std::setw(5) << batchSize << std::setw(8) << format << std::setw(9) << FloatToStringFixed(info.Step, 3) << std::setw(11) << FloatToStringFixed(info.Throughput, 1) << std::endl;
+
+                networks.push_back(std::string("{ \"network\": \"") + name + std::string("\", \"batch\": ") + std::to_string(batchSize) + std::string(", \"format\": \"") + format + std::string("\", ") + ToJson(info) + std::string(" }"));
+            }
+    }
+
+    const auto join = [](const std::vector<std::string>& entries)
+    {
+        auto text = std::string();
+        for (auto i = 0ull; i < entries.size(); i++)
+            text += std::string("    ") + entries[i] + (i + 1ull < entries.size() ? std::string(",\n") : std::string("\n"));
+        return text;
+    };
+
+    auto file = std::ofstream(fileName);
+    if (!file.is_open())
+    {
+        std::cout << std::endl << std::string("Cannot write ") << fileName << std::endl;
+        return -1;
+    }
+
+    file << std::string("{\n  \"iterations\": ") << std::to_string(iterations) << std::string(",\n  \"layers\": [\n") << join(layers) << std::string("  ],\n  \"networks\": [\n") << join(networks) << std::string("  ]\n}\n");
+    file.close();
+
+    std::cout << std::endl << std::string("Results written to ") << fileName << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef _WIN32
+  #include <stdlib.h>
+  #define DNN_API extern "C" 
+#else
+#ifdef DNN_DLL
+  #define DNN_API extern "C" __declspec(dllimport)
+#else
+  #define DNN_API extern "C"
+#endif
+#endif
+
+#include "Model.h"
+
+using namespace dnn;
+
+DNN_API void* DNNInferenceCreate(const char* definition, const char* weightsFileName, const UInt batchSize, const bool meanStdNormalization);
+DNN_API void DNNInferenceDispose(void* session);
+DNN_API void* DNNInferenceBatcherCreate(void* session, const UInt maxBatchSize, const UInt maxDelayMicroseconds);
+DNN_API void DNNInferenceBatcherDispose(void* batcher);
+DNN_API void DNNInferenceBatcherBenchmark(void* batcher, const UInt clients, const UInt requestsPerClient, dnn::BatcherBenchmarkInfo* info);
+
+// inferencebench <definition> <weights> [clients] [requests per client] [max delay in us] [max batch size]...
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cout << std::string("Usage: inferencebench definition weights [clients=64] [requests=100] [delay=2000] [batch sizes=1 16 64]") << std::endl;
+        return 1;
+    }
+
+    auto file = std::ifstream(argv[1]);
+    if (file.bad() || !file.is_open())
+    {
+        std::cout << std::string("Could not open ") << argv[1] << std::endl;
+        return 1;
+    }
+    std::stringstream definition;
+    definition << file.rdbuf();
+    file.close();
+
+    const auto clients = argc > 3 ? std::stoull(argv[3]) : 64ull;
+    const auto requests = argc > 4 ? std::stoull(argv[4]) : 100ull;
+    const auto delay = argc > 5 ? std::stoull(argv[5]) : 2000ull;
+    auto batchSizes = std::vector<UInt>();
+    for (auto i = 6; i < argc; i++)
+        batchSizes.push_back(std::stoull(argv[i]));
+    if (batchSizes.empty())
+        batchSizes = { 1, 16, 64 };
+
+    auto session = DNNInferenceCreate(definition.str().c_str(), argv[2], 1, false);
+    if (!session)
+    {
+        std::cout << std::string("Could not create an inference session") << std::endl;
+        return 1;
+    }
+
+    std::cout << std::string("Clients: ") << std::to_string(clients) << std::string("  Requests: ") << std::to_string(requests) << std::string("  Max delay: ") << std::to_string(delay) << std::string(" us") << std::endl << std::endl;
+    std::cout << std::string("Batch   Avg batch   Requests/s   p50 ms   p90 ms   p99 ms   max ms") << std::endl;
+
+    for (const auto batchSize : batchSizes)
+    {
+        auto batcher = DNNInferenceBatcherCreate(session, batchSize, UInt(delay));
+        if (!batcher)
+        {
+            std::cout << std::string("Could not create a batcher with batch size ") << std::to_string(batchSize) << std::endl;
+            continue;
+        }
+
+        auto info = BatcherBenchmarkInfo();
+        DNNInferenceBatcherBenchmark(batcher, clients, requests, &info);
+        DNNInferenceBatcherDispose(batcher);
+
+        std::cout << std::setw(5) << batchSize << std::setw(12) << FloatToStringFixed(info.AvgBatchSize, 2) << std::setw(13) << FloatToStringFixed(info.Throughput, 1) << std::setw(9) << FloatToStringFixed(info.LatencyP50, 2) << std::setw(9) << FloatToStringFixed(info.LatencyP90, 2) << std::setw(9) << FloatToStringFixed(info.LatencyP99, 2) << std::setw(9) << FloatToStringFixed(info.LatencyMax, 2) << std::endl;
+    }
+
+    DNNInferenceDispose(session);
+
+    return 0;
+}
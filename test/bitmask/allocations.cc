@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <include/Utils.h>
+
+#include <testers/definitions.h>
+
+
+// every convolution feeds only a Relu, with bit masks nothing reads its Neurons in the backward pass
+static std::string MaskedDefinition()
+{
+	using namespace scripts;
+
+	auto net = DefinitionHeader("bitmask");
+
+	net += ScriptsCatalog::Convolution(1, "Input", 16, 3, 3, 1, 1, 1, 1);
+	net += ScriptsCatalog::Activation(1, "C1", "Relu");
+	net += ScriptsCatalog::Convolution(2, "ACT1", 16, 3, 3, 1, 1, 1, 1);
+	net += ScriptsCatalog::Activation(2, "C2", "Relu");
+	net += ClassifierHead("ACT2");
+
+	return net;
+}
+
+static std::unique_ptr<dnn::Model> MaskedModel(const bool bitMasks)
+{
+	auto model = ReadModel(MaskedDefinition());
+	if (!model)
+		return nullptr;
+
+	model->InitializeLayers(4);
+	model->BatchSize = 4;
+	if (!model->SetBitMasks(bitMasks))
+		return nullptr;
+
+	return model;
+}
+
+static dnn::UInt NeuronsSize(const dnn::Model& model)
+{
+	auto size = dnn::UInt(0);
+	for (const auto& layer : model.Layers)
+		size += layer->Neurons.size();
+
+	return size;
+}
+
+TEST(BitMask, TrainingPlanEndsInputsInForwardPass) {
+	auto plain = MaskedModel(false);
+	auto masked = MaskedModel(true);
+	ASSERT_TRUE(plain && masked);
+
+	EXPECT_LT(masked->GetMemoryPlanInfo().TrainingArenaSize, plain->GetMemoryPlanInfo().TrainingArenaSize);
+	EXPECT_EQ(masked->GetMemoryPlanInfo().InferenceArenaSize, plain->GetMemoryPlanInfo().InferenceArenaSize);
+}
+
+TEST(BitMask, TrainingStepReleasesInputs) {
+	auto plain = MaskedModel(false);
+	auto masked = MaskedModel(true);
+	ASSERT_TRUE(plain && masked);
+
+	plain->BenchmarkStep(4, 1);
+	masked->BenchmarkStep(4, 1);
+
+	for (const auto name : { "C1", "C2" })
+	{
+		EXPECT_FALSE(FindLayer(*plain, name)->Neurons.empty());
+		EXPECT_TRUE(FindLayer(*masked, name)->Neurons.empty());
+	}
+	for (const auto name : { "ACT1", "ACT2", "GAP" })
+		EXPECT_FALSE(FindLayer(*masked, name)->Neurons.empty());
+
+	EXPECT_LT(NeuronsSize(*masked), NeuronsSize(*plain));
+}
+
+int main(int argc, char* argv[]) {
+	setenv("TERM", "xterm-256color", 0);
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
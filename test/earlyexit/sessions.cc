@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include <include/Utils.h>
+
+#include <testers/definitions.h>
+#include <InferenceSession.h>
+
+
+// a first head on ACT1 can answer early, C2 behind it still reads ACT1 for the samples that go on
+static std::string TwoHeadDefinition()
+{
+	using namespace scripts;
+
+	auto net = DefinitionHeader("earlyexit");
+
+	net += ScriptsCatalog::Convolution(1, "Input", 16, 3, 3, 1, 1, 1, 1);
+	net += ScriptsCatalog::Activation(1, "C1", "Relu");
+	net += ClassifierHead("ACT1", "E1");
+	net += ScriptsCatalog::Convolution(2, "ACT1", 16, 3, 3, 1, 1, 1, 1);
+	net += ScriptsCatalog::Activation(2, "C2", "Relu");
+	net += ClassifierHead("ACT2");
+
+	return net;
+}
+
+static std::unique_ptr<dnn::InferenceSession> TwoHeadSession(const dnn::UInt batchSize)
+{
+	auto model = ReadModel(TwoHeadDefinition());
+	if (!model)
+		return nullptr;
+
+	const auto weights = (std::filesystem::temp_directory_path() / "earlyexit-weights.bin").string();
+	if (model->SaveWeights(weights) != 0)
+		return nullptr;
+
+	auto msg = dnn::CheckMsg();
+	auto session = dnn::InferenceSession::Create(TwoHeadDefinition(), weights, batchSize, nullptr, false, msg);
+	std::filesystem::remove(weights);
+
+	return msg.Error ? nullptr : std::move(session);
+}
+
+TEST(EarlyExit, PartialExitMatchesFullRun) {
+	constexpr auto batchSize = dnn::UInt(4);
+
+	auto session = TwoHeadSession(batchSize);
+	ASSERT_TRUE(session);
+	ASSERT_EQ(session->GetOutputCount(), 2ull);
+
+	const auto size = session->GetOutputSize(1);
+	auto input = std::vector<dnn::Byte>(batchSize * session->GetInputSize());
+	for (auto i = 0ull; i < input.size(); i++)
+		input[i] = dnn::Byte((i * 7919ull + (i / 97ull) * 31ull) % 256ull);
+
+	auto exits = std::vector<dnn::UInt>(batchSize);
+
+	// without exits every sample runs through the last head
+	auto last = std::vector<dnn::Float>(batchSize * size);
+	session->SetEarlyExit(dnn::Float(0));
+	ASSERT_TRUE(session->RunEarlyExit(input.data(), batchSize, last.data(), exits.data()));
+
+	// a threshold every sample reaches answers all of them with the first head
+	auto first = std::vector<dnn::Float>(batchSize * size);
+	ASSERT_EQ(session->SetEarlyExit(std::numeric_limits<dnn::Float>::min()), 1ull);
+	ASSERT_TRUE(session->RunEarlyExit(input.data(), batchSize, first.data(), exits.data()));
+	for (const auto exit : exits)
+		ASSERT_EQ(exit, 0ull);
+
+	// the first head is LogSoftmax, its confidence is the exponent of the largest output
+	auto confidences = std::vector<dnn::Float>(batchSize);
+	for (auto n = 0ull; n < batchSize; n++)
+		confidences[n] = std::exp(*std::max_element(first.begin() + n * size, first.begin() + (n + 1ull) * size));
+
+	auto sorted = confidences;
+	std::sort(sorted.begin(), sorted.end());
+	ASSERT_LT(sorted[1], sorted[2]);
+
+	// half of the batch exits, the other half goes on as a batch of two
+	const auto threshold = (sorted[1] + sorted[2]) / dnn::Float(2);
+	auto output = std::vector<dnn::Float>(batchSize * size);
+	ASSERT_EQ(session->SetEarlyExit(threshold), 1ull);
+	ASSERT_TRUE(session->RunEarlyExit(input.data(), batchSize, output.data(), exits.data()));
+
+	for (auto n = 0ull; n < batchSize; n++)
+	{
+		const auto early = confidences[n] >= threshold;
+		EXPECT_EQ(exits[n], early ? 0ull : 1ull) << "sample " << n;
+
+		const auto& expected = early ? first : last;
+		for (auto i = n * size; i < (n + 1ull) * size; i++)
+			EXPECT_NEAR(output[i], expected[i], dnn::Float(1e-4)) << "sample " << n;
+	}
+
+	// the session is back at its batch size, a second run answers the same
+	auto again = std::vector<dnn::Float>(batchSize * size);
+	ASSERT_TRUE(session->RunEarlyExit(input.data(), batchSize, again.data(), exits.data()));
+	for (auto i = 0ull; i < output.size(); i++)
+		EXPECT_NEAR(again[i], output[i], dnn::Float(1e-4));
+}
+
+int main(int argc, char* argv[]) {
+	setenv("TERM", "xterm-256color", 0);
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <include/Utils.h>
+
+#include <testers/definitions.h>
+
+
+// a residual Add followed by the activation under test, so the memory plan puts the activation in the Neurons of the Add
+static std::string MergeDefinition(const std::string& activation, const std::string& parameters)
+{
+	using namespace scripts;
+
+	auto net = DefinitionHeader("fusedepilogue");
+
+	net += ScriptsCatalog::Convolution(1, "Input", 16, 3, 3, 1, 1, 1, 1);
+	net += ScriptsCatalog::Convolution(2, "C1", 16, 3, 3, 1, 1, 1, 1);
+	net += ScriptsCatalog::Add(1, "C1,C2");
+	net += "[ACT1]" + nwl + "Type=Activation" + nwl + "Inputs=A1" + nwl + "Activation=" + activation + nwl + parameters + nwl;
+	net += ClassifierHead("ACT1");
+
+	return net;
+}
+
+static std::unique_ptr<dnn::Model> PlannedModel(const std::string& definition)
+{
+	auto model = ReadModel(definition);
+	if (!model)
+		return nullptr;
+
+	model->InitializeLayers(1);
+	model->BatchSize = 1;
+	if (!model->ApplyMemoryPlan())
+		return nullptr;
+
+	return model;
+}
+
+static dnn::Activation* ActivationLayer(dnn::Model& model)
+{
+	return dynamic_cast<dnn::Activation*>(FindLayer(model, "ACT1"));
+}
+
+static void Forward(dnn::Model& model)
+{
+	auto& input = model.Layers[0]->Neurons;
+	for (auto i = 0ull; i < input.size(); i++)
+		input[i] = dnn::Float(i % 7) - dnn::Float(3);
+
+	for (auto i = 1ull; i < model.Layers.size(); i++)
+		if (model.Layers[i]->LayerType != dnn::LayerTypes::Cost)
+			model.Layers[i]->ForwardProp(1, false);
+}
+
+TEST(FusedEpilogue, FusesActivationWithKernel) {
+	auto model = PlannedModel(MergeDefinition("Relu", ""));
+	ASSERT_TRUE(model);
+
+	const auto activation = ActivationLayer(*model);
+	ASSERT_TRUE(activation);
+	EXPECT_TRUE(activation->FusedWithMerge);
+
+	Forward(*model);
+	for (auto i = 0ull; i < activation->CDHW(); i++)
+		EXPECT_GE(activation->Neurons[i], dnn::Float(0));
+}
+
+// Clip, ClipV2, GeluErf and GeluTanh only run in oneDNN, the Add keeps its own pass and the activation runs after it
+TEST(FusedEpilogue, SkipsActivationsWithoutKernel) {
+	const auto activations = std::vector<std::pair<std::string, std::string>>({
+		{ "Clip", "Alpha=-1" + nwl + "Beta=1" + nwl },
+		{ "ClipV2", "Alpha=-1" + nwl + "Beta=1" + nwl },
+		{ "GeluErf", "" },
+		{ "GeluTanh", "" } });
+
+	for (const auto& activation : activations)
+	{
+		auto model = PlannedModel(MergeDefinition(activation.first, activation.second));
+		ASSERT_TRUE(model) << activation.first;
+
+		const auto layer = ActivationLayer(*model);
+		ASSERT_TRUE(layer) << activation.first;
+		EXPECT_FALSE(layer->FusedWithMerge) << activation.first;
+
+		Forward(*model);
+		for (auto i = 0ull; i < layer->CDHW(); i++)
+		{
+			EXPECT_TRUE(std::isfinite(layer->Neurons[i])) << activation.first;
+			if (activation.first == "Clip" || activation.first == "ClipV2")
+			{
+				EXPECT_GE(layer->Neurons[i], dnn::Float(-1)) << activation.first;
+				EXPECT_LE(layer->Neurons[i], dnn::Float(1)) << activation.first;
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	setenv("TERM", "xterm-256color", 0);
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <include/Utils.h>
+
+#include <testers/definitions.h>
+
+
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+	allocations++;
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+// a convolution with an inplace BatchNormRelu feeding a residual Add, so the backward inputs differ from the forward ones
+static std::string ResidualDefinition()
+{
+	using namespace scripts;
+
+	auto net = DefinitionHeader("inplacebwd", "Scaling=Yes" + nwl + "Momentum=0.995000" + nwl + "Eps=0.000100" + nwl);
+
+	net += ScriptsCatalog::Convolution(1, "Input", 16, 3, 3, 1, 1, 1, 1);
+	net += "[B1]" + nwl + "Type=BatchNormRelu" + nwl + "Inputs=C1" + nwl + nwl;
+	net += ScriptsCatalog::Convolution(2, "B1", 16, 3, 3, 1, 1, 1, 1);
+	net += "[B2]" + nwl + "Type=BatchNormRelu" + nwl + "Inputs=C2" + nwl + nwl;
+	net += ScriptsCatalog::Add(1, "B1,B2");
+	net += ClassifierHead("A1");
+
+	return net;
+}
+
+TEST(InplaceBwd, SwitchIsAllocationFree) {
+	auto model = ReadModel(ResidualDefinition());
+	ASSERT_TRUE(model);
+
+	model->SwitchInplaceBwd(true);
+	model->SwitchInplaceBwd(false);
+
+	const auto before = allocations.load();
+	for (auto i = 0; i < 1000; i++)
+	{
+		model->SwitchInplaceBwd(true);
+		model->SwitchInplaceBwd(false);
+	}
+	EXPECT_EQ(allocations.load(), before);
+
+	model->SwitchInplaceBwd(true);
+	for (const auto& layer : model->Layers)
+	{
+		ASSERT_EQ(layer->Inputs.size(), layer->InputsBwd.size());
+		for (auto j = 0ull; j < layer->Inputs.size(); j++)
+			EXPECT_EQ(layer->Inputs[j], layer->InputsBwd[j]);
+		EXPECT_EQ(layer->InputLayer, layer->InputLayerBwd);
+	}
+
+	model->SwitchInplaceBwd(false);
+	for (const auto& layer : model->Layers)
+	{
+		ASSERT_EQ(layer->Inputs.size(), layer->InputsFwd.size());
+		for (auto j = 0ull; j < layer->Inputs.size(); j++)
+			EXPECT_EQ(layer->Inputs[j], layer->InputsFwd[j]);
+		EXPECT_EQ(layer->InputLayer, layer->InputLayerFwd);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	setenv("TERM", "xterm-256color", 0);
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include <include/Utils.h>
+
+#include <testers/definitions.h>
+#include <Pruning.h>
+
+
+// C1 feeds C2 through B1, only C1 can be pruned (C2 is read by the global average pooling). Half of its 32 channels
+// stays a multiple of the vector size.
+static std::string PrunableDefinition(const bool scaling)
+{
+	using namespace scripts;
+
+	auto net = DefinitionHeader("pruning", std::string("Scaling=") + (scaling ? "Yes" : "No") + nwl);
+
+	net += ScriptsCatalog::Convolution(1, "Input", 32, 3, 3, 1, 1, 1, 1);
+	net += "[B1]" + nwl + "Type=BatchNormRelu" + nwl + "Inputs=C1" + nwl + nwl;
+	net += ScriptsCatalog::Convolution(2, "B1", 16, 3, 3, 1, 1, 1, 1);
+	net += "[B2]" + nwl + "Type=BatchNormRelu" + nwl + "Inputs=C2" + nwl + nwl;
+	net += ClassifierHead("B2");
+
+	return net;
+}
+
+static void Forward(dnn::Model& model, const dnn::UInt batchSize)
+{
+	auto& input = model.Layers[0]->Neurons;
+	for (auto i = 0ull; i < input.size(); i++)
+		input[i] = dnn::Float(i % 11) / dnn::Float(5) - dnn::Float(1);
+
+	for (auto i = 1ull; i < model.Layers.size(); i++)
+		if (model.Layers[i]->LayerType != dnn::LayerTypes::Cost)
+			model.Layers[i]->ForwardProp(batchSize, false);
+}
+
+TEST(Pruning, ZeroGammaChannelsPruneWithoutChange) {
+	constexpr auto batchSize = dnn::UInt(2);
+
+	auto model = ReadModel(PrunableDefinition(true));
+	ASSERT_TRUE(model);
+
+	// the upper half of the channels of B1 outputs Relu(0 * x + 0) = 0
+	auto bn = FindLayer(*model, "B1");
+	ASSERT_TRUE(bn && bn->Scaling);
+	for (auto c = 0ull; c < bn->C; c++)
+	{
+		bn->Weights[c] = c < bn->C / 2ull ? dnn::Float(1) : dnn::Float(0);
+		bn->Biases[c] = c < bn->C / 2ull ? dnn::Float(0.1) : dnn::Float(0);
+	}
+
+	auto msg = dnn::CheckMsg();
+	auto info = dnn::PruneInfo();
+	auto pruned = std::unique_ptr<dnn::Model>(dnn::Pruner::Prune(*model, dnn::Float(0.5), dnn::PruneCriteria::Gamma, msg, info));
+	ASSERT_TRUE(pruned && !msg.Error);
+	EXPECT_EQ(info.Groups, 1ull);
+	EXPECT_EQ(FindLayer(*pruned, "C1")->C, bn->C / 2ull);
+
+	model->InitializeLayers(batchSize);
+	pruned->InitializeLayers(batchSize);
+	Forward(*model, batchSize);
+	Forward(*pruned, batchSize);
+
+	const auto& expected = FindLayer(*model, "LSM")->Neurons;
+	const auto& actual = FindLayer(*pruned, "LSM")->Neurons;
+	ASSERT_EQ(actual.size(), expected.size());
+	for (auto i = 0ull; i < expected.size(); i++)
+		EXPECT_NEAR(actual[i], expected[i], dnn::Float(1e-5));
+}
+
+// a batch normalization without scaling keeps gamma at 1, the channels are ranked by the L1 norm of their filters
+TEST(Pruning, GammaWithoutScalingRanksByFilters) {
+	auto model = ReadModel(PrunableDefinition(false));
+	ASSERT_TRUE(model);
+
+	const auto groups = dnn::Pruner::Groups(*model);
+	ASSERT_EQ(groups.size(), 1ull);
+
+	const auto gamma = dnn::Pruner::Scores(*model, groups[0], dnn::PruneCriteria::Gamma);
+	const auto l1 = dnn::Pruner::Scores(*model, groups[0], dnn::PruneCriteria::L1);
+	ASSERT_EQ(gamma.size(), l1.size());
+	for (auto c = 0ull; c < l1.size(); c++)
+		EXPECT_EQ(gamma[c], l1[c]);
+}
+
+int main(int argc, char* argv[]) {
+	setenv("TERM", "xterm-256color", 0);
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
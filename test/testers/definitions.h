@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <Definition.h>
+#include <Scripts.h>
+
+
+// the header every test definition starts with, parameters holds the lines of the layers defaults that differ
+inline std::string DefinitionHeader(const std::string& name, const std::string& parameters = "")
+{
+	using namespace scripts;
+
+	return
+		"[" + name + "]" + nwl +
+		"Dataset=cifar10" + nwl +
+		"Dim=3,16,16" + nwl +
+		"WeightsFiller=HeNormal(In,1.000000)" + nwl +
+		"Biases=No" + nwl +
+		parameters + nwl;
+}
+
+// global average pooling, a dense layer and a LogSoftmax cost over the 10 classes of cifar10, a second head takes a group
+inline std::string ClassifierHead(const std::string& input, const std::string& group = "")
+{
+	using namespace scripts;
+
+	return
+		ScriptsCatalog::GlobalAvgPooling(input, group) +
+		ScriptsCatalog::Dense(1, group + "GAP", 10, true, group) +
+		ScriptsCatalog::LogSoftmax(group + "DS1", group) +
+		ScriptsCatalog::Cost(group + "LSM", Datasets::cifar10, 10, "CategoricalCrossEntropy", 0.0f, group);
+}
+
+inline std::unique_ptr<dnn::Model> ReadModel(const std::string& definition, const bool forwardOnly = false)
+{
+	auto msg = dnn::CheckMsg();
+	auto model = std::unique_ptr<dnn::Model>(dnn::Read(definition, nullptr, msg, forwardOnly));
+
+	return (model && !msg.Error) ? std::move(model) : nullptr;
+}
+
+inline dnn::Layer* FindLayer(dnn::Model& model, const std::string& name)
+{
+	for (const auto& layer : model.Layers)
+		if (layer->Name == name)
+			return layer.get();
+
+	return nullptr;
+}